@@ -0,0 +1,37 @@
+#include "../stdafx.h"
+#include "Components/ComponentRegistry.h"
+#include "Components/EntityComponent.h"
+
+
+ComponentRegistry::Storage* ComponentRegistry::storage = nullptr;
+std::atomic<size_t> ComponentRegistry::nextTypeId{ 0 };
+
+ComponentRegistry::Storage& ComponentRegistry::getStorage() {
+	if (!storage) storage = new Storage();
+	return *storage;
+}
+
+void ComponentRegistry::remove(size_t type, EntityComponent* component) {
+	Storage& s = getStorage();
+	// Components removed before they began play are taken off the queue.
+	if (!component->hasBegunPlay) {
+		auto queued = std::find(s.beginPlayQueue.begin(), s.beginPlayQueue.end(), component);
+		if (queued != s.beginPlayQueue.end()) s.beginPlayQueue.erase(queued);
+	}
+	s.pools[type]->remove(component);
+}
+
+void ComponentRegistry::update(float deltaTime, JobSystem& jobs) {
+	Storage& s = getStorage();
+	// Components may add more components in beginPlay(), which are begun in the same pass.
+	for (size_t i = 0; i < s.beginPlayQueue.size(); i++) {
+		EntityComponent* component = s.beginPlayQueue[i];
+		component->hasBegunPlay = true;
+		component->beginPlay();
+	}
+	s.beginPlayQueue.clear();
+
+	for (ComponentPoolBase* pool : s.pools) {
+		if (pool) pool->scheduleUpdate(deltaTime, jobs);
+	}
+}
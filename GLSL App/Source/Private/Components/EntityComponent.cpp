@@ -1,6 +1,7 @@
 #include "../stdafx.h"
 #include "Components/EntityComponent.h"
 #include "Entities/Entity.h"
+#include "World.h"
 
 
 EntityComponent::EntityComponent(Entity* owner) {
@@ -8,13 +9,8 @@ EntityComponent::EntityComponent(Entity* owner) {
 }
 
 EntityComponent::~EntityComponent() {
-	std::cout << "Component destroyed" << std::endl;
+	// The pool reuses the component's slot, so bindings capturing it would call whatever is created there next.
+	if (owner && owner->getWorld()) owner->getWorld()->getInputManager().removeBindings(this);
 }
 
-void EntityComponent::beginPlay() {
-	hasBegunPlay = true;
-}
-
-void EntityComponent::update(float deltaTime) {
-	if (!hasBegunPlay) beginPlay();
-}
+void EntityComponent::beginPlay() {}
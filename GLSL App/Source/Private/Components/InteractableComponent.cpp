@@ -7,39 +7,39 @@ InteractableComponent::InteractableComponent(Entity* owner) : EntityComponent(ow
 	owner->getWorld()->getInputManager().addTriggerBinding(InputManager::MOUSE_LEFT, InputManager::INPUT_PRESSED, [this]() {
 		selectionPressed = true;
 		selected = isHovered;
-	});
+	}, this);
 	owner->getWorld()->getInputManager().addTriggerBinding(InputManager::MOUSE_LEFT, InputManager::INPUT_RELEASED, [this]() {
 		selectionPressed = false;
 		selected = false;
-	});
+	}, this);
 
 	// Bind move button.
 	owner->getWorld()->getInputManager().addTriggerBinding('g', InputManager::INPUT_PRESSED, [this]() {
 		movePressed = true;
-	});
+	}, this);
 	owner->getWorld()->getInputManager().addTriggerBinding('g', InputManager::INPUT_RELEASED, [this]() {
 		movePressed = false;
-	});
+	}, this);
 
 	// Bind scale button.
 	owner->getWorld()->getInputManager().addTriggerBinding('f', InputManager::INPUT_PRESSED, [this]() {
 		scalePressed = true;
-	});
+	}, this);
 	owner->getWorld()->getInputManager().addTriggerBinding('f', InputManager::INPUT_RELEASED, [this]() {
 		scalePressed = false;
-	});
+	}, this);
 
 	// Bind mouse over/out.
 	owner->getWorld()->getInputManager().adddEventBinding(owner, InputManager::MOUSE_OVER, [this]() {
 		isHovered = true;
-	});
+	}, this);
 	owner->getWorld()->getInputManager().adddEventBinding(owner, InputManager::MOUSE_OUT, [this]() {
 		isHovered = false;
-	});
+	}, this);
 
 	// Mouse movement for rotation.
-	owner->getWorld()->getInputManager().addValueBinding(InputManager::EMouseAxis::MOUSE_X, std::bind(&InteractableComponent::manipulateRight, this, std::placeholders::_1));
-	owner->getWorld()->getInputManager().addValueBinding(InputManager::EMouseAxis::MOUSE_Y, std::bind(&InteractableComponent::manipulateUp, this, std::placeholders::_1));
+	owner->getWorld()->getInputManager().addValueBinding(InputManager::EMouseAxis::MOUSE_X, std::bind(&InteractableComponent::manipulateRight, this, std::placeholders::_1), this);
+	owner->getWorld()->getInputManager().addValueBinding(InputManager::EMouseAxis::MOUSE_Y, std::bind(&InteractableComponent::manipulateUp, this, std::placeholders::_1), this);
 }
 
 void InteractableComponent::manipulateUp(float val) {
@@ -6,18 +6,11 @@
 
 RotatingComponent::RotatingComponent(Entity* owner) : EntityComponent(owner) {}
 
-void RotatingComponent::beginPlay() {
-	EntityComponent::beginPlay();
-
-	// Get a pointer to the interactable component. Will be null if there isn't one.
-	interactableComponent = getOwner()->getComponent<InteractableComponent>();
-}
-
 void RotatingComponent::update(float deltaTime) {
-	EntityComponent::update(deltaTime);
-
 	if (!getOwner()) return;
-	
+	// Looked up each time rather than kept, as a removed component's pool slot is reused by the next one created.
+	InteractableComponent* interactableComponent = getOwner()->getComponent<InteractableComponent>();
+
 	// Only rotate when not selected, or if there isn't an interactable component.
 	if ((interactableComponent && !interactableComponent->isSelected()) || !interactableComponent) {
 		getOwner()->rotateBy(speed * deltaTime, axis, localSpace);
@@ -49,17 +49,24 @@ Camera::Camera(World* world) : Entity(world) {
 	});
 
 	// Rotation flag.
+	// Window calls are made on the render thread, as bindings may run on the simulation thread.
 	world->getInputManager().addTriggerBinding(InputManager::MOUSE_RIGHT, InputManager::INPUT_PRESSED, [this]() {
 		rotateCamera = true;
 		// Hide the cursor when looking around.
-		glutSetCursor(GLUT_CURSOR_NONE);
+		getWorld()->runOnRenderThread([]() {
+			glutSetCursor(GLUT_CURSOR_NONE);
+		});
 	});
 	world->getInputManager().addTriggerBinding(InputManager::MOUSE_RIGHT, InputManager::INPUT_RELEASED, [this]() {
 		rotateCamera = false;
-		// Show the cursor when looking around stops.
-		glutSetCursor(GLUT_CURSOR_INHERIT);
-		// Snap cursor back to centre of the screen when looking stops.
-		glutWarpPointer(screenWidth / 2, screenHeight / 2);
+		int centreX = (int)(screenWidth / 2);
+		int centreY = (int)(screenHeight / 2);
+		getWorld()->runOnRenderThread([centreX, centreY]() {
+			// Show the cursor when looking around stops.
+			glutSetCursor(GLUT_CURSOR_INHERIT);
+			// Snap cursor back to centre of the screen when looking stops.
+			glutWarpPointer(centreX, centreY);
+		});
 	});
 
 	// Look
@@ -105,7 +112,24 @@ void Camera::updateMatrices(float FOV, float screenWidth, float screenHeight, fl
 
 void Camera::updateMatrices() {
 	projectionMatrix = glm::perspective(FOV, screenWidth / screenHeight, nearClippingPlane, farClippingPlane);
-	viewMatrix = glm::lookAt(getPosition(), getPosition() + getForwardVector(), getUpVector());
+	viewMatrix = getViewMatrix(getPosition(), getRotation());
+}
+
+CameraView Camera::getView() const {
+	CameraView view;
+	view.projectionMatrix = projectionMatrix;
+	view.viewMatrix = viewMatrix;
+	view.position = getPosition();
+	view.FOV = FOV;
+	view.screenWidth = screenWidth;
+	view.screenHeight = screenHeight;
+	view.nearClippingPlane = nearClippingPlane;
+	view.farClippingPlane = farClippingPlane;
+	return view;
+}
+
+glm::mat4 Camera::getViewMatrix(const glm::vec3& position, const glm::quat& rotation) {
+	return glm::lookAt(position, position + FORWARD_VECTOR * rotation, UP_VECTOR * rotation);
 }
 
 void Camera::lookRight(float deltaDegrees) {
@@ -1,10 +1,12 @@
 #include "../stdafx.h"
 #include "Entities/Entity.h"
 #include "Components/EntityComponent.h"
+#include "World.h"
 #include "glm\gtc\matrix_transform.hpp"
 #include "glm\gtx\quaternion.hpp"
 
 
+std::atomic<GLuint> Entity::nextId{ 1 };
 
 Entity::Entity(World* world) {
 	this->world = world;
@@ -21,32 +23,65 @@ Entity::Entity(World* world, Model model) {
 	this->model = Model(model);
 }
 
-Entity::~Entity() {
-	// Clean up components.
-	/*for (auto* component : components) {
-		delete component;
-	}*/
+Entity::Entity(const Entity& other) : ITransform(other), model(other.model), world(other.world) {}
+
+Entity& Entity::operator=(const Entity& other) {
+	ITransform::operator=(other);
+	model = other.model;
+	world = other.world;
+	return *this;
 }
 
-void Entity::update(float deltaTime) {
-	// Update components.
-	for (auto& component : components) {
-		if (component) component->update(deltaTime);
+Entity::~Entity() {
+	if (world) world->removeEntityId(this);
+	// Clean up components.
+	for (size_t type = 0; type < components.size(); type++) {
+		if (components[type]) ComponentRegistry::remove(type, components[type]);
 	}
 }
 
-void Entity::render(GLuint shaderProgram) {
-	// Update model matrices.
-	glm::mat4 modelMatrix = glm::mat4(1.f);
-	modelMatrix = glm::translate(modelMatrix, getPosition());
-	// Apply rotation.
-	modelMatrix *= glm::toMat4(getRotation());
-	// Scale.
-	modelMatrix = glm::scale(modelMatrix, getScale());
+void Entity::update(float deltaTime) {}
 
+void Entity::render(const ShaderProgram& shader) {
 	// Send model matrix to shader.
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MODEL, modelMatrix);
+	shader.setValue(shader.getUniforms().model, getModelMatrix());
 
 	// Render the model.
-	model.render(shaderProgram);
+	model.render(shader);
+}
+
+float Entity::getBoundingRadius() {
+	// Rotation doesn't change a sphere around the origin, so only the largest scale axis matters.
+	glm::vec3 scale = getWorldScale();
+	return model.getBoundingRadius() * glm::max(scale.x, glm::max(scale.y, scale.z));
+}
+
+void Entity::setModel(const Model& model) {
+	this->model = model;
+	// Bounding radius may have changed.
+	markTransformChanged();
+}
+
+bool Entity::attachTo(Entity* parent, bool keepWorldTransform/* = true*/) {
+	return setParent(parent, keepWorldTransform);
+}
+
+void Entity::detach(bool keepWorldTransform/* = true*/) {
+	setParent(nullptr, keepWorldTransform);
+}
+
+std::vector<uint8_t>& Entity::getMeshLODs() {
+	// Reset if the model has changed.
+	if (meshLODs.size() != model.getMeshes().size()) meshLODs.assign(model.getMeshes().size(), 0);
+	return meshLODs;
+}
+
+AABB Entity::getBounds() {
+	return AABB::fromSphere(getWorldPosition(), getBoundingRadius());
+}
+
+void Entity::onTransformUpdated() {
+	if (boundsDirty || !world) return;
+	boundsDirty = true;
+	world->markBoundsDirty(this);
 }
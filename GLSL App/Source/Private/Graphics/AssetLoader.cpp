@@ -0,0 +1,218 @@
+#include "../stdafx.h"
+#include "Graphics/AssetLoader.h"
+#include "Graphics/TextureManager.h"
+#include "Utils/Utils.h"
+#include <assimp/Importer.hpp>
+#include <chrono>
+#include <set>
+#include <algorithm>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static inline double millisecondsSince(const Clock::time_point& start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+AssetLoader::AssetLoader() {}
+
+AssetLoader::~AssetLoader() {
+	stop();
+}
+
+void AssetLoader::start(unsigned int numThreads/* = 0*/) {
+	if (!workers.empty()) return;
+	if (numThreads == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned int i = 0; i < numThreads; i++) {
+		workers.emplace_back(&AssetLoader::workerLoop, this);
+	}
+}
+
+void AssetLoader::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	uploadReady.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	// Free anything that was decoded but never uploaded.
+	auto freeTextures = [](Request& request) {
+		for (auto& texture : request.textures) {
+			if (texture.pixels) SOIL_free_image_data(texture.pixels);
+			texture.pixels = nullptr;
+		}
+	};
+	for (auto& request : uploadQueue) freeTextures(*request);
+	if (currentUpload) freeTextures(*currentUpload);
+	loadQueue.clear();
+	uploadQueue.clear();
+	currentUpload.reset();
+}
+
+void AssetLoader::load(const std::string& path, const Model::ImportSettings& importSettings, LoadedCallback callback) {
+	RequestPtr request(new Request());
+	request->path = path;
+	request->importSettings = importSettings;
+	request->callback = callback;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		loadQueue.push_back(std::move(request));
+		stats.requested++;
+		stats.queued++;
+	}
+	workAvailable.notify_one();
+}
+
+void AssetLoader::workerLoop() {
+	// Reused for every model this worker imports.
+	Assimp::Importer importer;
+	while (true) {
+		RequestPtr request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			// Wait for a request and for space in the upload queue, counting imports that will join it.
+			workAvailable.wait(lock, [this]() {
+				return stopping || (!loadQueue.empty() && uploadQueue.size() + stats.loading < maxPendingUploads);
+			});
+			if (stopping) return;
+			request = std::move(loadQueue.front());
+			loadQueue.pop_front();
+			stats.queued--;
+			stats.loading++;
+		}
+
+		loadRequest(*request, importer);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.loading--;
+			stats.waitingForUpload++;
+			uploadQueue.push_back(std::move(request));
+		}
+		uploadReady.notify_one();
+	}
+}
+
+void AssetLoader::loadRequest(Request& request, Assimp::Importer& importer) {
+	auto importStart = Clock::now();
+	request.success = Model::import(request.path, request.importSettings, request.data, importer);
+	double importMs = millisecondsSince(importStart);
+
+	// Decode each texture once, even if several meshes use it.
+	auto decodeStart = Clock::now();
+	unsigned int texturesDecoded = 0;
+	if (request.success) {
+		std::set<std::string> paths;
+		for (auto& mesh : request.data.meshes) {
+			for (auto& textureRef : mesh.textures) {
+				paths.insert(request.data.baseDir + textureRef.path);
+			}
+		}
+		for (auto& path : paths) {
+			DecodedTexture texture;
+			texture.path = path;
+			texture.pixels = SOIL_load_image(path.c_str(), &texture.width, &texture.height, &texture.channels, SOIL_LOAD_AUTO);
+			request.textures.push_back(texture);
+			texturesDecoded++;
+		}
+	}
+	double decodeMs = millisecondsSince(decodeStart);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.importMs += importMs;
+	stats.decodeMs += decodeMs;
+	stats.texturesDecoded += texturesDecoded;
+}
+
+void AssetLoader::update() {
+	auto updateStart = Clock::now();
+	bool uploaded = false;
+
+	// Always make at least one step so loading progresses however small the budget.
+	while (!uploaded || millisecondsSince(updateStart) < uploadBudgetMs) {
+		if (!currentUpload) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (uploadQueue.empty()) break;
+			currentUpload = std::move(uploadQueue.front());
+			uploadQueue.pop_front();
+			stats.waitingForUpload--;
+		}
+		// The upload queue has space again.
+		workAvailable.notify_one();
+
+		uploaded = true;
+		if (uploadStep(*currentUpload)) {
+			RequestPtr finished = std::move(currentUpload);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (finished->success) stats.completed++;
+				else stats.failed++;
+			}
+			if (finished->callback) finished->callback(finished->success, finished->model);
+		}
+	}
+
+	double updateMs = millisecondsSince(updateStart);
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.lastUpdateMs = uploaded ? updateMs : 0;
+	stats.uploadMs += stats.lastUpdateMs;
+}
+
+void AssetLoader::flush() {
+	if (workers.empty()) return;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			// Nothing to upload yet, so sleep until a worker finishes one.
+			uploadReady.wait(lock, [this]() {
+				return stopping || !uploadQueue.empty() || currentUpload || (loadQueue.empty() && stats.loading == 0);
+			});
+			if (stopping) return;
+			if (uploadQueue.empty() && !currentUpload && loadQueue.empty() && stats.loading == 0) return;
+		}
+		update();
+	}
+}
+
+bool AssetLoader::uploadStep(Request& request) {
+	if (!request.success) return true;
+
+	// Textures first, so creating the meshes finds them already in the TextureManager.
+	if (request.texturesUploaded < request.textures.size()) {
+		DecodedTexture& texture = request.textures[request.texturesUploaded++];
+		TextureManager::create(texture.path, texture.pixels, texture.width, texture.height, texture.channels);
+		if (texture.pixels) SOIL_free_image_data(texture.pixels);
+		texture.pixels = nullptr;
+		return false;
+	}
+
+	if (request.meshesCreated < request.data.meshes.size()) {
+		request.model.addMesh(std::move(request.data.meshes[request.meshesCreated++]), request.data.baseDir);
+		return false;
+	}
+
+	// Done with the imported arrays and any mapped cache file.
+	request.data = ModelData();
+	return true;
+}
+
+AssetLoader::Stats AssetLoader::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+float AssetLoader::getProgress() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (stats.requested == 0) return 1.f;
+	return (float)(stats.completed + stats.failed) / stats.requested;
+}
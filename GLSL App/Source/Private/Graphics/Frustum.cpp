@@ -0,0 +1,61 @@
+#include "../stdafx.h"
+#include "Graphics/Frustum.h"
+
+
+Frustum::Frustum() {}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+	// Rows of the matrix. glm is column-major, so row i is the i'th component of each column.
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	// Clip space is -w <= x, y, z <= w, so each plane is the last row plus or minus one of the others.
+	planes[PLANE_LEFT] = rows[3] + rows[0];
+	planes[PLANE_RIGHT] = rows[3] - rows[0];
+	planes[PLANE_BOTTOM] = rows[3] + rows[1];
+	planes[PLANE_TOP] = rows[3] - rows[1];
+	planes[PLANE_NEAR] = rows[3] + rows[2];
+	planes[PLANE_FAR] = rows[3] - rows[2];
+
+	// Normalise so distances are in world units.
+	for (auto& plane : planes) {
+		plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+	}
+}
+
+bool Frustum::testSphere(const glm::vec3& centre, float radius) const {
+	for (auto& plane : planes) {
+		if (plane.x * centre.x + plane.y * centre.y + plane.z * centre.z + plane.w < -radius) return false;
+	}
+	return true;
+}
+
+size_t Frustum::cullSpheres(const BoundingSphereArray& spheres, std::vector<uint8_t>& visible) const {
+	const size_t count = spheres.size();
+	visible.assign(count, 1);
+	const float* xs = spheres.x.data();
+	const float* ys = spheres.y.data();
+	const float* zs = spheres.z.data();
+	const float* radii = spheres.radius.data();
+	uint8_t* result = visible.data();
+
+	// Planes are the outer loop and the inner loop is branchless, so it vectorises across spheres.
+	for (size_t blockStart = 0; blockStart < count; blockStart += CULL_BLOCK_SIZE) {
+		const size_t blockEnd = (blockStart + CULL_BLOCK_SIZE < count) ? blockStart + CULL_BLOCK_SIZE : count;
+		for (const auto& plane : planes) {
+			const float nx = plane.x, ny = plane.y, nz = plane.z, d = plane.w;
+			for (size_t i = blockStart; i < blockEnd; i++) {
+				const float distance = nx * xs[i] + ny * ys[i] + nz * zs[i] + d;
+				result[i] &= (uint8_t)(distance >= -radii[i]);
+			}
+		}
+	}
+
+	size_t numVisible = 0;
+	for (size_t i = 0; i < count; i++) {
+		numVisible += result[i];
+	}
+	return numVisible;
+}
@@ -0,0 +1,38 @@
+#include "../stdafx.h"
+#include "Graphics/GLHandle.h"
+#include <iostream>
+
+
+int GLObjects::live[GLObjects::NUM_TYPES];
+int GLObjects::peak[GLObjects::NUM_TYPES];
+
+void GLObjects::onCreated(EType type) {
+	live[type]++;
+	if (live[type] > peak[type]) peak[type] = live[type];
+}
+
+void GLObjects::onDestroyed(EType type) {
+	live[type]--;
+}
+
+const char* GLObjects::getTypeName(EType type) {
+	static const char* names[NUM_TYPES] = { "buffers", "vertex arrays", "textures", "programs", "shaders", "framebuffers", "renderbuffers" };
+	return names[type];
+}
+
+int GLObjects::report() {
+	int total = 0;
+	for (int type = 0; type < NUM_TYPES; type++) {
+		total += live[type];
+	}
+	if (total == 0) {
+		std::cout << "GL objects: no leaks" << std::endl;
+		return 0;
+	}
+	std::cout << "GL objects leaked: " << total << std::endl;
+	for (int type = 0; type < NUM_TYPES; type++) {
+		if (live[type] == 0) continue;
+		std::cout << "  " << getTypeName((EType)type) << ": " << live[type] << " (peak " << peak[type] << ")" << std::endl;
+	}
+	return total;
+}
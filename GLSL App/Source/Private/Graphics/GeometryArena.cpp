@@ -0,0 +1,254 @@
+#include "../stdafx.h"
+#include "Graphics/GeometryArena.h"
+#include "Graphics/Mesh.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/StagingBuffer.h"
+#include "glm/gtc/packing.hpp"
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+
+
+GLVertexArray GeometryArena::vertexArrays[GeometryArena::NUM_VERTEX_FORMATS];
+GLBuffer GeometryArena::vertexBuffers[GeometryArena::NUM_VERTEX_FORMATS];
+GLBuffer GeometryArena::indexBuffer;
+GLBuffer GeometryArena::instanceBuffer;
+GLsizei GeometryArena::instanceCapacity = 0;
+RangeAllocator* GeometryArena::vertexAllocators[GeometryArena::NUM_VERTEX_FORMATS];
+RangeAllocator* GeometryArena::indexAllocator = nullptr;
+unsigned int GeometryArena::grows = 0;
+
+/** Converts vertices to the packed format, quantising positions within their bounds. */
+static void packVertices(const Vertex* vertices, GLuint vertexCount, std::vector<PackedVertex>& packed, glm::vec3& positionOffset, glm::vec3& positionScale) {
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (GLuint i = 1; i < vertexCount; i++) {
+		boundsMin = glm::min(boundsMin, vertices[i].position);
+		boundsMax = glm::max(boundsMax, vertices[i].position);
+	}
+	positionOffset = boundsMin;
+	// Flat axes still need a non-zero scale to divide by.
+	positionScale = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+
+	packed.resize(vertexCount);
+	for (GLuint i = 0; i < vertexCount; i++) {
+		const Vertex& vertex = vertices[i];
+		PackedVertex& packedVertex = packed[i];
+		glm::vec3 position = glm::clamp((vertex.position - positionOffset) / positionScale, glm::vec3(0), glm::vec3(1));
+		for (int axis = 0; axis < 3; axis++) {
+			packedVertex.position[axis] = (uint16_t)(position[axis] * 65535.f + 0.5f);
+		}
+		packedVertex.position[3] = 0;
+		packedVertex.normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0));
+		packedVertex.tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.tangent, 0));
+		packedVertex.texCoords = glm::packHalf2x16(vertex.texCoords);
+	}
+}
+
+
+void GeometryArena::init() {
+	if (indexAllocator) return;
+	indexAllocator = new RangeAllocator(INITIAL_INDICES);
+	indexBuffer = GLBuffer::create();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)INITIAL_INDICES * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+	// Streamed matrices are read from the staging ring instead.
+	if (!StagingBuffer::isSupported()) instanceBuffer = GLBuffer::create();
+
+	for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
+		EVertexFormat format = (EVertexFormat)i;
+		vertexAllocators[format] = new RangeAllocator(INITIAL_VERTICES);
+		vertexBuffers[format] = GLBuffer::create();
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffers[format]);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)INITIAL_VERTICES * getVertexSize(format), nullptr, GL_STATIC_DRAW);
+		vertexArrays[format] = GLVertexArray::create();
+		setupVertexArray(format);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::shutdown() {
+	for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
+		vertexArrays[i].reset();
+		vertexBuffers[i].reset();
+	}
+	indexBuffer.reset();
+	instanceBuffer.reset();
+	instanceCapacity = 0;
+	// The allocators are kept, so meshes still alive can free their ranges without a check.
+}
+
+GeometryArena::Range GeometryArena::allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, EVertexFormat format/* = FULL_VERTEX*/) {
+	if (!indexAllocator) init();
+
+	Range range;
+	range.format = format;
+	range.vertexCount = vertexCount;
+	range.indexCount = indexCount;
+
+	GLsizeiptr vertexSize = getVertexSize(format);
+	range.firstVertex = allocateRange(*vertexAllocators[format], vertexBuffers[format], vertexSize, vertexCount);
+	range.firstIndex = allocateRange(*indexAllocator, indexBuffer, sizeof(GLuint), indexCount);
+
+	if (vertexCount > 0) {
+		const void* vertexData = vertices;
+		std::vector<PackedVertex> packed;
+		if (format == PACKED_VERTEX) {
+			packVertices(vertices, vertexCount, packed, range.positionOffset, range.positionScale);
+			vertexData = packed.data();
+		}
+		StagingBuffer::uploadToBuffer(vertexBuffers[format], (GLintptr)range.firstVertex * vertexSize, vertexData, (GLsizeiptr)vertexCount * vertexSize);
+	}
+	if (indexCount > 0) StagingBuffer::uploadToBuffer(indexBuffer, (GLintptr)range.firstIndex * sizeof(GLuint), indices, (GLsizeiptr)indexCount * sizeof(GLuint));
+	return range;
+}
+
+void GeometryArena::free(const Range& range) {
+	if (!indexAllocator) return;
+	vertexAllocators[range.format]->free(range.firstVertex, range.vertexCount);
+	indexAllocator->free(range.firstIndex, range.indexCount);
+}
+
+void GeometryArena::readPositions(const Range& range, std::vector<glm::vec3>& positions) {
+	positions.resize(range.vertexCount);
+	if (range.vertexCount == 0 || !vertexBuffers[range.format]) return;
+	GLsizeiptr vertexSize = getVertexSize(range.format);
+	std::vector<unsigned char> bytes((size_t)range.vertexCount * vertexSize);
+	// Read through the copy binding so the element buffer of the bound vertex array isn't changed.
+	glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffers[range.format]);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)range.firstVertex * vertexSize, (GLsizeiptr)bytes.size(), bytes.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	for (GLuint i = 0; i < range.vertexCount; i++) {
+		const unsigned char* vertex = bytes.data() + (size_t)i * vertexSize;
+		if (range.format == PACKED_VERTEX) {
+			PackedVertex packed;
+			memcpy(&packed, vertex, sizeof(packed));
+			glm::vec3 position = glm::vec3(packed.position[0], packed.position[1], packed.position[2]) / 65535.f;
+			positions[i] = position * range.positionScale + range.positionOffset;
+		} else {
+			memcpy(&positions[i], vertex + offsetof(Vertex, position), sizeof(glm::vec3));
+		}
+	}
+}
+
+void GeometryArena::readIndices(GLuint firstIndex, GLuint count, std::vector<GLuint>& indices) {
+	indices.resize(count);
+	if (count == 0 || !indexBuffer) return;
+	glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)firstIndex * sizeof(GLuint), (GLsizeiptr)count * sizeof(GLuint), indices.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+GLuint GeometryArena::writeInstances(const glm::mat4* transforms, GLsizei count) {
+	StagingBuffer::Allocation allocation = StagingBuffer::allocate(count * sizeof(glm::mat4), sizeof(glm::mat4));
+	if (allocation.isValid()) {
+		memcpy(allocation.data, transforms, count * sizeof(glm::mat4));
+		// The attributes read from the start of the ring.
+		return (GLuint)(allocation.offset / sizeof(glm::mat4));
+	}
+
+	// Upload the instance matrices, growing the buffer if needed.
+	// The old storage is orphaned each time so the upload doesn't wait on the previous draw.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	if (count > instanceCapacity) instanceCapacity = count;
+	glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return 0;
+}
+
+GLsizeiptr GeometryArena::getVertexSize(EVertexFormat format) {
+	return (format == PACKED_VERTEX) ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+bool GeometryArena::supportsMultiDraw() {
+	return StagingBuffer::isSupported() && GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters;
+}
+
+GeometryArena::Stats GeometryArena::getStats() {
+	Stats stats;
+	if (!indexAllocator) return stats;
+	for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
+		GLsizeiptr vertexSize = getVertexSize((EVertexFormat)i);
+		stats.vertexBytes += vertexAllocators[i]->getCapacity() * vertexSize;
+		stats.vertexBytesUsed += vertexAllocators[i]->getUsed() * vertexSize;
+		stats.freeBlocks += vertexAllocators[i]->getNumFreeBlocks();
+	}
+	stats.indexCapacity = indexAllocator->getCapacity();
+	stats.indicesUsed = indexAllocator->getUsed();
+	stats.freeBlocks += indexAllocator->getNumFreeBlocks();
+	stats.grows = grows;
+	return stats;
+}
+
+void GeometryArena::setupVertexArray(EVertexFormat format) {
+	RenderState::bindVertexArray(vertexArrays[format]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[format]);
+	GLsizei stride = (GLsizei)getVertexSize(format);
+	for (GLuint location = 0; location < 4; location++) {
+		glEnableVertexAttribArray(location);
+	}
+
+	if (format == PACKED_VERTEX) {
+		// Position (16-bit unsigned normalised within the mesh bounds).
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, position));
+		// Normal (signed normalised 10_10_10_2).
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, normal));
+		// Texture coordinates (half float).
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(PackedVertex, texCoords));
+		// Tangent (signed normalised 10_10_10_2).
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, tangent));
+	} else {
+		// Vertex position attribute (vector 3).
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+		// Vertex normal attribute (vector 3).
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, normal));
+		// Vertex texture coordinate attribute (vector 2).
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, texCoords));
+		// Vertex tangent attribute (vector 3).
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, tangent));
+	}
+
+	// Model matrix attribute (mat4), one column per attribute location, advancing once per instance.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer ? instanceBuffer : StagingBuffer::getBuffer());
+	for (GLuint column = 0; column < 4; column++) {
+		GLuint location = Mesh::INSTANCE_MATRIX_ATTRIBUTE + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+uint32_t GeometryArena::allocateRange(RangeAllocator& allocator, GLBuffer& buffer, GLsizeiptr elementSize, uint32_t count) {
+	uint32_t offset = allocator.allocate(count);
+	if (offset != RangeAllocator::INVALID) return offset;
+
+	uint32_t oldCapacity = allocator.getCapacity();
+	uint32_t newCapacity = std::max(oldCapacity * 2, oldCapacity + count);
+	GLsizeiptr oldSize = (GLsizeiptr)oldCapacity * elementSize;
+	GLsizeiptr newSize = (GLsizeiptr)newCapacity * elementSize;
+	std::cout << "Growing geometry buffer to " << newSize / (1024 * 1024) << " MB" << std::endl;
+
+	// Replace the buffer with a larger one holding the same data.
+	GLBuffer newBuffer = GLBuffer::create();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	buffer = std::move(newBuffer);
+	grows++;
+
+	// The vertex arrays still refer to the old buffer.
+	for (int i = 0; i < NUM_VERTEX_FORMATS; i++) {
+		setupVertexArray((EVertexFormat)i);
+	}
+
+	allocator.grow(newCapacity);
+	return allocator.allocate(count);
+}
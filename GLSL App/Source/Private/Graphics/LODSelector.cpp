@@ -0,0 +1,33 @@
+#include "../stdafx.h"
+#include "Graphics/LODSelector.h"
+#include "Graphics/Mesh.h"
+#include "Entities/Camera.h"
+
+
+LODSelector::LODSelector() {}
+
+void LODSelector::beginFrame(const CameraView& camera) {
+	viewPosition = camera.position;
+	// projection[1][1] maps a unit at distance 1 to half the viewport height in clip space.
+	pixelsPerUnit = camera.projectionMatrix[1][1] * camera.screenHeight * 0.5f;
+	nearPlane = camera.nearClippingPlane;
+}
+
+GLuint LODSelector::select(const Mesh& mesh, const glm::vec3& centre, float scale, uint8_t& level) const {
+	GLuint levels = mesh.getLODCount();
+	if (!enabled || levels <= 1) {
+		level = 0;
+		return 0;
+	}
+	if (level >= levels) level = (uint8_t)(levels - 1);
+
+	float distance = glm::max(glm::length(centre - viewPosition), nearPlane);
+	float screenRadius = mesh.getBoundsRadius() * scale * pixelsPerUnit / distance;
+	auto screenError = [&](GLuint lod) { return mesh.getLOD(lod).error * screenRadius; };
+
+	// Refine while the current level is clearly too coarse, then coarsen while the next level is clearly fine.
+	// Levels that were refined away fail the coarsen test, so a mesh never moves both ways in one frame.
+	while (level > 0 && screenError(level) > maxScreenError * (1 + hysteresis)) level--;
+	while (level + 1u < levels && screenError(level + 1) <= maxScreenError * (1 - hysteresis)) level++;
+	return level;
+}
@@ -0,0 +1,179 @@
+#include "../stdafx.h"
+#include "Graphics/LightGrid.h"
+#include "Entities/Camera.h"
+#include "Graphics/StagingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+
+LightGrid::LightGrid() {}
+
+void LightGrid::init() {
+	lightBuffer = GLBuffer::create();
+	clusterBuffer = GLBuffer::create();
+	lightIndexBuffer = GLBuffer::create();
+	lightBlockBuffer.create(UniformBuffer::LIGHT_BINDING, sizeof(LightBlock));
+}
+
+void LightGrid::update(const CameraView& camera, const std::vector<LightInstance>& lights) {
+	float nearPlane = camera.nearClippingPlane;
+	float farPlane = camera.farClippingPlane;
+	// Cluster bounds only change with the projection.
+	if (clusterBounds.empty() || camera.projectionMatrix != clusterProjection || nearPlane != clusterNear || farPlane != clusterFar) {
+		buildClusterBounds(camera.projectionMatrix, nearPlane, farPlane);
+	}
+
+	const glm::mat4& view = camera.viewMatrix;
+	const glm::mat4& projection = camera.projectionMatrix;
+
+	gpuLights.resize(lights.size());
+	clusterLights.clear();
+	glm::vec3 ambientLight(0);
+	for (GLuint i = 0; i < lights.size(); i++) {
+		const Light& light = *lights[i].light;
+		GPULight& gpuLight = gpuLights[i];
+		glm::vec3 position = lights[i].position;
+		gpuLight.positionRadius = glm::vec4(position, light.radius);
+		gpuLight.ambient = glm::vec4(light.ambient, 0);
+		// Ambient light doesn't depend on distance, so it reaches fragments outside the light's clusters too.
+		ambientLight += light.ambient;
+		gpuLight.diffuse = glm::vec4(light.diffuse, 0);
+		gpuLight.specular = glm::vec4(light.specular, 0);
+
+		// Light sphere in view space. The camera looks down -Z.
+		glm::vec3 centre = glm::vec3(view * glm::vec4(position, 1));
+		float radius = light.radius;
+
+		// Depth range covered by the light, clipped to the frustum.
+		float minDepth = glm::max(-centre.z - radius, nearPlane);
+		float maxDepth = glm::min(-centre.z + radius, farPlane);
+		if (minDepth > maxDepth) continue;
+		int minZ = getDepthSlice(minDepth);
+		int maxZ = getDepthSlice(maxDepth);
+
+		// Screen tile range from the projected corners of the light's view-space bounding box,
+		// with corners behind the near plane pulled onto it.
+		glm::vec2 ndcMin = glm::vec2(1);
+		glm::vec2 ndcMax = glm::vec2(-1);
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 point = centre + glm::vec3((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+			point.z = glm::min(point.z, -nearPlane);
+			glm::vec4 clip = projection * glm::vec4(point, 1);
+			glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+		int minX = glm::clamp((int)glm::floor((ndcMin.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+		int maxX = glm::clamp((int)glm::floor((ndcMax.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+		int minY = glm::clamp((int)glm::floor((ndcMin.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+		int maxY = glm::clamp((int)glm::floor((ndcMax.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+
+		// Test the sphere against each cluster in range.
+		float radiusSqr = radius * radius;
+		for (int z = minZ; z <= maxZ; z++) {
+			for (int y = minY; y <= maxY; y++) {
+				for (int x = minX; x <= maxX; x++) {
+					GLuint clusterIndex = x + GRID_X * (y + GRID_Y * z);
+					const ClusterBounds& bounds = clusterBounds[clusterIndex];
+					// Distance from the sphere centre to the closest point in the box.
+					glm::vec3 closest = glm::clamp(centre, bounds.min, bounds.max);
+					glm::vec3 offset = closest - centre;
+					if (glm::dot(offset, offset) <= radiusSqr) clusterLights.push_back({ clusterIndex, i });
+				}
+			}
+		}
+	}
+
+	// Counting sort the light references by cluster into one compact index list.
+	clusters.assign(NUM_CLUSTERS, Cluster{ 0, 0 });
+	for (auto& clusterLight : clusterLights) {
+		clusters[clusterLight.cluster].count++;
+	}
+	GLuint offset = 0;
+	for (auto& cluster : clusters) {
+		cluster.offset = offset;
+		offset += cluster.count;
+		// Count is rebuilt as the write cursor below.
+		cluster.count = 0;
+	}
+	lightIndices.resize(clusterLights.size());
+	for (auto& clusterLight : clusterLights) {
+		Cluster& cluster = clusters[clusterLight.cluster];
+		lightIndices[cluster.offset + cluster.count++] = clusterLight.light;
+	}
+
+	// Upload.
+	uploadStorage(lightBuffer, LIGHTS_BINDING, gpuLights.data(), gpuLights.size() * sizeof(GPULight));
+	uploadStorage(clusterBuffer, CLUSTERS_BINDING, clusters.data(), clusters.size() * sizeof(Cluster));
+	uploadStorage(lightIndexBuffer, LIGHT_INDICES_BINDING, lightIndices.data(), lightIndices.size() * sizeof(GLuint));
+
+	float logDepthRatio = glm::log(farPlane / nearPlane);
+	lightBlock.gridSize = glm::uvec4(GRID_X, GRID_Y, GRID_Z, (GLuint)lights.size());
+	lightBlock.screenSize = glm::vec4(camera.screenWidth, camera.screenHeight, 0, 0);
+	lightBlock.depthSlicing = glm::vec4(nearPlane, farPlane, GRID_Z / logDepthRatio, -GRID_Z * glm::log(nearPlane) / logDepthRatio);
+	lightBlock.ambientLight = glm::vec4(ambientLight, 0);
+	lightBlockBuffer.update(lightBlock);
+}
+
+void LightGrid::buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane) {
+	clusterProjection = projection;
+	clusterNear = nearPlane;
+	clusterFar = farPlane;
+	clusterBounds.resize(NUM_CLUSTERS);
+
+	// View-space extent per unit of depth at the edge of the screen.
+	float tanHalfX = 1.f / projection[0][0];
+	float tanHalfY = 1.f / projection[1][1];
+	float depthRatio = farPlane / nearPlane;
+
+	for (int z = 0; z < GRID_Z; z++) {
+		// Slices are distributed exponentially so clusters stay roughly cubic.
+		float sliceNear = nearPlane * glm::pow(depthRatio, (float)z / GRID_Z);
+		float sliceFar = nearPlane * glm::pow(depthRatio, (float)(z + 1) / GRID_Z);
+		for (int y = 0; y < GRID_Y; y++) {
+			float ndcY0 = -1 + 2.f * y / GRID_Y;
+			float ndcY1 = -1 + 2.f * (y + 1) / GRID_Y;
+			for (int x = 0; x < GRID_X; x++) {
+				float ndcX0 = -1 + 2.f * x / GRID_X;
+				float ndcX1 = -1 + 2.f * (x + 1) / GRID_X;
+
+				// Bounds of the tile's corners at the near and far depth of the slice.
+				ClusterBounds& bounds = clusterBounds[x + GRID_X * (y + GRID_Y * z)];
+				bounds.min = glm::vec3(LARGE_NUMBER);
+				bounds.max = glm::vec3(-LARGE_NUMBER);
+				for (float depth : { sliceNear, sliceFar }) {
+					for (float ndcX : { ndcX0, ndcX1 }) {
+						for (float ndcY : { ndcY0, ndcY1 }) {
+							glm::vec3 corner = glm::vec3(ndcX * tanHalfX * depth, ndcY * tanHalfY * depth, -depth);
+							bounds.min = glm::min(bounds.min, corner);
+							bounds.max = glm::max(bounds.max, corner);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+int LightGrid::getDepthSlice(float depth) const {
+	float logDepthRatio = glm::log(clusterFar / clusterNear);
+	int slice = (int)glm::floor(glm::log(depth / clusterNear) / logDepthRatio * GRID_Z);
+	return glm::clamp(slice, 0, GRID_Z - 1);
+}
+
+void LightGrid::uploadStorage(GLuint buffer, GLuint binding, const void* data, size_t size) {
+	// Write into the staging ring and bind that range, if it's available.
+	StagingBuffer::Allocation allocation = StagingBuffer::allocate(std::max(size, (size_t)16), StagingBuffer::getStorageAlignment());
+	if (allocation.isValid()) {
+		if (size > 0) memcpy(allocation.data, data, size);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, StagingBuffer::getBuffer(), allocation.offset, allocation.size);
+		return;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	// Orphan the old storage so the upload doesn't wait on the previous frame. Never allocate an empty buffer.
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, (size_t)16), nullptr, GL_STREAM_DRAW);
+	if (size > 0) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
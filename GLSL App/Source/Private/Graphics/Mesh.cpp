@@ -1,6 +1,7 @@
 #include "../stdafx.h"
 #include "Graphics/Mesh.h"
 #include "Utils/Utils.h"
+#include "Graphics/RenderState.h"
 #include <sstream>
 #include <iostream>
 #include "glm/gtx/string_cast.hpp"
@@ -10,95 +11,184 @@
 #include "GL/freeglut.h"
 #include <string.h>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, float boundingRadius) {
-	this->vertices = vertices;
-	this->originVertices = vertices;
-	this->triangleElements = indices;
+Mesh::Mesh(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, std::vector<Texture> textures, float boundingRadius,
+	std::vector<MeshLOD> lods/* = std::vector<MeshLOD>()*/, EGeometryResidency residency/* = RELEASE_GEOMETRY*/) {
 	this->textures = textures;
 	this->boundingRadius = boundingRadius;
 
-	setupMesh();
+	MeshData data;
+	data.setStorage(std::move(vertices), std::move(indices));
+	data.lods = std::move(lods);
+	data.residency = residency;
+	updateTextureSet();
+	setupMesh(data);
 }
 
-Mesh::~Mesh() {
+Mesh::Mesh(MeshData&& data, std::vector<Texture> textures) {
+	this->textures = textures;
+	this->boundingRadius = data.boundingRadius;
+
+	updateTextureSet();
+	setupMesh(data);
+}
+
+Mesh::SharedGeometry::~SharedGeometry() {
+	GeometryArena::free(range);
+}
+
+void Mesh::render(const ShaderProgram& shader) {
+	bindMaterial(shader);
+	draw(shader);
+}
 
+void Mesh::renderInstanced(const ShaderProgram& shader, const glm::mat4* transforms, GLsizei count) {
+	bindMaterial(shader);
+	drawInstanced(shader, transforms, count);
 }
 
-void Mesh::render(GLuint shaderProgram) {
+void Mesh::bindMaterial(const ShaderProgram& shader) {
+	const ShaderProgram::Uniforms& uniforms = shader.getUniforms();
+	// Missing maps sample white from the last texture unit.
+	const GLuint fallbackUnit = RenderState::MAX_TEXTURE_UNITS - 1;
+	RenderState::bindTexture(fallbackUnit, GL_TEXTURE_2D, RenderState::getWhiteTexture());
+
 	// Load each texture into the shader samplers.
-	GLuint diffuseNum = 0;
-	GLuint specularNum = 0;
-	GLuint normalNum = 0;
-	// Default to no normal map.
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MAT_HAS_NORMALMAP, (GLuint)0);
-	for (GLuint i = 0; i < textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		std::string name = textures[i].type;
+	int diffuseNum = 0;
+	int specularNum = 0;
+	int normalNum = 0;
+	for (GLuint i = 0; i < textures.size() && i < fallbackUnit; i++) {
+		const char* type = textures[i].type;
 		int number = 0;
-		if (name == ShaderLoader::Vars::MAT_DIFFUSE) number = ++diffuseNum;
-		else if (name == ShaderLoader::Vars::MAT_SPECULAR) number = ++specularNum;
-		else if (name == ShaderLoader::Vars::MAT_NORMAL) {
-			number = ++normalNum;
-			ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MAT_HAS_NORMALMAP, (GLuint)1);
-		}
+		if (strcmp(type, ShaderLoader::Vars::MAT_DIFFUSE) == 0) number = ++diffuseNum;
+		else if (strcmp(type, ShaderLoader::Vars::MAT_SPECULAR) == 0) number = ++specularNum;
+		else if (strcmp(type, ShaderLoader::Vars::MAT_NORMAL) == 0) number = ++normalNum;
 
 		// Bind the texture to the sampler location in the shader.
-		ShaderLoader::setShaderValue(shaderProgram, (name + std::to_string(number)).c_str(), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		shader.setValue(shader.getMaterialMapLocation(type, number), (int)i);
+		RenderState::bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+	}
+	// Point unused samplers at the fallback.
+	for (int number = 1; number <= ShaderProgram::MAX_MATERIAL_MAPS; number++) {
+		if (number > diffuseNum) shader.setValue(uniforms.matDiffuse[number - 1], (int)fallbackUnit);
+		if (number > specularNum) shader.setValue(uniforms.matSpecular[number - 1], (int)fallbackUnit);
+		if (number > normalNum) shader.setValue(uniforms.matNormal[number - 1], (int)fallbackUnit);
 	}
-	glActiveTexture(GL_TEXTURE0);
+	shader.setValue(uniforms.matHasNormalMap, (normalNum > 0) ? 1 : 0);
 
 	// Material settings.
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MAT_DIFFUSE_COLOUR, material.diffuse);
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MAT_SPECULAR_COLOUR, material.specular);
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::MAT_SHININESS, material.shininess);
-	
-	// Draw.
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, triangleElements.size(), GL_UNSIGNED_INT, 0);
-	// Unbind the VAO.
-	glBindVertexArray(0);
-
-	// Set textures back to defaults.
-	for (GLuint i = 0; i < textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
+	shader.setValue(uniforms.matDiffuseColour, material.diffuse);
+	shader.setValue(uniforms.matSpecularColour, material.specular);
+	shader.setValue(uniforms.matShininess, material.shininess);
+}
+
+void Mesh::bindGeometry(const ShaderProgram& shader) {
+	const GeometryArena::Range& range = geometry->range;
+	shader.setValue(shader.getUniforms().positionOffset, range.positionOffset);
+	shader.setValue(shader.getUniforms().positionScale, range.positionScale);
+	RenderState::bindVertexArray(GeometryArena::getVertexArray(range.format));
+}
+
+void Mesh::draw(const ShaderProgram& shader, GLuint lod/* = 0*/) {
+	GeometryArena::Range range = getLODGeometry(lod);
+	bindGeometry(shader);
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.firstIndex * sizeof(GLuint)), range.firstVertex);
+	RenderState::countDrawCall();
 }
 
-void Mesh::setupMesh() {
-	// Create vertex array and buffers.
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
+void Mesh::drawInstanced(const ShaderProgram& shader, const glm::mat4* transforms, GLsizei count, GLuint lod/* = 0*/) {
+	if (count <= 0) return;
+	GLuint baseInstance = GeometryArena::writeInstances(transforms, count);
 
-	// Vertex buffer.
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// Copy the vertices array into the vertex buffer.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	// Draw every instance.
+	GeometryArena::Range range = getLODGeometry(lod);
+	bindGeometry(shader);
+	glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+		(GLvoid*)(range.firstIndex * sizeof(GLuint)), count, range.firstVertex, baseInstance);
+	RenderState::countDrawCall();
+}
 
-	// Element buffer.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	// Copy face indices to the element buffer.
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangleElements.size() * sizeof(GLuint), &triangleElements[0], GL_STATIC_DRAW);
+GeometryArena::Range Mesh::getLODGeometry(GLuint lod) const {
+	const std::vector<MeshLOD>& lods = geometry->lods;
+	GeometryArena::Range range = geometry->range;
+	if (lod >= lods.size()) lod = (GLuint)lods.size() - 1;
+	range.firstIndex += lods[lod].firstIndex;
+	range.indexCount = lods[lod].indexCount;
+	return range;
+}
 
-	// Vertex position attribute (vector 3).
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+void Mesh::addTexture(const Texture& texture) {
+	textures.push_back(texture);
+	updateTextureSet();
+}
 
-	// Vertex normal attribute (vector 3).
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+void Mesh::updateTextureSet() {
+	std::vector<GLuint> textureIds;
+	for (auto& texture : textures) {
+		textureIds.push_back(texture.id);
+	}
+	textureSet = TextureManager::getTextureSet(textureIds);
+}
 
-	// Vertex texture coordinate attribute (vector 2).
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoords));
+void Mesh::setupMesh(MeshData& data) {
+	geometry = std::make_shared<SharedGeometry>();
+	std::vector<MeshLOD>& lods = geometry->lods;
+	CPUGeometry& cpuGeometry = geometry->cpuGeometry;
+	lods = std::move(data.lods);
+	if (lods.empty()) {
+		MeshLOD full;
+		full.indexCount = data.indexCount;
+		lods.push_back(full);
+	}
+	geometry->range = GeometryArena::allocate(data.vertices, data.vertexCount, data.indices, data.indexCount, data.vertexFormat);
+
+	// Bounding sphere around the middle of the vertices rather than the origin, for the mesh's size on screen.
+	if (data.vertexCount > 0) {
+		glm::vec3 minimum = data.vertices[0].position;
+		glm::vec3 maximum = minimum;
+		for (GLuint i = 1; i < data.vertexCount; i++) {
+			minimum = glm::min(minimum, data.vertices[i].position);
+			maximum = glm::max(maximum, data.vertices[i].position);
+		}
+		glm::vec3 centre = (minimum + maximum) * 0.5f;
+		float radiusSquared = 0;
+		for (GLuint i = 0; i < data.vertexCount; i++) {
+			glm::vec3 offset = data.vertices[i].position - centre;
+			radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+		}
+		geometry->boundsCentre = centre;
+		geometry->boundsRadius = glm::sqrt(radiusSquared);
+	}
 
-	// Vertex tangent attribute (vector 3).
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, tangent));
+	// Everything else is freed with the data.
+	EGeometryResidency residency = geometry->residency = data.residency;
+	if (residency >= KEEP_COLLISION_GEOMETRY) {
+		cpuGeometry.positions.resize(data.vertexCount);
+		for (GLuint i = 0; i < data.vertexCount; i++) {
+			cpuGeometry.positions[i] = data.vertices[i].position;
+		}
+		cpuGeometry.indices.assign(data.indices + lods[0].firstIndex, data.indices + lods[0].firstIndex + lods[0].indexCount);
+	}
+	if (residency >= KEEP_ALL_GEOMETRY) {
+		// Owned vertices can be taken, mapped ones have to be copied.
+		if (!data.vertexStorage.empty()) cpuGeometry.vertices = std::move(data.vertexStorage);
+		else cpuGeometry.vertices.assign(data.vertices, data.vertices + data.vertexCount);
+		data.vertices = nullptr;
+	}
+}
 
-	glBindVertexArray(0);
+const Mesh::CPUGeometry& Mesh::getCollisionGeometry() {
+	SharedGeometry& shared = *geometry;
+	if (shared.residency < KEEP_COLLISION_GEOMETRY) {
+		const MeshLOD& full = shared.lods[0];
+		GeometryArena::readPositions(shared.range, shared.cpuGeometry.positions);
+		GeometryArena::readIndices(shared.range.firstIndex + full.firstIndex, full.indexCount, shared.cpuGeometry.indices);
+		shared.residency = KEEP_COLLISION_GEOMETRY;
+	}
+	return shared.cpuGeometry;
 }
 
+void Mesh::releaseCPUGeometry() {
+	// Assigned empty arrays rather than cleared, since clear() keeps the memory.
+	geometry->cpuGeometry = CPUGeometry();
+	geometry->residency = RELEASE_GEOMETRY;
+}
@@ -0,0 +1,199 @@
+#include "../stdafx.h"
+#include "Graphics/MeshCache.h"
+#include "Utils/Utils.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+static const char MAGIC[4] = { 'M', 'B', 'I', 'N' };
+
+// Arrays are aligned in the file so views into the mapping can be read directly.
+static constexpr size_t ALIGNMENT = 16;
+static inline size_t alignOffset(size_t offset) {
+	return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+std::mutex MeshCache::importMutex;
+std::condition_variable MeshCache::importFinished;
+std::set<std::string> MeshCache::importing;
+
+MeshCache::ImportGuard::ImportGuard(const std::string& sourcePath, const std::string& settingsKey) {
+	cachePath = getCachePath(sourcePath, settingsKey);
+	std::unique_lock<std::mutex> lock(importMutex);
+	importFinished.wait(lock, [this]() { return importing.count(cachePath) == 0; });
+	importing.insert(cachePath);
+}
+
+MeshCache::ImportGuard::~ImportGuard() {
+	{
+		std::lock_guard<std::mutex> lock(importMutex);
+		importing.erase(cachePath);
+	}
+	importFinished.notify_all();
+}
+
+std::string MeshCache::getCachePath(const std::string& sourcePath, const std::string& settingsKey) {
+	return settingsKey.empty() ? sourcePath + EXTENSION : sourcePath + "." + settingsKey + EXTENSION;
+}
+
+std::string MeshCache::getCachePath(const std::string& sourcePath, const std::string& settingsKey, uint64_t sourceModifiedTime) {
+	std::string name = settingsKey.empty() ? sourcePath : sourcePath + "." + settingsKey;
+	return name + ".v" + std::to_string(VERSION) + "." + std::to_string(sourceModifiedTime) + EXTENSION;
+}
+
+bool MeshCache::read(const std::string& sourcePath, const std::string& settingsKey, MappedFile& file, std::vector<MeshData>& meshes) {
+	meshes.clear();
+	uint64_t sourceTime = MappedFile::getModifiedTime(sourcePath);
+	if (sourceTime == 0) return false;
+	if (!file.open(getCachePath(sourcePath, settingsKey, sourceTime))) return false;
+
+	const unsigned char* data = file.getData();
+	const size_t size = file.getSize();
+	size_t offset = 0;
+	// Every read is bounds checked, so a truncated or corrupt file is rejected rather than read past the end.
+	auto readable = [&](size_t bytes) { return offset + bytes <= size; };
+
+	// Header.
+	FileHeader header;
+	if (!readable(sizeof(header))) return false;
+	memcpy(&header, data, sizeof(header));
+	offset += sizeof(header);
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.vertexSize != sizeof(Vertex)) return false;
+	if (header.sourceModifiedTime != sourceTime) return false;
+	if (!readable(header.settingsKeyLength) || std::string((const char*)data + offset, header.settingsKeyLength) != settingsKey) return false;
+	offset += header.settingsKeyLength;
+
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		offset = alignOffset(offset);
+		MeshHeader meshHeader;
+		if (!readable(sizeof(meshHeader))) return false;
+		memcpy(&meshHeader, data + offset, sizeof(meshHeader));
+		offset += sizeof(meshHeader);
+
+		MeshData mesh;
+		mesh.vertexCount = meshHeader.vertexCount;
+		mesh.indexCount = meshHeader.indexCount;
+		mesh.boundingRadius = meshHeader.boundingRadius;
+
+		// Texture references. Type and path are each a length followed by the characters.
+		for (uint32_t t = 0; t < meshHeader.textureCount; t++) {
+			uint32_t lengths[2];
+			if (!readable(sizeof(lengths))) return false;
+			memcpy(lengths, data + offset, sizeof(lengths));
+			offset += sizeof(lengths);
+			if (!readable((size_t)lengths[0] + lengths[1])) return false;
+
+			TextureRef texture;
+			texture.type = findTextureType(std::string((const char*)data + offset, lengths[0]));
+			texture.path = std::string((const char*)data + offset + lengths[0], lengths[1]);
+			offset += (size_t)lengths[0] + lengths[1];
+			if (!texture.type) return false;
+			mesh.textures.push_back(texture);
+		}
+
+		// Level of detail ranges, which must lie within the index array.
+		if (!readable((size_t)meshHeader.lodCount * sizeof(MeshLOD))) return false;
+		mesh.lods.resize(meshHeader.lodCount);
+		memcpy(mesh.lods.data(), data + offset, (size_t)meshHeader.lodCount * sizeof(MeshLOD));
+		offset += (size_t)meshHeader.lodCount * sizeof(MeshLOD);
+		for (auto& lod : mesh.lods) {
+			if ((uint64_t)lod.firstIndex + lod.indexCount > mesh.indexCount) return false;
+		}
+
+		// Vertex and index arrays.
+		offset = alignOffset(offset);
+		if (!readable((size_t)mesh.vertexCount * sizeof(Vertex))) return false;
+		mesh.vertices = (const Vertex*)(data + offset);
+		offset += (size_t)mesh.vertexCount * sizeof(Vertex);
+
+		offset = alignOffset(offset);
+		if (!readable((size_t)mesh.indexCount * sizeof(GLuint))) return false;
+		mesh.indices = (const GLuint*)(data + offset);
+		offset += (size_t)mesh.indexCount * sizeof(GLuint);
+
+		meshes.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+bool MeshCache::write(const std::string& sourcePath, const std::string& settingsKey, const std::vector<MeshData>& meshes) {
+	uint64_t sourceTime = MappedFile::getModifiedTime(sourcePath);
+	if (sourceTime == 0) return false;
+
+	// Written beside the cache and renamed over it once complete.
+	std::string cachePath = getCachePath(sourcePath, settingsKey, sourceTime);
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.good()) return false;
+	size_t offset = 0;
+	auto write = [&](const void* bytes, size_t length) {
+		file.write((const char*)bytes, length);
+		offset += length;
+	};
+	auto pad = [&]() {
+		static const char zeros[ALIGNMENT] = {};
+		write(zeros, alignOffset(offset) - offset);
+	};
+
+	FileHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = (uint32_t)meshes.size();
+	header.sourceModifiedTime = sourceTime;
+	header.settingsKeyLength = (uint32_t)settingsKey.size();
+	header.padding = 0;
+	write(&header, sizeof(header));
+	write(settingsKey.data(), settingsKey.size());
+
+	for (auto& mesh : meshes) {
+		pad();
+		MeshHeader meshHeader;
+		meshHeader.vertexCount = mesh.vertexCount;
+		meshHeader.indexCount = mesh.indexCount;
+		meshHeader.textureCount = (uint32_t)mesh.textures.size();
+		meshHeader.boundingRadius = mesh.boundingRadius;
+		meshHeader.lodCount = (uint32_t)mesh.lods.size();
+		write(&meshHeader, sizeof(meshHeader));
+
+		for (auto& texture : mesh.textures) {
+			uint32_t lengths[2] = { (uint32_t)strlen(texture.type), (uint32_t)texture.path.size() };
+			write(lengths, sizeof(lengths));
+			write(texture.type, lengths[0]);
+			write(texture.path.data(), lengths[1]);
+		}
+		write(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLOD));
+
+		pad();
+		write(mesh.vertices, (size_t)mesh.vertexCount * sizeof(Vertex));
+		pad();
+		write(mesh.indices, (size_t)mesh.indexCount * sizeof(GLuint));
+	}
+	file.close();
+	if (!file.good() || !replaceFile(tempPath, cachePath)) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+const char* MeshCache::findTextureType(const std::string& type) {
+	if (type == ShaderLoader::Vars::MAT_DIFFUSE) return ShaderLoader::Vars::MAT_DIFFUSE;
+	if (type == ShaderLoader::Vars::MAT_SPECULAR) return ShaderLoader::Vars::MAT_SPECULAR;
+	if (type == ShaderLoader::Vars::MAT_NORMAL) return ShaderLoader::Vars::MAT_NORMAL;
+	return nullptr;
+}
+
+bool MeshCache::replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
\ No newline at end of file
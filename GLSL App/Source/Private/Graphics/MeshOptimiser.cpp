@@ -0,0 +1,297 @@
+#include "../stdafx.h"
+#include "Graphics/MeshOptimiser.h"
+#include "Graphics/Mesh.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+
+MeshOptimiser::Stats& MeshOptimiser::Stats::operator+=(const Stats& other) {
+	triangles += other.triangles;
+	trianglesRemoved += other.trianglesRemoved;
+	verticesBefore += other.verticesBefore;
+	verticesAfter += other.verticesAfter;
+	missesBefore += other.missesBefore;
+	missesAfter += other.missesAfter;
+	return *this;
+}
+
+void MeshOptimiser::Stats::print(const std::string& name) const {
+	std::cout << std::fixed << std::setprecision(2) << "Optimised " << name << ": "
+		<< "ACMR " << getACMRBefore() << " -> " << getACMRAfter() << ", "
+		<< "ATVR " << getATVRBefore() << " -> " << getATVRAfter() << ", "
+		<< "verts " << verticesBefore << " -> " << verticesAfter;
+	if (trianglesRemoved > 0) std::cout << ", " << trianglesRemoved << " degenerate tris removed";
+	std::cout << std::defaultfloat << std::endl;
+}
+
+MeshOptimiser::Stats MeshOptimiser::optimise(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+	Stats stats;
+	stats.verticesBefore = vertices.size();
+	stats.missesBefore = simulateCache(indices, vertices.size());
+
+	stats.trianglesRemoved = removeDegenerates(indices);
+	weldVertices(vertices, indices);
+	optimiseIndices(vertices, indices);
+	remapVertices(vertices, indices);
+
+	stats.triangles = indices.size() / 3;
+	stats.verticesAfter = vertices.size();
+	stats.missesAfter = simulateCache(indices, vertices.size());
+	return stats;
+}
+
+void MeshOptimiser::optimiseIndices(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+	removeDegenerates(indices);
+	std::vector<GLuint> clusterStarts;
+	tipsify(indices, vertices.size(), clusterStarts);
+	sortClusters(vertices, indices, clusterStarts);
+}
+
+size_t MeshOptimiser::simulateCache(const std::vector<GLuint>& indices, size_t vertexCount) {
+	// Time each vertex entered the cache. It's still cached if fewer than CACHE_SIZE misses have happened since.
+	std::vector<size_t> entered(vertexCount, 0);
+	size_t misses = 0;
+	for (GLuint index : indices) {
+		if (index >= vertexCount) continue;
+		if (entered[index] == 0 || misses - entered[index] >= CACHE_SIZE) {
+			misses++;
+			entered[index] = misses;
+		}
+	}
+	return misses;
+}
+
+size_t MeshOptimiser::removeDegenerates(std::vector<GLuint>& indices) {
+	size_t triangleCount = indices.size() / 3;
+	size_t kept = 0;
+	for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+		GLuint a = indices[triangle * 3], b = indices[triangle * 3 + 1], c = indices[triangle * 3 + 2];
+		if (a == b || b == c || c == a) continue;
+		indices[kept * 3] = a;
+		indices[kept * 3 + 1] = b;
+		indices[kept * 3 + 2] = c;
+		kept++;
+	}
+	size_t removed = (indices.size() + 2) / 3 - kept;
+	indices.resize(kept * 3);
+	return removed;
+}
+
+void MeshOptimiser::weldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+	// Vertices are compared by their bytes. Vertex is all floats, so has no padding.
+	struct VertexHash {
+		size_t operator()(const Vertex* vertex) const {
+			const unsigned char* bytes = (const unsigned char*)vertex;
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(Vertex); i++) {
+				hash = (hash ^ bytes[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+	struct VertexEqual {
+		bool operator()(const Vertex* a, const Vertex* b) const { return memcmp(a, b, sizeof(Vertex)) == 0; }
+	};
+
+	std::unordered_map<const Vertex*, GLuint, VertexHash, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	std::vector<GLuint> remap(vertices.size());
+	for (GLuint i = 0; i < vertices.size(); i++) {
+		remap[i] = unique.emplace(&vertices[i], i).first->second;
+	}
+	for (auto& index : indices) {
+		index = remap[index];
+	}
+	// Welded vertices are left unused and dropped by remapVertices().
+}
+
+void MeshOptimiser::tipsify(std::vector<GLuint>& indices, size_t vertexCount, std::vector<GLuint>& clusterStarts) {
+	const GLuint triangleCount = (GLuint)(indices.size() / 3);
+	clusterStarts.clear();
+	if (triangleCount == 0) return;
+
+	// Triangles using each vertex, as offsets into one array.
+	std::vector<GLuint> liveTriangles(vertexCount, 0);
+	for (GLuint index : indices) {
+		liveTriangles[index]++;
+	}
+	std::vector<GLuint> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+		adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	}
+	std::vector<GLuint> adjacency(indices.size());
+	std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (GLuint triangle = 0; triangle < triangleCount; triangle++) {
+		for (int corner = 0; corner < 3; corner++) {
+			GLuint vertex = indices[triangle * 3 + corner];
+			adjacency[fill[vertex]++] = triangle;
+		}
+	}
+
+	// Cache time stamp of each vertex, and the current time. Vertices are in the cache if now - stamp <= CACHE_SIZE.
+	std::vector<GLuint> cacheStamps(vertexCount, 0);
+	GLuint now = CACHE_SIZE + 1;
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<GLuint> deadEnds;
+	std::vector<GLuint> candidates;
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	// Next vertex to try when the dead-end stack runs out.
+	GLuint scan = 0;
+	// Set when the last skip had to scan for a vertex, which starts again with nothing useful in the cache.
+	bool flushed = false;
+	// First triangle of the current cluster, and its cache misses if it were drawn on its own from an empty cache,
+	// since the overdraw sort may put any cluster after any other. Simulated with a second set of time stamps.
+	GLuint clusterStart = 0;
+	GLuint clusterMisses = 0;
+	std::vector<GLuint> clusterStamps(vertexCount, 0);
+	GLuint clusterNow = CACHE_SIZE + 1;
+	GLuint clusterFirstStamp = clusterNow;
+
+	// Returns the next vertex with live triangles when the fan has nowhere to go, or -1 when every triangle is emitted.
+	auto skipDeadEnd = [&]() -> long {
+		flushed = false;
+		while (!deadEnds.empty()) {
+			GLuint vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0) return vertex;
+		}
+		flushed = true;
+		while (scan < vertexCount) {
+			if (liveTriangles[scan] > 0) return scan;
+			scan++;
+		}
+		return -1;
+	};
+	auto startCluster = [&]() {
+		clusterStart = (GLuint)(output.size() / 3);
+		clusterMisses = 0;
+		clusterFirstStamp = clusterNow;
+		clusterStarts.push_back(clusterStart);
+	};
+
+	long fanVertex = skipDeadEnd();
+	flushed = false;
+	startCluster();
+	while (fanVertex >= 0) {
+		// Emit every remaining triangle around the fanning vertex.
+		candidates.clear();
+		for (GLuint adjacent = adjacencyOffsets[fanVertex]; adjacent < adjacencyOffsets[fanVertex + 1]; adjacent++) {
+			GLuint triangle = adjacency[adjacent];
+			if (emitted[triangle]) continue;
+			for (int corner = 0; corner < 3; corner++) {
+				GLuint vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (now - cacheStamps[vertex] > CACHE_SIZE) cacheStamps[vertex] = now++;
+				if (clusterStamps[vertex] < clusterFirstStamp || clusterNow - clusterStamps[vertex] > CACHE_SIZE) {
+					clusterStamps[vertex] = clusterNow++;
+					clusterMisses++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Fan next around the candidate that will still be cached longest once its triangles are emitted.
+		long next = -1;
+		long bestPriority = -1;
+		for (GLuint vertex : candidates) {
+			if (liveTriangles[vertex] == 0) continue;
+			long priority = 0;
+			if (now - cacheStamps[vertex] + 2 * liveTriangles[vertex] <= CACHE_SIZE) priority = now - cacheStamps[vertex];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+		if (next < 0) next = skipDeadEnd();
+		if (next >= 0) {
+			// Clusters end where the cache was flushed anyway, or where the cluster drawn on its own stays within the
+			// threshold, so the overdraw sort can't push the ACMR above it.
+			GLuint clusterTriangles = (GLuint)(output.size() / 3) - clusterStart;
+			if (flushed || (float)clusterMisses <= CLUSTER_ACMR_THRESHOLD * clusterTriangles) startCluster();
+			flushed = false;
+		}
+		fanVertex = next;
+	}
+	indices.swap(output);
+}
+
+void MeshOptimiser::sortClusters(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<GLuint>& clusterStarts) {
+	if (clusterStarts.size() < 2) return;
+	const GLuint triangleCount = (GLuint)(indices.size() / 3);
+
+	// Area weighted centre of the whole mesh.
+	glm::vec3 meshCentre = glm::vec3(0);
+	float meshArea = 0;
+	struct Cluster {
+		GLuint start;
+		GLuint end;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters;
+	std::vector<glm::vec3> clusterCentres;
+	std::vector<glm::vec3> clusterNormals;
+	for (size_t i = 0; i < clusterStarts.size(); i++) {
+		Cluster cluster;
+		cluster.start = clusterStarts[i];
+		cluster.end = (i + 1 < clusterStarts.size()) ? clusterStarts[i + 1] : triangleCount;
+		cluster.sortKey = 0;
+
+		glm::vec3 centre = glm::vec3(0);
+		glm::vec3 normal = glm::vec3(0);
+		float area = 0;
+		for (GLuint triangle = cluster.start; triangle < cluster.end; triangle++) {
+			const glm::vec3& a = vertices[indices[triangle * 3]].position;
+			const glm::vec3& b = vertices[indices[triangle * 3 + 1]].position;
+			const glm::vec3& c = vertices[indices[triangle * 3 + 2]].position;
+			// Cross product length is twice the area, so it weights the normal sum by area.
+			glm::vec3 faceNormal = glm::cross(b - a, c - a);
+			float faceArea = glm::length(faceNormal);
+			centre += (a + b + c) / 3.f * faceArea;
+			normal += faceNormal;
+			area += faceArea;
+		}
+		meshCentre += centre;
+		meshArea += area;
+		clusters.push_back(cluster);
+		clusterCentres.push_back(area > 0 ? centre / area : vertices[indices[cluster.start * 3]].position);
+		clusterNormals.push_back(glm::length(normal) > 0 ? glm::normalize(normal) : normal);
+	}
+	if (meshArea > 0) meshCentre /= meshArea;
+
+	// Clusters facing out from the centre are likely to be in front, so are drawn first to occlude the rest.
+	for (size_t i = 0; i < clusters.size(); i++) {
+		clusters[i].sortKey = glm::dot(clusterCentres[i] - meshCentre, clusterNormals[i]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<GLuint> sorted;
+	sorted.reserve(indices.size());
+	for (auto& cluster : clusters) {
+		sorted.insert(sorted.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+	}
+	indices.swap(sorted);
+}
+
+void MeshOptimiser::remapVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+	const GLuint UNUSED = 0xFFFFFFFF;
+	std::vector<GLuint> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> remapped;
+	remapped.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = (GLuint)remapped.size();
+			remapped.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(remapped);
+}
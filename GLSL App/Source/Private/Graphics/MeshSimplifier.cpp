@@ -0,0 +1,272 @@
+#include "../stdafx.h"
+#include "Graphics/MeshSimplifier.h"
+#include "Graphics/MeshOptimiser.h"
+#include "Graphics/Mesh.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	/** Sum of squared distances to a set of weighted planes, as a symmetric matrix, a vector and a constant. */
+	struct Quadric {
+		float a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+		float b0 = 0, b1 = 0, b2 = 0;
+		float c = 0;
+		// Total weight of the planes, to average the distance.
+		float weight = 0;
+
+		void addPlane(const glm::vec3& normal, float distance, float planeWeight) {
+			a00 += planeWeight * normal.x * normal.x;
+			a11 += planeWeight * normal.y * normal.y;
+			a22 += planeWeight * normal.z * normal.z;
+			a01 += planeWeight * normal.x * normal.y;
+			a02 += planeWeight * normal.x * normal.z;
+			a12 += planeWeight * normal.y * normal.z;
+			b0 += planeWeight * normal.x * distance;
+			b1 += planeWeight * normal.y * distance;
+			b2 += planeWeight * normal.z * distance;
+			c += planeWeight * distance * distance;
+			weight += planeWeight;
+		}
+
+		Quadric& operator+=(const Quadric& other) {
+			a00 += other.a00; a11 += other.a11; a22 += other.a22;
+			a01 += other.a01; a02 += other.a02; a12 += other.a12;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+			return *this;
+		}
+
+		/** Returns the weighted mean squared distance of a point to the planes. */
+		float evaluate(const glm::vec3& p) const {
+			float error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+				+ 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+				+ 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return (weight > 0) ? glm::abs(error) / weight : 0;
+		}
+	};
+
+	/** Hashes positions by their bytes, so vertices at exactly the same position are found. */
+	struct PositionHash {
+		size_t operator()(const glm::vec3* position) const {
+			uint32_t words[3];
+			memcpy(words, position, sizeof(words));
+			return (words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u);
+		}
+	};
+	struct PositionEqual {
+		bool operator()(const glm::vec3* a, const glm::vec3* b) const { return memcmp(a, b, sizeof(glm::vec3)) == 0; }
+	};
+
+	// Collapses that leave a triangle facing further than acos(MAX_TURN) from how it faced before are rejected.
+	static constexpr float MAX_TURN = 0.25f;
+
+	/** A candidate collapse of the source vertex onto the target. */
+	struct Collapse {
+		GLuint source;
+		GLuint target;
+		float cost;
+	};
+}
+
+
+std::vector<GLuint> MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount,
+	float maxError, float errorScale, float* resultError/* = nullptr*/) {
+	std::vector<GLuint> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	if (resultError) *resultError = 0;
+	const size_t vertexCount = vertices.size();
+	if (result.size() <= targetIndexCount || vertexCount == 0) return result;
+
+	// Work in positions scaled by the error scale, so errors come out relative to it.
+	const float invScale = (errorScale > 0) ? 1 / errorScale : 1;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		positions[i] = vertices[i].position * invScale;
+	}
+
+	// Vertices at the same position are wedges of one point, which owns their quadric and adjacency.
+	std::unordered_map<const glm::vec3*, GLuint, PositionHash, PositionEqual> points;
+	points.reserve(vertexCount);
+	std::vector<GLuint> remap(vertexCount);
+	std::vector<GLuint> wedgeCount(vertexCount, 0);
+	for (GLuint i = 0; i < vertexCount; i++) {
+		remap[i] = points.emplace(&positions[i], i).first->second;
+		wedgeCount[remap[i]]++;
+	}
+
+	// Lock seams, where the wedges have different attributes, and open borders, whose edges only have one triangle.
+	std::vector<bool> locked(vertexCount, false);
+	for (GLuint i = 0; i < vertexCount; i++) {
+		if (wedgeCount[remap[i]] > 1) locked[remap[i]] = true;
+	}
+	std::unordered_map<uint64_t, GLuint> edgeUses;
+	for (size_t corner = 0; corner < result.size(); corner++) {
+		GLuint a = remap[result[corner]];
+		GLuint b = remap[result[(corner % 3 == 2) ? corner - 2 : corner + 1]];
+		edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+	}
+	for (auto& edge : edgeUses) {
+		if (edge.second != 1) continue;
+		locked[(GLuint)(edge.first >> 32)] = true;
+		locked[(GLuint)(edge.first & 0xFFFFFFFF)] = true;
+	}
+
+	// Area weighted plane quadrics of each point.
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t triangle = 0; triangle < result.size() / 3; triangle++) {
+		const glm::vec3& p0 = positions[result[triangle * 3]];
+		const glm::vec3& p1 = positions[result[triangle * 3 + 1]];
+		const glm::vec3& p2 = positions[result[triangle * 3 + 2]];
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length <= 0) continue;
+		normal /= length;
+		float distance = -glm::dot(normal, p0);
+		for (int corner = 0; corner < 3; corner++) {
+			quadrics[remap[result[triangle * 3 + corner]]].addPlane(normal, distance, length * 0.5f);
+		}
+	}
+
+	const float maxCost = maxError * maxError;
+	float worstCost = 0;
+	std::vector<GLuint> collapseTo(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<GLuint> adjacencyOffsets(vertexCount + 1);
+	std::vector<GLuint> adjacency;
+	std::vector<Collapse> candidates;
+
+	// Collapse in passes until the target is reached or every remaining collapse costs too much.
+	while (result.size() > targetIndexCount) {
+		const size_t triangleCount = result.size() / 3;
+
+		// Triangles around each point.
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (GLuint index : result) {
+			adjacencyOffsets[remap[index] + 1]++;
+		}
+		for (size_t point = 0; point < vertexCount; point++) {
+			adjacencyOffsets[point + 1] += adjacencyOffsets[point];
+		}
+		adjacency.resize(result.size());
+		std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t corner = 0; corner < result.size(); corner++) {
+			adjacency[fill[remap[result[corner]]]++] = (GLuint)(corner / 3);
+		}
+
+		// Cost of collapsing each edge either way. Locked vertices can be collapsed onto but not moved.
+		candidates.clear();
+		for (size_t corner = 0; corner < result.size(); corner++) {
+			GLuint a = result[corner];
+			GLuint b = result[(corner % 3 == 2) ? corner - 2 : corner + 1];
+			for (int direction = 0; direction < 2; direction++) {
+				GLuint source = direction ? b : a;
+				GLuint target = direction ? a : b;
+				if (locked[remap[source]]) continue;
+				Quadric merged = quadrics[remap[source]];
+				merged += quadrics[remap[target]];
+				candidates.push_back({ source, target, merged.evaluate(positions[target]) });
+			}
+		}
+		if (candidates.empty()) break;
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// Collapse the cheapest edges. Only one collapse is made around each point per pass, so the flip test
+		// below sees the triangles as they will be.
+		for (GLuint i = 0; i < vertexCount; i++) {
+			collapseTo[i] = i;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesLeft = triangleCount;
+		size_t collapses = 0;
+		for (auto& collapse : candidates) {
+			if (collapse.cost > maxCost || trianglesLeft * 3 <= targetIndexCount) break;
+			GLuint source = remap[collapse.source];
+			GLuint target = remap[collapse.target];
+			if (touched[source] || touched[target]) continue;
+
+			// Reject the collapse if it would flip or sharply turn any triangle that survives it.
+			bool flips = false;
+			size_t removed = 0;
+			for (GLuint adjacent = adjacencyOffsets[source]; adjacent < adjacencyOffsets[source + 1] && !flips; adjacent++) {
+				const GLuint* triangle = &result[adjacency[adjacent] * 3];
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				bool hasTarget = false;
+				for (int corner = 0; corner < 3; corner++) {
+					before[corner] = positions[triangle[corner]];
+					after[corner] = (remap[triangle[corner]] == source) ? positions[collapse.target] : before[corner];
+					if (remap[triangle[corner]] == target) hasTarget = true;
+				}
+				if (hasTarget) {
+					removed++;
+					continue;
+				}
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				if (glm::dot(normalBefore, normalAfter) <= MAX_TURN * glm::length(normalBefore) * glm::length(normalAfter)) flips = true;
+			}
+			if (flips) continue;
+
+			// Source isn't a seam, so it has a single wedge and moves onto the target wedge along the edge.
+			collapseTo[collapse.source] = collapse.target;
+			quadrics[target] += quadrics[source];
+			worstCost = std::max(worstCost, collapse.cost);
+			for (GLuint adjacent = adjacencyOffsets[source]; adjacent < adjacencyOffsets[source + 1]; adjacent++) {
+				for (int corner = 0; corner < 3; corner++) {
+					touched[remap[result[adjacency[adjacent] * 3 + corner]]] = true;
+				}
+			}
+			trianglesLeft -= removed;
+			collapses++;
+		}
+		if (collapses == 0) break;
+
+		// Apply the collapses and drop the triangles that lost an edge.
+		size_t kept = 0;
+		for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+			GLuint a = collapseTo[result[triangle * 3]];
+			GLuint b = collapseTo[result[triangle * 3 + 1]];
+			GLuint c = collapseTo[result[triangle * 3 + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a]) continue;
+			result[kept * 3] = a;
+			result[kept * 3 + 1] = b;
+			result[kept * 3 + 2] = c;
+			kept++;
+		}
+		result.resize(kept * 3);
+	}
+
+	if (resultError) *resultError = glm::sqrt(worstCost);
+	return result;
+}
+
+void MeshSimplifier::buildLODs(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float boundingRadius, std::vector<MeshLOD>& lods) {
+	lods.clear();
+	MeshLOD full;
+	full.firstIndex = 0;
+	full.indexCount = (GLuint)indices.size();
+	full.error = 0;
+	lods.push_back(full);
+
+	std::vector<GLuint> previous(indices);
+	float error = 0;
+	while (lods.size() < MAX_LODS && error < MAX_ERROR) {
+		size_t target = (size_t)(previous.size() / 3 * LOD_RATIO) * 3;
+		float levelError = 0;
+		std::vector<GLuint> level = simplify(vertices, previous, target, MAX_ERROR - error, boundingRadius, &levelError);
+		// Stop once simplifying stops paying off, e.g. when what's left is mostly locked seams.
+		if (level.empty() || level.size() > previous.size() * (1 - MIN_REDUCTION)) break;
+		MeshOptimiser::optimiseIndices(vertices, level);
+
+		// Each level is simplified from the last, so the errors add up.
+		error += levelError;
+		MeshLOD lod;
+		lod.firstIndex = (GLuint)indices.size();
+		lod.indexCount = (GLuint)level.size();
+		lod.error = error;
+		indices.insert(indices.end(), level.begin(), level.end());
+		lods.push_back(lod);
+		previous.swap(level);
+	}
+}
@@ -7,6 +7,8 @@
 #include <assimp/postprocess.h>
 
 #include "utils/Utils.h"
+#include "Graphics/MeshCache.h"
+#include "Graphics/MeshSimplifier.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
@@ -19,22 +21,32 @@ Model::Model(GLchar* path, ImportSettings importSettings/* = ImportSettings()*/)
 	loadModel(path);
 }
 
-void Model::render(GLuint shaderProgram) {
+void Model::render(const ShaderProgram& shader) {
 	// Render meshes.
 	for (auto& mesh : meshes) {
-		mesh.render(shaderProgram);
+		mesh->render(shader);
 	}
 }
 
-void Model::addMesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, float boundingRadius) {
-	meshes.push_back(Mesh(vertices, indices, textures, boundingRadius));
+float Model::getBoundingRadius() const {
+	float radius = 0;
+	for (auto& mesh : meshes) {
+		radius = glm::max(radius, mesh->boundingRadius);
+	}
+	return radius;
+}
+
+void Model::addMesh(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, std::vector<Texture> textures, float boundingRadius,
+	std::vector<MeshLOD> lods/* = std::vector<MeshLOD>()*/) {
+	meshes.push_back(std::make_shared<Mesh>(std::move(vertices), std::move(indices), textures, boundingRadius, lods, importSettings.residency));
 }
 
 void Model::setMaterial(glm::vec3 diffuse, glm::vec3 specular, float shininess) {
+	makeMeshesUnique();
 	for (auto& mesh : meshes) {
-		mesh.material.diffuse = diffuse;
-		mesh.material.specular = specular;
-		mesh.material.shininess = shininess;
+		mesh->material.diffuse = diffuse;
+		mesh->material.specular = specular;
+		mesh->material.shininess = shininess;
 	}
 }
 
@@ -42,38 +54,102 @@ void Model::addTexture(const char* path, const char* type) {
 	Texture texture;
 	texture.path = path;
 	texture.type = type;
-	texture.id = Utils::loadTexture(path);
+	texture.handle = TextureManager::load(path);
+	texture.id = texture.handle->id;
 
+	makeMeshesUnique();
 	for (auto& mesh : meshes) {
-		mesh.textures.push_back(texture);
+		mesh->addTexture(texture);
 	}
 }
 
+void Model::makeMeshesUnique() {
+	for (auto& mesh : meshes) {
+		if (mesh.use_count() > 1) mesh = std::make_shared<Mesh>(*mesh);
+	}
+}
+
+void Model::addMesh(MeshData&& data, const std::string& textureDir) {
+	std::vector<Texture> textures;
+	for (auto& textureRef : data.textures) {
+		Texture texture = loadTexture(textureDir + textureRef.path, textureRef.type);
+		// Keep the path relative to the model, as it was in the file.
+		texture.path = textureRef.path;
+		textures.push_back(texture);
+	}
+	meshes.push_back(std::make_shared<Mesh>(std::move(data), textures));
+}
+
 void Model::loadModel(std::string path) {
 	std::cout << "--- Loading model --- \n" << path << std::endl;
 
-	// Create Assimp importer and read the file with realtime quality processing. This triangulates the mesh, among other things.
+	ModelData data;
+	if (!import(path, importSettings, data)) return;
+
+	// Buffers are filled straight from the imported arrays, or the mapped cache file.
+	baseDir = data.baseDir;
+	for (auto& mesh : data.meshes) {
+		addMesh(std::move(mesh), baseDir);
+	}
+	std::cout << "--- Finished loading model ---" << std::endl;
+}
+
+bool Model::import(const std::string& path, const ImportSettings& importSettings, ModelData& data) {
 	Assimp::Importer importer;
+	return import(path, importSettings, data, importer);
+}
+
+bool Model::import(const std::string& path, const ImportSettings& importSettings, ModelData& data, Assimp::Importer& importer) {
+	data.path = path;
+	// Get base path to this asset.
+	data.baseDir = path.substr(0, path.find_last_of('/') + 1);
+	data.meshes.clear();
+
+	// Another thread importing the same file with the same settings finishes first, so this reads its cache.
+	MeshCache::ImportGuard importGuard(path, importSettings.getImportKey());
+
+	// Skip importing if the model has been imported before with the same settings.
+	data.cacheFile = std::make_shared<MappedFile>();
+	if (MeshCache::read(path, importSettings.getImportKey(), *data.cacheFile, data.meshes)) {
+		// The cache holds full vertices. They're converted to the GPU format when the meshes are created.
+		for (auto& mesh : data.meshes) {
+			mesh.vertexFormat = importSettings.getVertexFormat();
+			mesh.residency = importSettings.residency;
+		}
+		return true;
+	}
+	data.cacheFile.reset();
+	data.meshes.clear();
+
+	// Read the file with realtime quality processing. This triangulates the mesh, among other things.
 	const aiScene* scene = importer.ReadFile(path, aiProcessPreset_TargetRealtime_Quality);
 
 	if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		std::cout << "Error loading model '" << path << "': \n" << importer.GetErrorString() << std::endl;
-		return;
+		importer.FreeScene();
+		return false;
 	}
 
-	// Get base path to this asset.
-	baseDir = path.substr(0, path.find_last_of('/') + 1);
 	// Process meshes.
+	MeshOptimiser::Stats optimiserStats;
 	for (GLuint i = 0; i < scene->mNumMeshes; i++) {
-		meshes.push_back(processMesh(scene->mMeshes[i], scene));
+		data.meshes.push_back(processMesh(scene->mMeshes[i], scene, importSettings, optimiserStats));
 	}
-	std::cout << "--- Finished loading model ---" << std::endl;
+	optimiserStats.print(path);
+	// The meshes have been copied out, so the scene isn't kept until the importer's next file.
+	importer.FreeScene();
+
+	// Cache the imported meshes for next time.
+	if (!MeshCache::write(path, importSettings.getImportKey(), data.meshes)) {
+		std::cout << "Failed to write mesh cache for '" << path << "'" << std::endl;
+	}
+	return true;
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
+MeshData Model::processMesh(aiMesh* mesh, const aiScene* scene, const ImportSettings& importSettings, MeshOptimiser::Stats& stats) {
 	std::vector<Vertex> vertices;
 	std::vector<GLuint> indices;
-	std::vector<Texture> textures;
+	MeshData data;
 
 	// Get vertex data.
 	glm::vec3 furthestPoint = glm::vec3(0);
@@ -109,9 +185,10 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
 	// Calculate bounding radius.
 	boundingRadius = glm::sqrt(glm::dot(furthestPoint, furthestPoint));
 
-	// Indices of vertices that make up faces.
+	// Indices of vertices that make up faces. Point and line primitives can't be drawn as triangles, so are skipped.
 	for (GLuint i = 0; i < mesh->mNumFaces; i++) {
 		aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3) continue;
 		for (GLuint j = 0; j < face.mNumIndices; j++) {
 			indices.push_back(face.mIndices[j]);
 		}
@@ -121,46 +198,48 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
 	if (mesh->mMaterialIndex >= 0) {
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 		// Diffuse maps.
-		textures = loadTextures(material, aiTextureType_DIFFUSE, ShaderLoader::Vars::MAT_DIFFUSE);
-
+		getTextureRefs(material, aiTextureType_DIFFUSE, ShaderLoader::Vars::MAT_DIFFUSE, data.textures);
 		// Specular maps.
-		auto specMaps = loadTextures(material, aiTextureType_SPECULAR, ShaderLoader::Vars::MAT_SPECULAR);
-		textures.insert(textures.end(), specMaps.begin(), specMaps.end());
-
+		getTextureRefs(material, aiTextureType_SPECULAR, ShaderLoader::Vars::MAT_SPECULAR, data.textures);
 		// Normal maps. (.obj saves normals as aiTextureType_HEIGHT)
-		auto normalMaps = loadTextures(material, /*aiTextureType_NORMALS*/aiTextureType_HEIGHT, ShaderLoader::Vars::MAT_NORMAL);
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+		getTextureRefs(material, /*aiTextureType_NORMALS*/aiTextureType_HEIGHT, ShaderLoader::Vars::MAT_NORMAL, data.textures);
 	}
 
+	// Reorder for the vertex cache and overdraw. Done before caching, so cached meshes are already optimised.
+	stats += MeshOptimiser::optimise(vertices, indices);
+
 	std::cout << "Loaded mesh: \n  Verts: " << vertices.size() << "\n  Tris: " << (indices.size()/3) << "\n  Bounding Radius: " << boundingRadius << std::endl;
-	return Mesh(vertices, indices, textures, boundingRadius);
+
+	// Simplified levels of detail, appended to the indices.
+	if (importSettings.generateLODs) {
+		MeshSimplifier::buildLODs(vertices, indices, boundingRadius, data.lods);
+		std::cout << "  LOD Tris:";
+		for (auto& lod : data.lods) {
+			std::cout << " " << lod.indexCount / 3;
+		}
+		std::cout << std::endl;
+	}
+	data.boundingRadius = boundingRadius;
+	data.setStorage(std::move(vertices), std::move(indices));
+	data.vertexFormat = importSettings.getVertexFormat();
+	data.residency = importSettings.residency;
+	return data;
 }
 
-std::vector<Texture> Model::loadTextures(aiMaterial* mat, aiTextureType type, const char* typeName) {
-	std::vector<Texture> textures;
+void Model::getTextureRefs(aiMaterial* mat, aiTextureType type, const char* typeName, std::vector<TextureRef>& textures) {
 	for (GLuint i = 0; i < mat->GetTextureCount(type); i++) {
 		aiString path;
 		mat->GetTexture(type, i, &path);
-
-		// Only load textures that haven't already been loaded.
-		bool preLoaded = false;
-		for (auto& texture : textures) {
-			if (path == texture.path) {
-				preLoaded = true;
-				break;
-			}
-		}
-
-		if (!preLoaded) {
-			Texture texture;
-			std::string fullPath = baseDir + path.C_Str();
-			texture.id = Utils::loadTexture(fullPath.c_str()); // For loading and binding to an OpenGL texture.
-			texture.type = typeName;
-			texture.path = path;
-			textures.push_back(texture);
-			loadedTextures.push_back(texture);
-		}
+		textures.push_back({ typeName, path.C_Str() });
 	}
+}
 
-	return textures;
+Texture Model::loadTexture(const std::string& path, const char* typeName) {
+	Texture texture;
+	// Shared with any other model using the same file.
+	texture.handle = TextureManager::load(path);
+	texture.id = texture.handle->id;
+	texture.type = typeName;
+	texture.path = path;
+	return texture;
 }
@@ -0,0 +1,224 @@
+#include "../stdafx.h"
+#include "Graphics/RenderQueue.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/GeometryArena.h"
+#include "Graphics/StagingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+// Key layout, from the most significant bit.
+static constexpr int PROGRAM_BITS = 8;
+static constexpr int TEXTURE_SET_BITS = 20;
+static constexpr int MATERIAL_BITS = 16;
+static constexpr int GEOMETRY_BITS = 20;
+static constexpr int GEOMETRY_SHIFT = 0;
+static constexpr int MATERIAL_SHIFT = GEOMETRY_SHIFT + GEOMETRY_BITS;
+static constexpr int TEXTURE_SET_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+static constexpr int PROGRAM_SHIFT = TEXTURE_SET_SHIFT + TEXTURE_SET_BITS;
+
+static inline uint64_t keyField(uint64_t value, int bits, int shift) {
+	return (value & ((1ull << bits) - 1)) << shift;
+}
+
+// Whether two sorted items can be drawn as instances of one draw.
+static inline bool isSameDraw(const RenderQueue::DrawItem& a, const RenderQueue::DrawItem& b) {
+	return a.mesh->isSameDraw(*b.mesh) && a.lod == b.lod && a.shader == b.shader;
+}
+
+
+RenderQueue::RenderQueue() {}
+
+void RenderQueue::submit(const ShaderProgram& shader, Mesh* mesh, const glm::mat4& transform, GLuint lod/* = 0*/) {
+	DrawItem item;
+	item.key = makeKey(shader, *mesh, lod);
+	item.shader = &shader;
+	item.mesh = mesh;
+	item.lod = lod;
+	item.transformIndex = (GLuint)transforms.size();
+	items.push_back(item);
+	transforms.push_back(transform);
+}
+
+void RenderQueue::clear() {
+	items.clear();
+	transforms.clear();
+}
+
+void RenderQueue::render() {
+	stats = Stats();
+	stats.items = (unsigned int)items.size();
+	if (items.empty()) return;
+
+	// Sort by state. Meshes with identical keys are kept together so they can be merged into one draw.
+	std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.key != b.key) return a.key < b.key;
+		// Copies of a mesh are kept together too, so those with the same material are merged.
+		if (a.mesh->getGeometryId() != b.mesh->getGeometryId()) return a.mesh->getGeometryId() < b.mesh->getGeometryId();
+		return a.lod < b.lod;
+	});
+	for (auto& item : items) {
+		stats.triangles += item.mesh->getLODGeometry(item.lod).indexCount / 3;
+		stats.fullDetailTriangles += item.mesh->getLOD(0).indexCount / 3;
+	}
+
+	if (GeometryArena::supportsMultiDraw() && renderMultiDraw()) return;
+	renderBatches();
+}
+
+void RenderQueue::renderBatches() {
+	const ShaderProgram* currentShader = nullptr;
+	const Mesh* materialMesh = nullptr;
+	size_t i = 0;
+	while (i < items.size()) {
+		const DrawItem& first = items[i];
+
+		// Change program. Instancing is enabled while the queue renders with it.
+		if (first.shader != currentShader) {
+			if (currentShader) currentShader->setValue(currentShader->getUniforms().instanced, 0);
+			currentShader = first.shader;
+			currentShader->use();
+			currentShader->setValue(currentShader->getUniforms().instanced, 1);
+			materialMesh = nullptr;
+		}
+
+		// Material uniforms are only set if they differ from the last mesh drawn with this program.
+		if (!materialMesh || materialMesh->getTextureSetId() != first.mesh->getTextureSetId() || materialMesh->material != first.mesh->material) {
+			first.mesh->bindMaterial(*currentShader);
+			materialMesh = first.mesh;
+			stats.materialChanges++;
+		}
+
+		// Gather every instance of this mesh at this level of detail.
+		batchTransforms.clear();
+		size_t end = i;
+		while (end < items.size() && isSameDraw(items[end], first)) {
+			batchTransforms.push_back(transforms[items[end].transformIndex]);
+			end++;
+		}
+		first.mesh->drawInstanced(*currentShader, batchTransforms.data(), (GLsizei)batchTransforms.size(), first.lod);
+		stats.batches++;
+		i = end;
+	}
+	currentShader->setValue(currentShader->getUniforms().instanced, 0);
+}
+
+bool RenderQueue::renderMultiDraw() {
+	// One command per mesh and level of detail, with its instances' matrices gathered in draw order for the whole frame.
+	batchTransforms.clear();
+	commands.clear();
+	drawData.clear();
+	commandItems.clear();
+	size_t i = 0;
+	while (i < items.size()) {
+		const DrawItem& first = items[i];
+		GeometryArena::Range geometry = first.mesh->getLODGeometry(first.lod);
+
+		DrawCommand command;
+		command.count = geometry.indexCount;
+		command.firstIndex = geometry.firstIndex;
+		command.baseVertex = (GLint)geometry.firstVertex;
+		// Relative to the frame's first matrix until they're written.
+		command.baseInstance = (GLuint)batchTransforms.size();
+		size_t end = i;
+		while (end < items.size() && isSameDraw(items[end], first)) {
+			batchTransforms.push_back(transforms[items[end].transformIndex]);
+			end++;
+		}
+		command.instanceCount = (GLuint)(end - i);
+		commands.push_back(command);
+
+		DrawData data;
+		data.diffuseColour = glm::vec4(first.mesh->material.diffuse, 1);
+		data.specularColour = glm::vec4(first.mesh->material.specular, first.mesh->material.shininess);
+		data.positionOffset = glm::vec4(geometry.positionOffset, 0);
+		data.positionScale = glm::vec4(geometry.positionScale, 0);
+		drawData.push_back(data);
+		commandItems.push_back(&first);
+		i = end;
+	}
+
+	// Stream the commands and materials. Too many to fit is left to the instanced path.
+	StagingBuffer::Allocation commandAllocation = StagingBuffer::allocate(commands.size() * sizeof(DrawCommand));
+	StagingBuffer::Allocation drawDataAllocation = StagingBuffer::allocate(drawData.size() * sizeof(DrawData), StagingBuffer::getStorageAlignment());
+	if (!commandAllocation.isValid() || !drawDataAllocation.isValid()) return false;
+
+	GLuint baseInstance = GeometryArena::writeInstances(batchTransforms.data(), (GLsizei)batchTransforms.size());
+	for (auto& command : commands) {
+		command.baseInstance += baseInstance;
+	}
+	memcpy(commandAllocation.data, commands.data(), commands.size() * sizeof(DrawCommand));
+	memcpy(drawDataAllocation.data, drawData.data(), drawData.size() * sizeof(DrawData));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, StagingBuffer::getBuffer());
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, StagingBuffer::getBuffer(), drawDataAllocation.offset, drawDataAllocation.size);
+
+	// Textures and vertex arrays are bound per call, so each program, texture set and vertex format gets its own multi-draw.
+	const ShaderProgram* currentShader = nullptr;
+	size_t firstCommand = 0;
+	while (firstCommand < commands.size()) {
+		const DrawItem& first = *commandItems[firstCommand];
+		size_t endCommand = firstCommand + 1;
+		while (endCommand < commands.size() && commandItems[endCommand]->shader == first.shader
+			&& commandItems[endCommand]->mesh->getTextureSetId() == first.mesh->getTextureSetId()
+			&& commandItems[endCommand]->mesh->getGeometry().format == first.mesh->getGeometry().format) {
+			endCommand++;
+		}
+
+		if (first.shader != currentShader) {
+			if (currentShader) {
+				currentShader->setValue(currentShader->getUniforms().instanced, 0);
+				currentShader->setValue(currentShader->getUniforms().multiDraw, 0);
+			}
+			currentShader = first.shader;
+			currentShader->use();
+			currentShader->setValue(currentShader->getUniforms().instanced, 1);
+			currentShader->setValue(currentShader->getUniforms().multiDraw, 1);
+		}
+		// Binds the textures. The colours set here are ignored in favour of the draw data.
+		first.mesh->bindMaterial(*currentShader);
+		currentShader->setValue(currentShader->getUniforms().drawOffset, (int)firstCommand);
+		RenderState::bindVertexArray(GeometryArena::getVertexArray(first.mesh->getGeometry().format));
+		stats.materialChanges++;
+
+		GLintptr commandOffset = commandAllocation.offset + firstCommand * sizeof(DrawCommand);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)commandOffset, (GLsizei)(endCommand - firstCommand), 0);
+		RenderState::countDrawCall();
+		stats.multiDraws++;
+		firstCommand = endCommand;
+	}
+	currentShader->setValue(currentShader->getUniforms().instanced, 0);
+	currentShader->setValue(currentShader->getUniforms().multiDraw, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	stats.batches = (unsigned int)commands.size();
+	return true;
+}
+
+uint64_t RenderQueue::makeKey(const ShaderProgram& shader, const Mesh& mesh, GLuint lod) {
+	return keyField(shader.getHandle(), PROGRAM_BITS, PROGRAM_SHIFT)
+		| keyField(mesh.getTextureSetId(), TEXTURE_SET_BITS, TEXTURE_SET_SHIFT)
+		| keyField(hashMaterial(mesh.material), MATERIAL_BITS, MATERIAL_SHIFT)
+		| keyField(makeGeometryKey(mesh.getLODGeometry(lod)), GEOMETRY_BITS, GEOMETRY_SHIFT);
+}
+
+uint64_t RenderQueue::makeGeometryKey(const GeometryArena::Range& geometry) {
+	// Meshes of a format share the arena's vertex array, so within a format order by where the geometry is to keep reads local.
+	uint64_t position = (geometry.firstIndex >> 8) & ((1ull << (GEOMETRY_BITS - 1)) - 1);
+	return ((uint64_t)geometry.format << (GEOMETRY_BITS - 1)) | position;
+}
+
+uint64_t RenderQueue::hashMaterial(const Material& material) {
+	// FNV-1a over the raw values.
+	const float values[] = {
+		material.diffuse.x, material.diffuse.y, material.diffuse.z,
+		material.specular.x, material.specular.y, material.specular.z,
+		material.shininess
+	};
+	unsigned char bytes[sizeof(values)];
+	memcpy(bytes, values, sizeof(values));
+	uint32_t hash = 2166136261u;
+	for (unsigned char byte : bytes) {
+		hash = (hash ^ byte) * 16777619u;
+	}
+	// Fold down to 16 bits.
+	return (hash >> 16) ^ (hash & 0xFFFF);
+}
@@ -0,0 +1,86 @@
+#include "../stdafx.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/GLHandle.h"
+
+
+GLuint RenderState::currentProgram = RenderState::UNKNOWN;
+GLuint RenderState::currentVertexArray = RenderState::UNKNOWN;
+GLuint RenderState::activeTextureUnit = RenderState::UNKNOWN;
+GLuint RenderState::boundTextures2D[RenderState::MAX_TEXTURE_UNITS];
+GLuint RenderState::boundTexturesCube[RenderState::MAX_TEXTURE_UNITS];
+RenderState::Stats RenderState::stats;
+
+// 1x1 white texture used for missing material maps. Kept out of the header as GLHandle.h includes it.
+static GLTexture whiteTexture;
+
+void RenderState::beginFrame() {
+	stats = Stats();
+	invalidate();
+}
+
+void RenderState::invalidate() {
+	currentProgram = UNKNOWN;
+	currentVertexArray = UNKNOWN;
+	activeTextureUnit = UNKNOWN;
+	for (GLuint i = 0; i < MAX_TEXTURE_UNITS; i++) {
+		boundTextures2D[i] = UNKNOWN;
+		boundTexturesCube[i] = UNKNOWN;
+	}
+}
+
+void RenderState::shutdown() {
+	whiteTexture.reset();
+	invalidate();
+}
+
+void RenderState::useProgram(GLuint program) {
+	if (program == currentProgram) {
+		stats.redundantChanges++;
+		return;
+	}
+	glUseProgram(program);
+	currentProgram = program;
+	stats.programChanges++;
+}
+
+void RenderState::bindVertexArray(GLuint vertexArray) {
+	if (vertexArray == currentVertexArray) {
+		stats.redundantChanges++;
+		return;
+	}
+	glBindVertexArray(vertexArray);
+	currentVertexArray = vertexArray;
+	stats.vertexArrayChanges++;
+}
+
+void RenderState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+	// Units beyond what's tracked are always bound.
+	GLuint* boundTexture = nullptr;
+	if (unit < MAX_TEXTURE_UNITS) boundTexture = (target == GL_TEXTURE_CUBE_MAP) ? &boundTexturesCube[unit] : &boundTextures2D[unit];
+	if (boundTexture && *boundTexture == texture) {
+		stats.redundantChanges++;
+		return;
+	}
+
+	if (unit != activeTextureUnit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeTextureUnit = unit;
+	}
+	glBindTexture(target, texture);
+	if (boundTexture) *boundTexture = texture;
+	stats.textureChanges++;
+}
+
+GLuint RenderState::getWhiteTexture() {
+	if (whiteTexture == 0) {
+		const unsigned char white[] = { 255, 255, 255, 255 };
+		whiteTexture = GLTexture::create();
+		glBindTexture(GL_TEXTURE_2D, whiteTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		// Binding was made directly, so the cached texture state is no longer valid.
+		invalidate();
+	}
+	return whiteTexture;
+}
@@ -0,0 +1,103 @@
+#include "../stdafx.h"
+#include "Graphics/ShaderProgram.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/UniformBuffer.h"
+#include "Utils/Utils.h"
+#include <string.h>
+
+
+ShaderProgram::Uniforms::Uniforms() {
+	for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+		matDiffuse[i] = -1;
+		matSpecular[i] = -1;
+		matNormal[i] = -1;
+	}
+}
+
+ShaderProgram::ShaderProgram() {}
+
+ShaderProgram::ShaderProgram(const char* vertexShaderFile, const char* fragmentShaderFile) {
+	program = ShaderLoader::createShaderProgram(vertexShaderFile, fragmentShaderFile);
+	// Attach shared per-frame blocks, e.g. the camera, to their fixed binding points.
+	UniformBuffer::bindBlocks(program);
+	cacheUniformLocations();
+	resolveCommonUniforms();
+}
+
+void ShaderProgram::use() const {
+	RenderState::useProgram(program);
+}
+
+GLint ShaderProgram::getUniformLocation(const std::string& name) const {
+	auto it = uniformLocations.find(name);
+	return (it != uniformLocations.end()) ? it->second : -1;
+}
+
+GLint ShaderProgram::getMaterialMapLocation(const char* type, int number) const {
+	if (number < 1 || number > MAX_MATERIAL_MAPS) return -1;
+
+	if (strcmp(type, ShaderLoader::Vars::MAT_DIFFUSE) == 0) return uniforms.matDiffuse[number - 1];
+	if (strcmp(type, ShaderLoader::Vars::MAT_SPECULAR) == 0) return uniforms.matSpecular[number - 1];
+	if (strcmp(type, ShaderLoader::Vars::MAT_NORMAL) == 0) return uniforms.matNormal[number - 1];
+	return -1;
+}
+
+void ShaderProgram::cacheUniformLocations() {
+	uniformLocations.clear();
+
+	GLint numUniforms = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	if (numUniforms <= 0 || maxNameLength <= 0) return;
+
+	std::vector<GLchar> nameBuffer(maxNameLength);
+	for (GLint i = 0; i < numUniforms; i++) {
+		GLsizei nameLength = 0;
+		GLint arraySize = 0;
+		GLenum type;
+		glGetActiveUniform(program, (GLuint)i, maxNameLength, &nameLength, &arraySize, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), nameLength);
+
+		// Uniforms in blocks don't have a location.
+		GLint location = glGetUniformLocation(program, name.c_str());
+		if (location < 0) continue;
+		uniformLocations[name] = location;
+
+		// Arrays are reported as name[0]. Store the bare name and every element so they can be looked up directly.
+		size_t arraySuffix = name.rfind("[0]");
+		if (arraySuffix != std::string::npos && arraySuffix + 3 == name.length()) {
+			std::string baseName = name.substr(0, arraySuffix);
+			uniformLocations[baseName] = location;
+			for (GLint element = 1; element < arraySize; element++) {
+				std::string elementName = baseName + "[" + std::to_string(element) + "]";
+				uniformLocations[elementName] = glGetUniformLocation(program, elementName.c_str());
+			}
+		}
+	}
+}
+
+void ShaderProgram::resolveCommonUniforms() {
+	uniforms = Uniforms();
+	uniforms.model = getUniformLocation(ShaderLoader::Vars::MODEL);
+
+	// Numbered material maps, e.g. material.diffuse1.
+	for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+		std::string number = std::to_string(i + 1);
+		uniforms.matDiffuse[i] = getUniformLocation(ShaderLoader::Vars::MAT_DIFFUSE + number);
+		uniforms.matSpecular[i] = getUniformLocation(ShaderLoader::Vars::MAT_SPECULAR + number);
+		uniforms.matNormal[i] = getUniformLocation(ShaderLoader::Vars::MAT_NORMAL + number);
+	}
+	uniforms.matDiffuseColour = getUniformLocation(ShaderLoader::Vars::MAT_DIFFUSE_COLOUR);
+	uniforms.matSpecularColour = getUniformLocation(ShaderLoader::Vars::MAT_SPECULAR_COLOUR);
+	uniforms.matShininess = getUniformLocation(ShaderLoader::Vars::MAT_SHININESS);
+	uniforms.matHasNormalMap = getUniformLocation(ShaderLoader::Vars::MAT_HAS_NORMALMAP);
+
+	uniforms.entityId = getUniformLocation(ShaderLoader::Vars::ENTITY_ID);
+
+	uniforms.instanced = getUniformLocation(ShaderLoader::Vars::INSTANCED);
+	uniforms.multiDraw = getUniformLocation(ShaderLoader::Vars::MULTI_DRAW);
+	uniforms.drawOffset = getUniformLocation(ShaderLoader::Vars::DRAW_OFFSET);
+	uniforms.positionOffset = getUniformLocation(ShaderLoader::Vars::POSITION_OFFSET);
+	uniforms.positionScale = getUniformLocation(ShaderLoader::Vars::POSITION_SCALE);
+}
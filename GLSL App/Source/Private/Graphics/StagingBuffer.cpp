@@ -0,0 +1,171 @@
+#include "../stdafx.h"
+#include "Graphics/StagingBuffer.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+
+GLBuffer StagingBuffer::buffer;
+unsigned char* StagingBuffer::mapped = nullptr;
+GLsizeiptr StagingBuffer::head = 0;
+GLsizeiptr StagingBuffer::usedBytes = 0;
+GLsizeiptr StagingBuffer::unfencedBytes = 0;
+std::deque<StagingBuffer::Fence> StagingBuffer::fences;
+GLint StagingBuffer::storageAlignment = 256;
+StagingBuffer::Stats StagingBuffer::stats;
+
+void StagingBuffer::init() {
+	if (buffer) return;
+	if (!GLEW_ARB_buffer_storage) {
+		std::cout << "GL_ARB_buffer_storage isn't supported, uploads won't be streamed." << std::endl;
+		return;
+	}
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	buffer = GLBuffer::create();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, SIZE, nullptr, flags);
+	mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, SIZE, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (!mapped) {
+		std::cout << "Failed to map the staging buffer, uploads won't be streamed." << std::endl;
+		buffer.reset();
+	}
+}
+
+void StagingBuffer::shutdown() {
+	for (const Fence& fence : fences) glDeleteSync(fence.sync);
+	fences.clear();
+	if (mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = nullptr;
+	}
+	buffer.reset();
+	head = usedBytes = unfencedBytes = 0;
+}
+
+void StagingBuffer::beginFrame() {
+	if (unfencedBytes > 0) placeFence();
+	// Free whatever the GPU is already done with, without waiting.
+	while (!fences.empty() && retireFence(false));
+
+	stats = Stats();
+	stats.bytesInFlight = usedBytes;
+}
+
+StagingBuffer::Allocation StagingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment/* = 16*/) {
+	Allocation allocation;
+	if (!mapped || size <= 0 || size > SIZE) return allocation;
+
+	GLsizeiptr start = (head + alignment - 1) / alignment * alignment;
+	// Wrap to the start if there isn't room before the end. The skipped space is counted as used until it is passed again.
+	if (start + size > SIZE) start = 0;
+	GLsizeiptr needed = ((start >= head) ? start - head : SIZE - head) + size;
+	if (needed > SIZE) return allocation;
+
+	// In-flight data sits in the bytes just behind the head, so there is room once it no longer overlaps what's needed.
+	// Only earlier frames are fenced. Data written this frame may still be read by draws issued later in it, so if
+	// that is all that's left the caller uploads the usual way instead.
+	while (usedBytes + needed > SIZE) {
+		if (fences.empty()) return allocation;
+		retireFence(true);
+	}
+
+	head = start + size;
+	if (head == SIZE) head = 0;
+	usedBytes += needed;
+	unfencedBytes += needed;
+	stats.bytesUploaded += size;
+	stats.allocations++;
+	stats.bytesInFlight = usedBytes;
+
+	allocation.data = mapped + start;
+	allocation.offset = start;
+	allocation.size = size;
+	return allocation;
+}
+
+void StagingBuffer::uploadToBuffer(GLuint destination, GLintptr offset, const void* data, GLsizeiptr size) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	if (!mapped) {
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (GLsizeiptr copied = 0; copied < size; copied += MAX_COPY_SIZE) {
+		GLsizeiptr copySize = std::min((GLsizeiptr)MAX_COPY_SIZE, size - copied);
+		Allocation allocation = allocate(copySize);
+		if (!allocation.isValid()) {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset + copied, copySize, bytes + copied);
+			continue;
+		}
+		memcpy(allocation.data, bytes + copied, copySize);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset, offset + copied, copySize);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool StagingBuffer::uploadTexture2D(GLenum format, GLsizei width, GLsizei height, GLsizei channels, const unsigned char* pixels) {
+	if (!mapped) return false;
+
+	GLsizeiptr rowSize = (GLsizeiptr)width * channels;
+	// Rows are copied tightly packed.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	GLsizei rowsPerBand = (GLsizei)std::max((GLsizeiptr)1, MAX_COPY_SIZE / rowSize);
+	for (GLsizei y = 0; y < height; y += rowsPerBand) {
+		GLsizei rows = std::min(rowsPerBand, height - y);
+		Allocation allocation = allocate(rowSize * rows);
+		if (!allocation.isValid()) {
+			// The ring is full of this frame's data, so this band is uploaded from client memory.
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, format, GL_UNSIGNED_BYTE, pixels + rowSize * y);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			continue;
+		}
+		memcpy(allocation.data, pixels + rowSize * y, rowSize * rows);
+		// With an unpack buffer bound, the pointer is an offset into it.
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, format, GL_UNSIGNED_BYTE, (const GLvoid*)allocation.offset);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return true;
+}
+
+void StagingBuffer::placeFence() {
+	Fence fence;
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence.bytes = unfencedBytes;
+	fences.push_back(fence);
+	unfencedBytes = 0;
+}
+
+bool StagingBuffer::retireFence(bool wait) {
+	Fence& fence = fences.front();
+	if (wait) {
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		// Flush on the first wait so the fence is guaranteed to be reached.
+		GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fence.sync, waitFlags, 1000000000) == GL_TIMEOUT_EXPIRED) {
+			waitFlags = 0;
+		}
+		stats.fenceWaits++;
+		stats.fenceWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+	} else {
+		GLenum status = glClientWaitSync(fence.sync, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+	}
+
+	glDeleteSync(fence.sync);
+	usedBytes -= fence.bytes;
+	fences.pop_front();
+	return true;
+}
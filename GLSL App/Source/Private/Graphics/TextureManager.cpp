@@ -0,0 +1,208 @@
+#include "../stdafx.h"
+#include "Graphics/TextureManager.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/StagingBuffer.h"
+#include "Utils/Utils.h"
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <limits.h>
+#endif
+
+
+const unsigned int TextureManager::DEFAULT_FLAGS = SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS;
+std::unordered_map<std::string, std::shared_ptr<TextureManager::Entry>> TextureManager::textures;
+TextureManager::Stats TextureManager::stats;
+
+TextureManager::TexturePtr TextureManager::load(const std::string& path, unsigned int flags/* = DEFAULT_FLAGS*/) {
+	std::string key = getKey(path, flags);
+	auto found = textures.find(key);
+	if (found != textures.end()) {
+		stats.hits++;
+		return found->second;
+	}
+	stats.misses++;
+
+	std::cout << "Loading texture: " << path << std::endl;
+	int width, height, channels;
+	unsigned char* pixels = SOIL_load_image(path.c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
+	GLuint id = pixels ? createTexture(pixels, width, height, channels, flags) : 0;
+	if (!id) std::cout << "Failed to load texture '" << path << "': " << SOIL_last_result() << std::endl;
+	if (pixels) SOIL_free_image_data(pixels);
+	return addEntry(key, id, flags);
+}
+
+TextureManager::TexturePtr TextureManager::create(const std::string& path, const unsigned char* pixels, int width, int height, int channels, unsigned int flags/* = DEFAULT_FLAGS*/) {
+	std::string key = getKey(path, flags);
+	auto found = textures.find(key);
+	if (found != textures.end()) {
+		stats.hits++;
+		return found->second;
+	}
+	stats.misses++;
+
+	GLuint id = pixels ? createTexture(pixels, width, height, channels, flags) : 0;
+	if (!id) std::cout << "Failed to create texture '" << path << "'" << std::endl;
+	return addEntry(key, id, flags);
+}
+
+TextureManager::TextureSetStorage& TextureManager::getTextureSetStorage() {
+	// Initialised once even if several threads get here first together.
+	static TextureSetStorage* storage = new TextureSetStorage();
+	return *storage;
+}
+
+TextureManager::TextureSetPtr TextureManager::getTextureSet(const std::vector<GLuint>& textureIds) {
+	TextureSetStorage& s = getTextureSetStorage();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	std::weak_ptr<const TextureSet>& entry = s.sets[textureIds];
+	TextureSetPtr set = entry.lock();
+	if (set) return set;
+
+	GLuint id;
+	if (!s.freeIds.empty()) {
+		id = s.freeIds.back();
+		s.freeIds.pop_back();
+	} else {
+		id = s.nextId++;
+	}
+	set = TextureSetPtr(new TextureSet{ id, textureIds }, &TextureManager::releaseTextureSet);
+	entry = set;
+	return set;
+}
+
+void TextureManager::releaseTextureSet(const TextureSet* set) {
+	TextureSetStorage& s = getTextureSetStorage();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		auto found = s.sets.find(set->textures);
+		// Another thread may already have replaced the expired entry with a new set.
+		if (found != s.sets.end() && found->second.expired()) s.sets.erase(found);
+		s.freeIds.push_back(set->id);
+	}
+	delete set;
+}
+
+bool TextureManager::isLoaded(const std::string& path, unsigned int flags/* = DEFAULT_FLAGS*/) {
+	return textures.count(getKey(path, flags)) > 0;
+}
+
+GLuint TextureManager::createTexture(const unsigned char* pixels, int width, int height, int channels, unsigned int flags) {
+	// Anything the upload below doesn't handle is left to SOIL.
+	const unsigned int streamedFlags = SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS;
+	if (!StagingBuffer::isSupported() || (flags & ~streamedFlags) || channels < 1 || channels > 4) {
+		GLuint id = SOIL_create_OGL_texture(pixels, width, height, channels, 0, flags);
+		RenderState::invalidate();
+		return id;
+	}
+
+	static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	static const GLenum internalFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+	GLenum format = formats[channels - 1];
+
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[channels - 1], width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+	StagingBuffer::uploadTexture2D(format, width, height, channels, pixels);
+
+	// Greyscale images read as grey in every channel, the same as SOIL's luminance textures.
+	if (channels <= 2) {
+		const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, (channels == 2) ? GL_GREEN : GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
+	GLint wrap = (flags & SOIL_FLAG_TEXTURE_REPEATS) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (flags & SOIL_FLAG_MIPMAPS) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	} else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	RenderState::invalidate();
+	return id;
+}
+
+std::string TextureManager::getKey(const std::string& path, unsigned int flags) {
+	return getCanonicalPath(path) + "|" + std::to_string(flags);
+}
+
+TextureManager::TexturePtr TextureManager::addEntry(const std::string& key, GLuint id, unsigned int flags) {
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->key = key;
+	entry->id.reset(id);
+	// Failures aren't kept, so a file that is fixed or appears later is picked up by the next request.
+	if (!entry->id) return entry;
+
+	// Size for memory accounting. Assumes 4 bytes per texel, plus a third for mipmaps.
+	glBindTexture(GL_TEXTURE_2D, entry->id);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &entry->width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &entry->height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	// SOIL and the query bound textures directly.
+	RenderState::invalidate();
+	entry->bytes = (size_t)entry->width * entry->height * 4;
+	if (flags & SOIL_FLAG_MIPMAPS) entry->bytes += entry->bytes / 3;
+
+	textures[key] = entry;
+	stats.textures = textures.size();
+	stats.bytes += entry->bytes;
+	return entry;
+}
+
+size_t TextureManager::evictUnreferenced() {
+	size_t evicted = 0;
+	for (auto texture = textures.begin(); texture != textures.end();) {
+		// Only the manager holds it.
+		if (texture->second.use_count() == 1) {
+			stats.bytes -= texture->second->bytes;
+			texture = textures.erase(texture);
+			evicted++;
+		} else {
+			++texture;
+		}
+	}
+	stats.evicted += (unsigned int)evicted;
+	stats.textures = textures.size();
+	return evicted;
+}
+
+void TextureManager::clear() {
+	textures.clear();
+	stats.textures = 0;
+	stats.bytes = 0;
+}
+
+long TextureManager::getReferenceCount(const TexturePtr& texture) {
+	if (!texture) return 0;
+	// The manager's own reference isn't counted.
+	return texture.use_count() - 1;
+}
+
+std::string TextureManager::getCanonicalPath(const std::string& path) {
+	std::string resolved;
+#ifdef _WIN32
+	char buffer[_MAX_PATH];
+	if (_fullpath(buffer, path.c_str(), _MAX_PATH)) resolved = buffer;
+#else
+	char buffer[PATH_MAX];
+	if (realpath(path.c_str(), buffer)) resolved = buffer;
+#endif
+	if (resolved.empty()) resolved = path;
+
+	std::replace(resolved.begin(), resolved.end(), '\\', '/');
+#ifdef _WIN32
+	// Windows paths are case insensitive.
+	std::transform(resolved.begin(), resolved.end(), resolved.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+#endif
+	return resolved;
+}
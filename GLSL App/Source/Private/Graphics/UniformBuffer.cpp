@@ -0,0 +1,40 @@
+#include "../stdafx.h"
+#include "Graphics/UniformBuffer.h"
+
+
+UniformBuffer::UniformBuffer() {}
+
+void UniformBuffer::create(EBindingPoint bindingPoint, GLsizeiptr size) {
+	this->bindingPoint = bindingPoint;
+	this->size = size;
+
+	buffer = GLBuffer::create();
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	// Contents are rewritten every frame.
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, buffer);
+}
+
+void UniformBuffer::update(const void* data, GLsizeiptr dataSize, GLintptr offset/* = 0*/) {
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, dataSize, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bindBlocks(GLuint program) {
+	struct BlockBinding {
+		const char* name;
+		EBindingPoint bindingPoint;
+	};
+	static const BlockBinding blockBindings[] = {
+		{ Blocks::CAMERA, CAMERA_BINDING },
+		{ Blocks::LIGHTS, LIGHT_BINDING }
+	};
+
+	for (auto& binding : blockBindings) {
+		GLuint blockIndex = glGetUniformBlockIndex(program, binding.name);
+		if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, blockIndex, binding.bindingPoint);
+	}
+}
@@ -0,0 +1,135 @@
+#include "../stdafx.h"
+#include "Input/GPUPicker.h"
+#include "Graphics/RenderState.h"
+#include <chrono>
+
+
+GPUPicker::GPUPicker() {}
+
+void GPUPicker::init() {
+	shader = ShaderProgram("shaders/SelectionShader/SelectionVertex.glsl", "shaders/SelectionShader/SelectionFragment.glsl");
+
+	for (auto& readback : readbacks) {
+		readback.buffer = GLBuffer::create();
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void GPUPicker::resize(const glm::ivec2& size) {
+	if (size == bufferSize) return;
+	bufferSize = size;
+
+	if (framebuffer == 0) {
+		framebuffer = GLFramebuffer::create();
+		idTexture = GLTexture::create();
+		depthBuffer = GLRenderbuffer::create();
+	}
+
+	glBindTexture(GL_TEXTURE_2D, idTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, size.x, size.y, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	// Texture was bound directly.
+	RenderState::invalidate();
+
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GPUPicker::render(const std::vector<Entity::EntityPtr>& entities, const glm::vec2& mousePos, const glm::vec2& screenSize) {
+	frame++;
+
+	// Every buffer is still waiting on the GPU, so drop this frame rather than wait.
+	if (readbacks[nextReadback].fence) {
+		stats.skippedFrames++;
+		return;
+	}
+
+	int divisor = glm::max(resolutionDivisor, 1);
+	resize(glm::max(glm::ivec2((int)screenSize.x / divisor, (int)screenSize.y / divisor), glm::ivec2(1)));
+
+	// Pixel under the mouse in the ID buffer. Y is flipped as screen space uses negative Y and buffer space uses positive Y.
+	glm::ivec2 pixel = glm::ivec2((int)(mousePos.x / divisor), bufferSize.y - 1 - (int)(mousePos.y / divisor));
+	if (pixel.x < 0 || pixel.y < 0 || pixel.x >= bufferSize.x || pixel.y >= bufferSize.y) return;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Only the pixel under the mouse is needed, so everything else is scissored away.
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, bufferSize.x, bufferSize.y);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(pixel.x, pixel.y, 1, 1);
+	const GLuint clearId[] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clearId);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// --- ID buffer ---
+	// View and projection come from the shared camera block. Materials aren't needed, so meshes are drawn directly.
+	shader.use();
+	const ShaderProgram::Uniforms& uniforms = shader.getUniforms();
+	for (auto& entity : entities) {
+		if (!entity) continue;
+		shader.setValue(uniforms.entityId, entity->getId());
+		shader.setValue(uniforms.model, entity->getModelMatrix());
+		for (auto& mesh : entity->model.getMeshes()) {
+			mesh->draw(shader);
+		}
+	}
+
+	// Copy the pixel into the next buffer. This returns immediately, the copy happens once the pass has rendered.
+	Readback& readback = readbacks[nextReadback];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(pixel.x, pixel.y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.frame = frame;
+	nextReadback = (nextReadback + 1) % NUM_READBACKS;
+	stats.pending++;
+
+	// Restore the default framebuffer.
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool GPUPicker::poll(GLuint& entityId) {
+	bool hasResult = false;
+
+	// Read every finished readback in order, keeping the newest result.
+	while (readbacks[oldestReadback].fence) {
+		Readback& readback = readbacks[oldestReadback];
+		// Zero timeout, so this only checks the fence.
+		GLenum status = glClientWaitSync(readback.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+		auto readStart = std::chrono::high_resolution_clock::now();
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		GLuint* data = (GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT);
+		if (data) {
+			entityId = *data;
+			hasResult = true;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		stats.readbackMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - readStart).count();
+		stats.latencyFrames = frame - readback.frame;
+		stats.completed++;
+		stats.pending--;
+
+		glDeleteSync(readback.fence);
+		readback.fence = 0;
+		oldestReadback = (oldestReadback + 1) % NUM_READBACKS;
+	}
+	return hasResult;
+}
@@ -4,61 +4,197 @@
 #include "GL/freeglut.h"
 #include "World.h"
 #include "utils\Utils.h"
+#include <algorithm>
 
 InputManager::InputManager() {}
 
-void InputManager::init() {
-	selectionShader = ShaderLoader::createShaderProgram("shaders/SelectionShader/SelectionVertex.glsl", "shaders/SelectionShader/SelectionFragment.glsl");
+void InputManager::init(World* world) {
+	this->world = world;
+	gpuPicker.init();
 }
 
-void InputManager::update(std::vector<Entity::EntityPtr> entities) {
+void InputManager::update(const std::vector<Entity::EntityPtr>& entities) {
 	// Update last mouse position so stationary input is registered.
 	lastMousePos = currentMousePos;
+	if (bindingsRemoved) eraseRemovedBindings();
 
-	// --- Selection buffer ---
-	// Each entity is rendered with a unique colour which can then be sampled using the mouse position to detect the selected entity.
-	glUseProgram(selectionShader);
-
-	// Update matrices.
-	if (entities.size() >= 1) entities[0]->getWorld()->updateVP(selectionShader);
-
-	for (int i = 0; i < entities.size(); i++) {
-		// Use entity index as the colour code. For more than 255 objects, this would be changed to use a vec4 (RGBA, rather than just R);
-		ShaderLoader::setShaderValue(selectionShader, ShaderLoader::Vars::COLOUR_CODE, (GLuint)i+1);
-		// Render the entity.
-		entities[i]->render(selectionShader);
-	}
-
-	// Get selected entity.
-	GLint viewport[4];
-	unsigned char sample[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
-	// Get the colour of the pixel under the mouse. Y is flipped as screen space uses negative Y and buffer space uses positive Y.
-	glReadPixels(currentMousePos.x, viewport[3] - currentMousePos.y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, sample);
-	int colourCode = sample[0];
-	if (colourCode > 0) {
-		// Since the colourCode used was the entity index + 1, then the selected entity is at colourCode - 1.
-		// Skip, though, if the selected entity is already selected.
-		if (entities.size() >= colourCode && selectedEntity != entities[colourCode - 1].get()) {
-			// Notify the currently selected entity that the mouse has stopped hovering over it.
-			if (selectedEntity) processEvents(MOUSE_OUT, entityEventBindings[selectedEntity]);
-			// Get the new selected entity.
-			selectedEntity = entities[colourCode - 1].get();
-			// Notify the entity that the mouse has entered it.
-			if (selectedEntity) processEvents(MOUSE_OVER, entityEventBindings[selectedEntity]);
-		}		
-	} else {
-		// Mouse is in open space.
-		if (selectedEntity) processEvents(MOUSE_OUT, entityEventBindings[selectedEntity]);
-		selectedEntity = nullptr;
-	}
-
-	// Clear the buffer for normal rendering.
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// The selection pass needs the GL context, so picking is done on the CPU while the world simulates on its own thread.
+	if (pickingMode == PICK_GPU && !world->isSimulationThreaded()) pickGPU(entities);
+	else pickCPU();
+}
+
+void InputManager::pickGPU(const std::vector<Entity::EntityPtr>& entities) {
+	Camera& camera = world->getCamera();
+	gpuPicker.render(entities, currentMousePos, glm::vec2(camera.screenWidth, camera.screenHeight));
+
+	// Select whatever was under the mouse when the newest finished readback was requested.
+	GLuint entityId;
+	if (gpuPicker.poll(entityId)) setSelectedEntity(world->findEntity(entityId));
+}
+
+void InputManager::pickCPU() {
+	Camera& camera = world->getCamera();
+	glm::mat4 viewProjection = camera.projectionMatrix * camera.viewMatrix;
+	// Nothing under the mouse can have changed.
+	if (currentMousePos == pickMousePos && viewProjection == pickViewProjection && world->getSceneVersion() == pickSceneVersion) return;
+	pickMousePos = currentMousePos;
+	pickViewProjection = viewProjection;
+	pickSceneVersion = world->getSceneVersion();
+
+	// Unproject the mouse position on the near and far planes. Y is flipped as screen space uses negative Y.
+	glm::vec2 ndc = glm::vec2(currentMousePos.x / camera.screenWidth * 2.f - 1.f, 1.f - currentMousePos.y / camera.screenHeight * 2.f);
+	glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1, 1);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1, 1);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 end = glm::vec3(farPoint) / farPoint.w;
+
+	float length = glm::length(end - origin);
+	setSelectedEntity(raycast(origin, (end - origin) / length, length));
+}
+
+/**
+* Moller-Trumbore ray/triangle intersection.
+* Returns the distance along the ray to the hit, or a negative value if it misses.
+*/
+static float intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+	const float epsilon = 1e-7f;
+	glm::vec3 edge1 = v1 - v0;
+	glm::vec3 edge2 = v2 - v0;
+	glm::vec3 p = glm::cross(direction, edge2);
+	float determinant = glm::dot(edge1, p);
+	// Parallel to the triangle. Both faces are hit, since the selection pass didn't cull back faces either.
+	if (determinant > -epsilon && determinant < epsilon) return -1;
+
+	float inverseDeterminant = 1.f / determinant;
+	glm::vec3 s = origin - v0;
+	float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0 || u > 1) return -1;
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0 || u + v > 1) return -1;
+	return glm::dot(edge2, q) * inverseDeterminant;
+}
+
+Entity* InputManager::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance/* = nullptr*/) {
+	// Candidates whose bounds the ray passes through, nearest first.
+	world->getSceneBVH().queryRay(origin, direction, maxDistance, pickCandidates);
+
+	Entity* nearestEntity = nullptr;
+	float nearestDistance = maxDistance;
+	for (auto& candidate : pickCandidates) {
+		// Every remaining candidate is further than the nearest hit.
+		if (candidate.distance > nearestDistance) break;
+		Entity* entity = candidate.entity;
+
+		// Bounding sphere.
+		glm::vec3 toCentre = entity->getWorldPosition() - origin;
+		float radius = entity->getBoundingRadius();
+		float along = glm::dot(toCentre, direction);
+		if (glm::dot(toCentre, toCentre) - along * along > radius * radius) continue;
+
+		// Triangles are tested in object space. The direction isn't normalised, so distances stay in world units.
+		glm::mat4 inverseModel = glm::inverse(entity->getModelMatrix());
+		glm::vec3 localOrigin = glm::vec3(inverseModel * glm::vec4(origin, 1));
+		glm::vec3 localDirection = glm::vec3(inverseModel * glm::vec4(direction, 0));
+		for (auto& mesh : entity->model.getMeshes()) {
+			// Geometry can only be read back from the GPU on the render thread. The sphere hit counts until it's ready.
+			if (mesh->getResidency() < KEEP_COLLISION_GEOMETRY && world->isSimulationThreaded()) {
+				if (along < nearestDistance) {
+					nearestDistance = glm::max(along, 0.f);
+					nearestEntity = entity;
+				}
+				if (pendingReadbacks.insert(mesh.get()).second) {
+					Mesh::MeshPtr readMesh = mesh;
+					world->runOnRenderThread([this, readMesh]() {
+						readMesh->getCollisionGeometry();
+						pendingReadbacks.erase(readMesh.get());
+					});
+				}
+				continue;
+			}
+
+			// Read back from the GPU the first time if the mesh didn't keep its geometry.
+			const Mesh::CPUGeometry& geometry = mesh->getCollisionGeometry();
+			const std::vector<glm::vec3>& positions = geometry.positions;
+			const std::vector<GLuint>& elements = geometry.indices;
+			for (size_t i = 0; i + 2 < elements.size(); i += 3) {
+				float distance = intersectTriangle(localOrigin, localDirection,
+					positions[elements[i]], positions[elements[i + 1]], positions[elements[i + 2]]);
+				if (distance >= 0 && distance < nearestDistance) {
+					nearestDistance = distance;
+					nearestEntity = entity;
+				}
+			}
+		}
+	}
+
+	if (hitDistance) *hitDistance = nearestDistance;
+	return nearestEntity;
+}
+
+void InputManager::setSelectedEntity(Entity* entity) {
+	// Skip if the entity is already selected.
+	if (entity == selectedEntity) return;
+	// Notify the currently selected entity that the mouse has stopped hovering over it.
+	if (selectedEntity) processEvents(MOUSE_OUT, entityEventBindings[selectedEntity]);
+	selectedEntity = entity;
+	// Notify the entity that the mouse has entered it.
+	if (selectedEntity) processEvents(MOUSE_OVER, entityEventBindings[selectedEntity]);
 }
 
 // Input functions.
-void InputManager::onMouse(int button, int state, int x, int y) {	
+void InputManager::onMouse(int button, int state, int x, int y) {
+	if (queueEvents) queueEvent({ QueuedEvent::MOUSE, button, state, 0, x, y });
+	else handleMouse(button, state, x, y);
+}
+
+void InputManager::onMouseMoved(int x, int y) {
+	if (queueEvents) queueEvent({ QueuedEvent::MOUSE_MOVED, 0, 0, 0, x, y });
+	else handleMouseMoved(x, y);
+}
+
+void InputManager::onKeyDown(unsigned char key, int x, int y) {
+	if (queueEvents) queueEvent({ QueuedEvent::KEY_DOWN, 0, 0, key, x, y });
+	else handleKeyDown(key);
+}
+
+void InputManager::onKeyUp(unsigned char key, int x, int y) {
+	if (queueEvents) queueEvent({ QueuedEvent::KEY_UP, 0, 0, key, x, y });
+	else handleKeyUp(key);
+}
+
+void InputManager::queueEvent(const QueuedEvent& event) {
+	std::lock_guard<std::mutex> lock(eventMutex);
+	queuedEvents.push_back(event);
+}
+
+void InputManager::dispatchQueuedEvents() {
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		if (queuedEvents.empty()) return;
+		dispatchingEvents.swap(queuedEvents);
+	}
+	for (const QueuedEvent& event : dispatchingEvents) {
+		switch (event.type) {
+			case QueuedEvent::MOUSE:
+				handleMouse(event.button, event.state, event.x, event.y);
+				break;
+			case QueuedEvent::MOUSE_MOVED:
+				handleMouseMoved(event.x, event.y);
+				break;
+			case QueuedEvent::KEY_DOWN:
+				handleKeyDown(event.key);
+				break;
+			case QueuedEvent::KEY_UP:
+				handleKeyUp(event.key);
+				break;
+		}
+	}
+	dispatchingEvents.clear();
+}
+
+void InputManager::handleMouse(int button, int state, int x, int y) {
 	currentMousePos = glm::vec2(x, y);
 	lastMousePos = currentMousePos;
 
@@ -78,7 +214,7 @@ void InputManager::onMouse(int button, int state, int x, int y) {
 	}
 }
 
-void InputManager::onMouseMoved(int x, int y) {
+void InputManager::handleMouseMoved(int x, int y) {
 	lastMousePos = currentMousePos;
 	currentMousePos = glm::vec2(x, y);
 	glm::vec2 delta = currentMousePos - lastMousePos;
@@ -86,59 +222,116 @@ void InputManager::onMouseMoved(int x, int y) {
 	delta *= mouseSensitivity;
 
 	// Trigger axis callback with the delta values.
-	for (auto& callback : mouseAxisBindings[EMouseAxis::MOUSE_X]) {
-		callback(delta.x);
+	auto& xBindings = mouseAxisBindings[EMouseAxis::MOUSE_X];
+	for (size_t i = 0; i < xBindings.size(); ++i) {
+		if (xBindings[i].callback) xBindings[i].callback(delta.x);
 	}
 	// Y
-	for (auto& callback : mouseAxisBindings[EMouseAxis::MOUSE_Y]) {
-		callback(delta.y);
+	auto& yBindings = mouseAxisBindings[EMouseAxis::MOUSE_Y];
+	for (size_t i = 0; i < yBindings.size(); ++i) {
+		if (yBindings[i].callback) yBindings[i].callback(delta.y);
 	}
 }
 
-void InputManager::onKeyDown(unsigned char key, int x, int y) {
+void InputManager::handleKeyDown(unsigned char key) {
 	// Trigger pressed callbacks.
 	processTriggers(EInputTrigger::INPUT_PRESSED, triggerBindings[key]);
 	
 }
 
-void InputManager::onKeyUp(unsigned char key, int x, int y) {
+void InputManager::handleKeyUp(unsigned char key) {
 	// Trigger released callbacks.
 	processTriggers(EInputTrigger::INPUT_RELEASED, triggerBindings[key]);
 }
 
 
 // Bindings.
-void InputManager::addTriggerBinding(unsigned char key, EInputTrigger triggerType, TriggerBinding callback) {
-	triggerBindings[key][triggerType].push_back(callback);
+void InputManager::addTriggerBinding(unsigned char key, EInputTrigger triggerType, TriggerBinding callback, const void* owner/* = nullptr*/) {
+	triggerBindings[key][triggerType].push_back({ callback, owner });
 }
 
-void InputManager::addTriggerBinding(EMouseButton mouseButton, EInputTrigger triggerType, TriggerBinding callback) {
-	mouseTriggerBindings[mouseButton][triggerType].push_back(callback);
+void InputManager::addTriggerBinding(EMouseButton mouseButton, EInputTrigger triggerType, TriggerBinding callback, const void* owner/* = nullptr*/) {
+	mouseTriggerBindings[mouseButton][triggerType].push_back({ callback, owner });
 }
 
-void InputManager::addTriggerBinding(std::vector<unsigned char> keys, EInputTrigger triggerType, TriggerBinding callback) {
+void InputManager::addTriggerBinding(std::vector<unsigned char> keys, EInputTrigger triggerType, TriggerBinding callback, const void* owner/* = nullptr*/) {
 	for (auto key : keys) {
-		addTriggerBinding(key, triggerType, callback);
+		addTriggerBinding(key, triggerType, callback, owner);
+	}
+}
+
+void InputManager::addValueBinding(EMouseAxis mouseAxis, ValueBinding callback, const void* owner/* = nullptr*/) {
+	mouseAxisBindings[mouseAxis].push_back({ callback, owner });
+}
+
+
+void InputManager::adddEventBinding(Entity* target, EInputEvent inputEvent, TriggerBinding callback, const void* owner/* = nullptr*/) {
+	entityEventBindings[target][inputEvent].push_back({ callback, owner });
+}
+
+template<typename Callback>
+bool InputManager::clearBindings(std::vector<Binding<Callback>>& bindings, const void* owner) {
+	// The bindings are left in place, as the list may be being dispatched.
+	bool cleared = false;
+	for (auto& binding : bindings) {
+		if (binding.owner != owner) continue;
+		binding.callback = nullptr;
+		binding.owner = nullptr;
+		cleared = true;
 	}
+	return cleared;
 }
 
-void InputManager::addValueBinding(EMouseAxis mouseAxis, ValueBinding callback) {
-	mouseAxisBindings[mouseAxis].push_back(callback);
+template<typename Callback>
+void InputManager::eraseClearedBindings(std::vector<Binding<Callback>>& bindings) {
+	bindings.erase(std::remove_if(bindings.begin(), bindings.end(), [](const Binding<Callback>& binding) {
+		return !binding.callback;
+	}), bindings.end());
 }
 
+void InputManager::removeBindings(const void* owner) {
+	if (!owner) return;
+	for (auto& keyBindings : triggerBindings) {
+		for (auto& bindings : keyBindings.second) bindingsRemoved |= clearBindings(bindings.second, owner);
+	}
+	for (auto& buttonBindings : mouseTriggerBindings) {
+		for (auto& bindings : buttonBindings.second) bindingsRemoved |= clearBindings(bindings.second, owner);
+	}
+	for (auto& bindings : mouseAxisBindings) {
+		bindingsRemoved |= clearBindings(bindings.second, owner);
+	}
+	for (auto& entityBindings : entityEventBindings) {
+		for (auto& bindings : entityBindings.second) bindingsRemoved |= clearBindings(bindings.second, owner);
+	}
+}
 
-void InputManager::adddEventBinding(Entity* target, EInputEvent inputEvent, TriggerBinding callback) {
-	entityEventBindings[target][inputEvent].push_back(callback);
+void InputManager::eraseRemovedBindings() {
+	for (auto& keyBindings : triggerBindings) {
+		for (auto& bindings : keyBindings.second) eraseClearedBindings(bindings.second);
+	}
+	for (auto& buttonBindings : mouseTriggerBindings) {
+		for (auto& bindings : buttonBindings.second) eraseClearedBindings(bindings.second);
+	}
+	for (auto& bindings : mouseAxisBindings) {
+		eraseClearedBindings(bindings.second);
+	}
+	for (auto& entityBindings : entityEventBindings) {
+		for (auto& bindings : entityBindings.second) eraseClearedBindings(bindings.second);
+	}
+	bindingsRemoved = false;
 }
 
 void InputManager::processTriggers(EInputTrigger triggerType, TriggerMap& triggers) {
-	for (auto& callback : triggers[triggerType]) {
-		callback();
+	// Indexed, as a callback may add bindings.
+	auto& bindings = triggers[triggerType];
+	for (size_t i = 0; i < bindings.size(); ++i) {
+		if (bindings[i].callback) bindings[i].callback();
 	}
 }
 
 void InputManager::processEvents(EInputEvent inputEvent, EventMap& events) {
-	for (auto& callback : events[inputEvent]) {
-		callback();
+	auto& bindings = events[inputEvent];
+	for (size_t i = 0; i < bindings.size(); ++i) {
+		if (bindings[i].callback) bindings[i].callback();
 	}
 }
@@ -0,0 +1,349 @@
+#include "../stdafx.h"
+#include "Scene/BVH.h"
+#include <algorithm>
+
+
+BVH::BVH() {}
+
+void BVH::insert(Entity* entity, const AABB& bounds) {
+	int leaf = allocateNode();
+	glm::vec3 margin = glm::max(bounds.getExtents() * fatMarginScale, glm::vec3(fatMarginMin));
+	nodes[leaf].bounds = AABB(bounds.min - margin, bounds.max + margin);
+	nodes[leaf].entity = entity;
+	nodes[leaf].height = 0;
+	leaves[entity] = leaf;
+	insertLeaf(leaf);
+}
+
+void BVH::remove(Entity* entity) {
+	auto found = leaves.find(entity);
+	if (found == leaves.end()) return;
+	removeLeaf(found->second);
+	freeNode(found->second);
+	leaves.erase(found);
+}
+
+bool BVH::update(Entity* entity, const AABB& bounds) {
+	auto found = leaves.find(entity);
+	if (found == leaves.end()) return false;
+	int leaf = found->second;
+	// Still inside the fat box, nothing to do.
+	if (nodes[leaf].bounds.contains(bounds)) return false;
+
+	// Reinsert with a new fat box.
+	removeLeaf(leaf);
+	glm::vec3 margin = glm::max(bounds.getExtents() * fatMarginScale, glm::vec3(fatMarginMin));
+	nodes[leaf].bounds = AABB(bounds.min - margin, bounds.max + margin);
+	insertLeaf(leaf);
+	return true;
+}
+
+void BVH::rebuild() {
+	// Gather the leaves and free every internal node.
+	std::vector<int> leafNodes;
+	leafNodes.reserve(leaves.size());
+	for (auto& leaf : leaves) {
+		leafNodes.push_back(leaf.second);
+	}
+	for (int i = 0; i < (int)nodes.size(); i++) {
+		if (nodes[i].height > 0) freeNode(i);
+	}
+
+	root = leafNodes.empty() ? NULL_NODE : buildTopDown(leafNodes.data(), (int)leafNodes.size());
+	if (root != NULL_NODE) nodes[root].parent = NULL_NODE;
+	rebuildCost = getCost();
+}
+
+bool BVH::rebuildIfDegraded() {
+	float cost = getCost();
+	// Rebuild against the last rebuild cost, or the first time any cost exists.
+	if (rebuildCost > 0 ? cost > rebuildCost * rebuildThreshold : cost > 0) {
+		rebuild();
+		return true;
+	}
+	return false;
+}
+
+float BVH::getCost() const {
+	float cost = 0;
+	for (auto& node : nodes) {
+		if (node.height > 0) cost += node.bounds.getSurfaceArea();
+	}
+	return cost;
+}
+
+
+// --- Queries
+
+void BVH::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<RayHit>& hits) const {
+	hits.clear();
+	if (root == NULL_NODE) return;
+	glm::vec3 inverseDirection = glm::vec3(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		int nodeId = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[nodeId];
+
+		float distance;
+		if (!node.bounds.intersectRay(origin, inverseDirection, maxDistance, distance)) continue;
+		if (node.isLeaf()) {
+			hits.push_back({ node.entity, distance });
+		} else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+
+	std::sort(hits.begin(), hits.end(), [](const RayHit& a, const RayHit& b) { return a.distance < b.distance; });
+}
+
+void BVH::querySphere(const glm::vec3& centre, float radius, std::vector<Entity*>& results) const {
+	if (root == NULL_NODE) return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!node.bounds.overlapsSphere(centre, radius)) continue;
+		if (node.isLeaf()) {
+			results.push_back(node.entity);
+		} else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<Entity*>& results) const {
+	if (root == NULL_NODE) return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		int nodeId = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[nodeId];
+
+		// Test the corner furthest along each plane normal (outside if it is behind) and the nearest
+		// corner (straddling if it is behind).
+		bool outside = false;
+		bool inside = true;
+		for (int i = 0; i < Frustum::NUM_PLANES && !outside; i++) {
+			const glm::vec4& plane = frustum.getPlane((Frustum::EPlane)i);
+			glm::vec3 furthest = glm::vec3(
+				(plane.x >= 0) ? node.bounds.max.x : node.bounds.min.x,
+				(plane.y >= 0) ? node.bounds.max.y : node.bounds.min.y,
+				(plane.z >= 0) ? node.bounds.max.z : node.bounds.min.z);
+			glm::vec3 nearest = glm::vec3(
+				(plane.x >= 0) ? node.bounds.min.x : node.bounds.max.x,
+				(plane.y >= 0) ? node.bounds.min.y : node.bounds.max.y,
+				(plane.z >= 0) ? node.bounds.min.z : node.bounds.max.z);
+			if (plane.x * furthest.x + plane.y * furthest.y + plane.z * furthest.z + plane.w < 0) outside = true;
+			else if (plane.x * nearest.x + plane.y * nearest.y + plane.z * nearest.z + plane.w < 0) inside = false;
+		}
+		if (outside) continue;
+
+		if (node.isLeaf()) {
+			results.push_back(node.entity);
+		} else if (inside) {
+			// Whole subtree is visible.
+			collectLeaves(nodeId, results);
+		} else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void BVH::collectLeaves(int node, std::vector<Entity*>& results) const {
+	if (nodes[node].isLeaf()) {
+		results.push_back(nodes[node].entity);
+		return;
+	}
+	collectLeaves(nodes[node].left, results);
+	collectLeaves(nodes[node].right, results);
+}
+
+
+// --- Tree management
+
+int BVH::allocateNode() {
+	if (freeList == NULL_NODE) {
+		nodes.push_back(Node());
+		return (int)nodes.size() - 1;
+	}
+	int node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node] = Node();
+	return node;
+}
+
+void BVH::freeNode(int node) {
+	nodes[node] = Node();
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void BVH::insertLeaf(int leaf) {
+	if (root == NULL_NODE) {
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// Find the best sibling, descending towards the child that increases the total surface area least.
+	const AABB leafBounds = nodes[leaf].bounds;
+	int index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		float area = node.bounds.getSurfaceArea();
+		float combinedArea = AABB::merge(node.bounds, leafBounds).getSurfaceArea();
+		// Cost of making a new parent for this node and the leaf.
+		float cost = 2.f * combinedArea;
+		// Minimum cost of pushing the leaf further down the tree.
+		float inheritanceCost = 2.f * (combinedArea - area);
+
+		float childCosts[2];
+		int children[2] = { node.left, node.right };
+		for (int i = 0; i < 2; i++) {
+			const Node& child = nodes[children[i]];
+			float mergedArea = AABB::merge(child.bounds, leafBounds).getSurfaceArea();
+			childCosts[i] = child.isLeaf() ? mergedArea + inheritanceCost : mergedArea - child.bounds.getSurfaceArea() + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1]) break;
+		index = (childCosts[0] < childCosts[1]) ? children[0] : children[1];
+	}
+	int sibling = index;
+
+	// Create a new parent for the sibling and leaf.
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = AABB::merge(leafBounds, nodes[sibling].bounds);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE) {
+		root = newParent;
+	} else if (nodes[oldParent].left == sibling) {
+		nodes[oldParent].left = newParent;
+	} else {
+		nodes[oldParent].right = newParent;
+	}
+
+	refitAncestors(nodes[leaf].parent);
+}
+
+void BVH::removeLeaf(int leaf) {
+	if (leaf == root) {
+		root = NULL_NODE;
+		return;
+	}
+
+	// Replace the parent with the leaf's sibling.
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+	if (grandParent == NULL_NODE) {
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+	} else {
+		if (nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+		else nodes[grandParent].right = sibling;
+		nodes[sibling].parent = grandParent;
+		refitAncestors(grandParent);
+	}
+	freeNode(parent);
+	nodes[leaf].parent = NULL_NODE;
+}
+
+void BVH::refitAncestors(int node) {
+	while (node != NULL_NODE) {
+		node = balance(node);
+
+		Node& current = nodes[node];
+		current.height = 1 + std::max(nodes[current.left].height, nodes[current.right].height);
+		current.bounds = AABB::merge(nodes[current.left].bounds, nodes[current.right].bounds);
+		node = current.parent;
+	}
+}
+
+int BVH::balance(int a) {
+	if (nodes[a].isLeaf() || nodes[a].height < 2) return a;
+
+	int b = nodes[a].left;
+	int c = nodes[a].right;
+	int difference = nodes[c].height - nodes[b].height;
+	if (difference >= -1 && difference <= 1) return a;
+
+	// Promote the taller child, moving its shorter grandchild into its place.
+	int tall = (difference > 1) ? c : b;
+	int f = nodes[tall].left;
+	int g = nodes[tall].right;
+
+	// Tall child takes a's place.
+	nodes[tall].left = a;
+	nodes[tall].parent = nodes[a].parent;
+	nodes[a].parent = tall;
+	if (nodes[tall].parent == NULL_NODE) {
+		root = tall;
+	} else if (nodes[nodes[tall].parent].left == a) {
+		nodes[nodes[tall].parent].left = tall;
+	} else {
+		nodes[nodes[tall].parent].right = tall;
+	}
+
+	// Keep the taller grandchild under the promoted node and give the shorter one to a.
+	int keep = (nodes[f].height > nodes[g].height) ? f : g;
+	int give = (keep == f) ? g : f;
+	nodes[tall].right = keep;
+	if (difference > 1) nodes[a].right = give;
+	else nodes[a].left = give;
+	nodes[give].parent = a;
+
+	nodes[a].bounds = AABB::merge(nodes[nodes[a].left].bounds, nodes[nodes[a].right].bounds);
+	nodes[a].height = 1 + std::max(nodes[nodes[a].left].height, nodes[nodes[a].right].height);
+	nodes[tall].bounds = AABB::merge(nodes[a].bounds, nodes[keep].bounds);
+	nodes[tall].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+	return tall;
+}
+
+int BVH::buildTopDown(int* leafNodes, int count) {
+	if (count == 1) return leafNodes[0];
+
+	// Split at the median along the longest axis of the leaf centres.
+	AABB centreBounds(nodes[leafNodes[0]].bounds.getCentre(), nodes[leafNodes[0]].bounds.getCentre());
+	for (int i = 1; i < count; i++) {
+		glm::vec3 centre = nodes[leafNodes[i]].bounds.getCentre();
+		centreBounds = AABB(glm::min(centreBounds.min, centre), glm::max(centreBounds.max, centre));
+	}
+	glm::vec3 extents = centreBounds.getExtents();
+	int axis = (extents.x > extents.y && extents.x > extents.z) ? 0 : (extents.y > extents.z) ? 1 : 2;
+
+	int half = count / 2;
+	std::nth_element(leafNodes, leafNodes + half, leafNodes + count, [this, axis](int a, int b) {
+		return nodes[a].bounds.getCentre()[axis] < nodes[b].bounds.getCentre()[axis];
+	});
+
+	int left = buildTopDown(leafNodes, half);
+	int right = buildTopDown(leafNodes + half, count - half);
+	int node = allocateNode();
+	nodes[node].left = left;
+	nodes[node].right = right;
+	nodes[node].bounds = AABB::merge(nodes[left].bounds, nodes[right].bounds);
+	nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+	nodes[left].parent = node;
+	nodes[right].parent = node;
+	return node;
+}
@@ -0,0 +1,402 @@
+#include "../stdafx.h"
+#include "Scene/TransformStore.h"
+#include "Transform.h"
+#include "Utils/JobSystem.h"
+#include <algorithm>
+
+// Lanes of the matrix kernel: AVX when the build targets it (/arch:AVX), otherwise SSE, which every x86 and x64
+// build has, and one float at a time on anything else.
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256 Lanes;
+static constexpr size_t LANE_COUNT = 8;
+static inline Lanes loadLanes(const float* values) { return _mm256_load_ps(values); }
+static inline void storeLanes(float* values, Lanes lanes) { _mm256_store_ps(values, lanes); }
+static inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes subLanes(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+typedef __m128 Lanes;
+static constexpr size_t LANE_COUNT = 4;
+static inline Lanes loadLanes(const float* values) { return _mm_load_ps(values); }
+static inline void storeLanes(float* values, Lanes lanes) { _mm_store_ps(values, lanes); }
+static inline Lanes splat(float value) { return _mm_set1_ps(value); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes subLanes(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+#else
+typedef float Lanes;
+static constexpr size_t LANE_COUNT = 1;
+static inline Lanes loadLanes(const float* values) { return *values; }
+static inline void storeLanes(float* values, Lanes lanes) { *values = lanes; }
+static inline Lanes splat(float value) { return value; }
+static inline Lanes addLanes(Lanes a, Lanes b) { return a + b; }
+static inline Lanes subLanes(Lanes a, Lanes b) { return a - b; }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return a * b; }
+#endif
+
+/** Components of one block gathered into contiguous arrays, and the rotation * scale part of the results. */
+struct alignas(32) MatrixBlock {
+	float qx[TransformStore::BLOCK_SIZE], qy[TransformStore::BLOCK_SIZE], qz[TransformStore::BLOCK_SIZE], qw[TransformStore::BLOCK_SIZE];
+	float sx[TransformStore::BLOCK_SIZE], sy[TransformStore::BLOCK_SIZE], sz[TransformStore::BLOCK_SIZE];
+	float m00[TransformStore::BLOCK_SIZE], m01[TransformStore::BLOCK_SIZE], m02[TransformStore::BLOCK_SIZE];
+	float m10[TransformStore::BLOCK_SIZE], m11[TransformStore::BLOCK_SIZE], m12[TransformStore::BLOCK_SIZE];
+	float m20[TransformStore::BLOCK_SIZE], m21[TransformStore::BLOCK_SIZE], m22[TransformStore::BLOCK_SIZE];
+};
+static_assert(TransformStore::BLOCK_SIZE % LANE_COUNT == 0, "Blocks must be a whole number of lanes.");
+
+/**
+* Computes the rotation matrix of each quaternion in a block (as glm::mat3_cast) with its columns scaled, a lane
+* group at a time. The count must be a multiple of LANE_COUNT.
+*/
+static void computeRotationScale(MatrixBlock& b, size_t count) {
+	const Lanes one = splat(1.f);
+	for (size_t i = 0; i < count; i += LANE_COUNT) {
+		Lanes qx = loadLanes(b.qx + i), qy = loadLanes(b.qy + i), qz = loadLanes(b.qz + i), qw = loadLanes(b.qw + i);
+		Lanes sx = loadLanes(b.sx + i), sy = loadLanes(b.sy + i), sz = loadLanes(b.sz + i);
+
+		Lanes x2 = addLanes(qx, qx), y2 = addLanes(qy, qy), z2 = addLanes(qz, qz);
+		Lanes xx = mulLanes(qx, x2), yy = mulLanes(qy, y2), zz = mulLanes(qz, z2);
+		Lanes xy = mulLanes(qx, y2), xz = mulLanes(qx, z2), yz = mulLanes(qy, z2);
+		Lanes wx = mulLanes(qw, x2), wy = mulLanes(qw, y2), wz = mulLanes(qw, z2);
+
+		storeLanes(b.m00 + i, mulLanes(subLanes(one, addLanes(yy, zz)), sx));
+		storeLanes(b.m01 + i, mulLanes(addLanes(xy, wz), sx));
+		storeLanes(b.m02 + i, mulLanes(subLanes(xz, wy), sx));
+		storeLanes(b.m10 + i, mulLanes(subLanes(xy, wz), sy));
+		storeLanes(b.m11 + i, mulLanes(subLanes(one, addLanes(xx, zz)), sy));
+		storeLanes(b.m12 + i, mulLanes(addLanes(yz, wx), sy));
+		storeLanes(b.m20 + i, mulLanes(addLanes(xz, wy), sz));
+		storeLanes(b.m21 + i, mulLanes(subLanes(yz, wx), sz));
+		storeLanes(b.m22 + i, mulLanes(subLanes(one, addLanes(xx, yy)), sz));
+	}
+}
+
+
+constexpr TransformStore::Handle TransformStore::INVALID_HANDLE;
+TransformStore::Storage* TransformStore::storage = nullptr;
+
+TransformStore::Storage& TransformStore::getStorage() {
+	if (!storage) {
+		storage = new Storage();
+		storage->threadChangedSlots.resize(JobSystem::MAX_THREADS);
+	}
+	return *storage;
+}
+
+TransformStore::Handle TransformStore::create(ITransform* owner) {
+	Storage& s = getStorage();
+	Handle handle;
+	if (!s.freeSlots.empty()) {
+		handle = s.freeSlots.back();
+		s.freeSlots.pop_back();
+	} else {
+		handle = (Handle)s.owners.size();
+		s.positionX.push_back(0); s.positionY.push_back(0); s.positionZ.push_back(0);
+		s.rotationX.push_back(0); s.rotationY.push_back(0); s.rotationZ.push_back(0); s.rotationW.push_back(1);
+		s.scaleX.push_back(1); s.scaleY.push_back(1); s.scaleZ.push_back(1);
+		s.matrices.push_back(glm::mat4(1.f));
+		s.hierarchyIndices.push_back(INVALID_HANDLE);
+		s.parents.push_back(INVALID_HANDLE);
+		s.firstChildren.push_back(INVALID_HANDLE);
+		s.nextSiblings.push_back(INVALID_HANDLE);
+		s.previousSiblings.push_back(INVALID_HANDLE);
+		s.changed.push_back(0);
+		s.matrixDirty.push_back(0);
+		s.owners.push_back(nullptr);
+	}
+
+	s.owners[handle] = owner;
+	setPosition(handle, glm::vec3(0));
+	setRotation(handle, glm::quat());
+	setScale(handle, glm::vec3(1));
+	s.stats.transforms++;
+	return handle;
+}
+
+void TransformStore::destroy(Handle handle) {
+	if (handle == INVALID_HANDLE || !storage) return;
+	Storage& s = *storage;
+	setParent(handle, INVALID_HANDLE);
+	while (s.firstChildren[handle] != INVALID_HANDLE) {
+		setParent(s.firstChildren[handle], INVALID_HANDLE);
+	}
+	// The slot may still be listed as changed. update() skips it while it has no owner.
+	s.owners[handle] = nullptr;
+	storage->freeSlots.push_back(handle);
+	storage->stats.transforms--;
+}
+
+void TransformStore::copy(Handle from, Handle to) {
+	setPosition(to, getPosition(from));
+	setRotation(to, getRotation(from));
+	setScale(to, getScale(from));
+}
+
+bool TransformStore::setParent(Handle handle, Handle parent) {
+	Storage& s = *storage;
+	if (s.parents[handle] == parent) return true;
+	for (Handle ancestor = parent; ancestor != INVALID_HANDLE; ancestor = s.parents[ancestor]) {
+		if (ancestor == handle) return false;
+	}
+
+	Handle oldParent = s.parents[handle];
+	if (oldParent != INVALID_HANDLE) {
+		// Unlink from the old parent's children.
+		Handle previous = s.previousSiblings[handle];
+		Handle next = s.nextSiblings[handle];
+		if (previous != INVALID_HANDLE) s.nextSiblings[previous] = next;
+		else s.firstChildren[oldParent] = next;
+		if (next != INVALID_HANDLE) s.previousSiblings[next] = previous;
+		s.previousSiblings[handle] = INVALID_HANDLE;
+		s.nextSiblings[handle] = INVALID_HANDLE;
+		s.stats.attached--;
+	}
+	if (parent != INVALID_HANDLE) {
+		Handle next = s.firstChildren[parent];
+		s.nextSiblings[handle] = next;
+		if (next != INVALID_HANDLE) s.previousSiblings[next] = handle;
+		s.firstChildren[parent] = handle;
+		s.stats.attached++;
+	}
+	s.parents[handle] = parent;
+	s.hierarchyChanged = true;
+	// The matrix relative to the parent is computed into the hierarchy arrays now.
+	markChanged(handle);
+	return true;
+}
+
+void TransformStore::setPosition(Handle handle, const glm::vec3& position) {
+	storage->positionX[handle] = position.x;
+	storage->positionY[handle] = position.y;
+	storage->positionZ[handle] = position.z;
+	markChanged(handle);
+}
+
+void TransformStore::setRotation(Handle handle, const glm::quat& rotation) {
+	storage->rotationX[handle] = rotation.x;
+	storage->rotationY[handle] = rotation.y;
+	storage->rotationZ[handle] = rotation.z;
+	storage->rotationW[handle] = rotation.w;
+	markChanged(handle);
+}
+
+void TransformStore::setScale(Handle handle, const glm::vec3& scale) {
+	storage->scaleX[handle] = scale.x;
+	storage->scaleY[handle] = scale.y;
+	storage->scaleZ[handle] = scale.z;
+	markChanged(handle);
+}
+
+void TransformStore::markChanged(Handle handle) {
+	storage->matrixDirty[handle] = 1;
+	if (storage->changed[handle]) return;
+	storage->changed[handle] = 1;
+	uint32_t thread = JobSystem::getThreadIndex();
+	if (thread == 0) {
+		storage->changedSlots.push_back(handle);
+	} else {
+		storage->threadChangedSlots[thread].push_back(handle);
+		storage->threadChangesPending.store(true, std::memory_order_relaxed);
+	}
+}
+
+void TransformStore::mergeThreadChanges() {
+	Storage& s = *storage;
+	if (!s.threadChangesPending.exchange(false)) return;
+	for (auto& slots : s.threadChangedSlots) {
+		s.changedSlots.insert(s.changedSlots.end(), slots.begin(), slots.end());
+		slots.clear();
+	}
+}
+
+const glm::mat4& TransformStore::getMatrix(Handle handle) {
+	Storage& s = *storage;
+	if (JobSystem::getThreadIndex() == 0) mergeThreadChanges();
+	if (s.hierarchyChanged) sortHierarchy();
+	if (s.matrixDirty[handle]) {
+		computeMatrices(&handle, 1);
+		s.computedOnDemand++;
+	}
+	uint32_t index = s.hierarchyIndices[handle];
+	if (index == INVALID_HANDLE) return s.matrices[handle];
+	// Any ancestor may have moved, so the world matrix is rebuilt up the chain until the next update().
+	if (!s.changedSlots.empty()) {
+		s.hierarchyMatrices[index] = getMatrix(s.parents[handle]) * s.hierarchyLocalMatrices[index];
+	}
+	return s.hierarchyMatrices[index];
+}
+
+void TransformStore::update() {
+	Storage& s = getStorage();
+	mergeThreadChanges();
+	// Owners may change transforms when notified, which starts the list for the next update.
+	s.updating.swap(s.changedSlots);
+	s.changedSlots.clear();
+
+	// Freed slots are skipped, as are matrices already computed on demand.
+	s.computing.clear();
+	size_t numLive = 0;
+	for (Handle handle : s.updating) {
+		s.changed[handle] = 0;
+		if (!s.owners[handle]) {
+			s.matrixDirty[handle] = 0;
+			continue;
+		}
+		s.updating[numLive++] = handle;
+		if (s.matrixDirty[handle]) s.computing.push_back(handle);
+	}
+	s.updating.resize(numLive);
+	// Local matrices of slots with a parent are written in hierarchy order, so it must be up to date first.
+	if (s.hierarchyChanged) sortHierarchy();
+	computeMatrices(s.computing.data(), s.computing.size());
+	updateHierarchy();
+
+	s.stats.updated = s.computing.size();
+	s.stats.computedOnDemand = s.computedOnDemand;
+	s.computedOnDemand = 0;
+
+	for (Handle handle : s.updating) {
+		// An earlier owner may have freed it.
+		if (s.owners[handle]) s.owners[handle]->onTransformUpdated();
+	}
+}
+
+void TransformStore::computeMatrices(const Handle* handles, size_t count) {
+	Storage& s = *storage;
+	MatrixBlock b;
+
+	for (size_t blockStart = 0; blockStart < count; blockStart += BLOCK_SIZE) {
+		const Handle* block = handles + blockStart;
+		size_t blockCount = std::min(count - blockStart, (size_t)BLOCK_SIZE);
+		// The last lane group is padded with identity transforms.
+		size_t laneCount = (blockCount + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT;
+
+		for (size_t i = 0; i < blockCount; i++) {
+			Handle handle = block[i];
+			b.qx[i] = s.rotationX[handle];
+			b.qy[i] = s.rotationY[handle];
+			b.qz[i] = s.rotationZ[handle];
+			b.qw[i] = s.rotationW[handle];
+			b.sx[i] = s.scaleX[handle];
+			b.sy[i] = s.scaleY[handle];
+			b.sz[i] = s.scaleZ[handle];
+		}
+		for (size_t i = blockCount; i < laneCount; i++) {
+			b.qx[i] = b.qy[i] = b.qz[i] = 0.f;
+			b.qw[i] = b.sx[i] = b.sy[i] = b.sz[i] = 1.f;
+		}
+
+		computeRotationScale(b, laneCount);
+
+		for (size_t i = 0; i < blockCount; i++) {
+			Handle handle = block[i];
+			// World matrices of slots with a parent are built from these in updateHierarchy().
+			uint32_t index = s.hierarchyIndices[handle];
+			glm::mat4& matrix = (index == INVALID_HANDLE) ? s.matrices[handle] : s.hierarchyLocalMatrices[index];
+			matrix[0] = glm::vec4(b.m00[i], b.m01[i], b.m02[i], 0.f);
+			matrix[1] = glm::vec4(b.m10[i], b.m11[i], b.m12[i], 0.f);
+			matrix[2] = glm::vec4(b.m20[i], b.m21[i], b.m22[i], 0.f);
+			matrix[3] = glm::vec4(s.positionX[handle], s.positionY[handle], s.positionZ[handle], 1.f);
+			s.matrixDirty[handle] = 0;
+		}
+	}
+}
+
+void TransformStore::sortHierarchy() {
+	Storage& s = *storage;
+	s.hierarchy.clear();
+	// Depth-first from each slot at the top of a hierarchy. The stack holds each open node's index and next child.
+	std::vector<std::pair<uint32_t, Handle>> stack;
+	for (Handle root = 0; root < (Handle)s.parents.size(); root++) {
+		if (s.parents[root] != INVALID_HANDLE || !s.owners[root] || s.firstChildren[root] == INVALID_HANDLE) continue;
+		stack.push_back(std::make_pair(INVALID_HANDLE, s.firstChildren[root]));
+		while (!stack.empty()) {
+			Handle child = stack.back().second;
+			if (child == INVALID_HANDLE) {
+				// Every descendant has been added.
+				if (stack.back().first != INVALID_HANDLE) s.hierarchy[stack.back().first].subtreeEnd = (uint32_t)s.hierarchy.size();
+				stack.pop_back();
+				continue;
+			}
+			stack.back().second = s.nextSiblings[child];
+
+			HierarchyNode node;
+			node.handle = child;
+			node.parent = s.parents[child];
+			node.parentIndex = INVALID_HANDLE;
+			node.subtreeEnd = (uint32_t)s.hierarchy.size() + 1;
+			s.hierarchy.push_back(node);
+			stack.push_back(std::make_pair((uint32_t)s.hierarchy.size() - 1, s.firstChildren[child]));
+		}
+	}
+
+	// Move the matrices into the new order. Newly attached slots are dirty, so their matrices are computed before use.
+	std::vector<glm::mat4> localMatrices(s.hierarchy.size(), glm::mat4(1.f));
+	std::vector<glm::mat4> worldMatrices(s.hierarchy.size(), glm::mat4(1.f));
+	for (size_t i = 0; i < s.hierarchy.size(); i++) {
+		uint32_t oldIndex = s.hierarchyIndices[s.hierarchy[i].handle];
+		if (oldIndex == INVALID_HANDLE) continue;
+		localMatrices[i] = s.hierarchyLocalMatrices[oldIndex];
+		worldMatrices[i] = s.hierarchyMatrices[oldIndex];
+	}
+	s.hierarchyLocalMatrices.swap(localMatrices);
+	s.hierarchyMatrices.swap(worldMatrices);
+	s.hierarchyMoved.assign(s.hierarchy.size(), 0);
+
+	std::fill(s.hierarchyIndices.begin(), s.hierarchyIndices.end(), INVALID_HANDLE);
+	for (size_t i = 0; i < s.hierarchy.size(); i++) {
+		s.hierarchyIndices[s.hierarchy[i].handle] = (uint32_t)i;
+	}
+	for (auto& node : s.hierarchy) {
+		node.parentIndex = s.hierarchyIndices[node.parent];
+	}
+	s.hierarchyChanged = false;
+}
+
+void TransformStore::updateHierarchy() {
+	Storage& s = *storage;
+	s.stats.hierarchyUpdated = 0;
+	if (s.hierarchy.empty() || s.updating.empty()) return;
+
+	// Subtrees to rebuild: those of moved slots with a parent, and those below moved slots at the top of a hierarchy.
+	s.subtreeStarts.clear();
+	for (Handle handle : s.updating) {
+		uint32_t index = s.hierarchyIndices[handle];
+		if (index != INVALID_HANDLE) {
+			s.hierarchyMoved[index] = 1;
+			s.subtreeStarts.push_back(index);
+			continue;
+		}
+		for (Handle child = s.firstChildren[handle]; child != INVALID_HANDLE; child = s.nextSiblings[child]) {
+			s.subtreeStarts.push_back(s.hierarchyIndices[child]);
+		}
+	}
+	std::sort(s.subtreeStarts.begin(), s.subtreeStarts.end());
+
+	// Parents come first, so their world matrices are final before their children read them. Only parents at the
+	// top of the hierarchy are read from the per-slot arrays.
+	uint32_t end = 0;
+	for (uint32_t start : s.subtreeStarts) {
+		// Inside a subtree that has already been rebuilt.
+		if (start < end) continue;
+		end = s.hierarchy[start].subtreeEnd;
+		for (uint32_t i = start; i < end; i++) {
+			const HierarchyNode& node = s.hierarchy[i];
+			// Moved through an ancestor, so its owner is notified too.
+			if (!s.hierarchyMoved[i]) {
+				s.hierarchyMoved[i] = 1;
+				s.updating.push_back(node.handle);
+			}
+			const glm::mat4& parentMatrix = (node.parentIndex != INVALID_HANDLE) ? s.hierarchyMatrices[node.parentIndex] : s.matrices[node.parent];
+			s.hierarchyMatrices[i] = parentMatrix * s.hierarchyLocalMatrices[i];
+			s.stats.hierarchyUpdated++;
+		}
+	}
+	for (Handle handle : s.updating) {
+		uint32_t index = s.hierarchyIndices[handle];
+		if (index != INVALID_HANDLE) s.hierarchyMoved[index] = 0;
+	}
+}
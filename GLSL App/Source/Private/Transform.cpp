@@ -4,8 +4,26 @@
 #include "glm/gtx/string_cast.hpp"
 
 
+ITransform::ITransform() {
+	transformHandle = TransformStore::create(this);
+}
+
+ITransform::ITransform(const ITransform& other) {
+	transformHandle = TransformStore::create(this);
+	TransformStore::copy(other.transformHandle, transformHandle);
+}
+
+ITransform& ITransform::operator=(const ITransform& other) {
+	if (this != &other) TransformStore::copy(other.transformHandle, transformHandle);
+	return *this;
+}
+
+ITransform::~ITransform() {
+	TransformStore::destroy(transformHandle);
+}
+
 void ITransform::setPosition(glm::vec3 newPosition) {
-	position = newPosition;
+	TransformStore::setPosition(transformHandle, newPosition);
 }
 
 void ITransform::setPosition(float x, float y, float z) {
@@ -13,7 +31,7 @@ void ITransform::setPosition(float x, float y, float z) {
 }
 
 void ITransform::move(glm::vec3 offset) {
-	position += offset;
+	TransformStore::setPosition(transformHandle, getPosition() + offset);
 }
 
 void ITransform::move(float x, float y, float z) {
@@ -21,11 +39,8 @@ void ITransform::move(float x, float y, float z) {
 }
 
 void ITransform::setRotation(glm::quat newRotation) {
-	rotation = newRotation;
-	// Rotate identity direction vectors to match.
-	forwardVector = glm::normalize(FORWARD_VECTOR * rotation);
-	rightVector = glm::normalize(RIGHT_VECTOR * rotation);
-	upVector = glm::normalize(UP_VECTOR * rotation);
+	// Normalised once here rather than the direction vectors on every read, so rotateBy() doesn't drift.
+	TransformStore::setRotation(transformHandle, glm::normalize(newRotation));
 }
 void ITransform::setRotation(glm::vec3 newRotation) {
 	setRotation(glm::quat(newRotation));
@@ -36,15 +51,58 @@ void ITransform::rotateBy(float degrees, glm::vec3 axis, bool global/*=false*/)
 	axis = glm::normalize(axis);
 	// Rotation space depends on which way round the quaternions are applied.
 	// Global (Existing rot applied to delta rot)
-	if (global) setRotation(glm::angleAxis(radians, axis) * rotation);
+	if (global) setRotation(glm::angleAxis(radians, axis) * getRotation());
 	// Local (Delta rot applied to existing rot).
-	else setRotation(rotation * glm::angleAxis(radians, axis));
+	else setRotation(getRotation() * glm::angleAxis(radians, axis));
 }
 
 
 void ITransform::setScale(glm::vec3 scaleFactor) {
-	scale = scaleFactor;
+	TransformStore::setScale(transformHandle, scaleFactor);
 }
 void ITransform::setScale(float scaleFactor) {
 	setScale(glm::vec3(scaleFactor));
 }
+
+glm::vec3 ITransform::getWorldScale() const {
+	if (TransformStore::getParent(transformHandle) == TransformStore::INVALID_HANDLE) return glm::abs(getScale());
+	const glm::mat4& matrix = getModelMatrix();
+	return glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2])));
+}
+
+bool ITransform::setParent(ITransform* parent, bool keepWorldTransform) {
+	TransformStore::Handle parentHandle = parent ? parent->transformHandle : TransformStore::INVALID_HANDLE;
+	if (TransformStore::getParent(transformHandle) == parentHandle) return true;
+
+	glm::mat4 worldMatrix = getModelMatrix();
+	if (!TransformStore::setParent(transformHandle, parentHandle)) return false;
+	if (keepWorldTransform) setFromMatrix(parent ? glm::inverse(parent->getModelMatrix()) * worldMatrix : worldMatrix);
+	return true;
+}
+
+/** Splits a matrix into a position, rotation and scale. Shear is lost. */
+static void decompose(const glm::mat4& matrix, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) {
+	scale = glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2])));
+	// Mirrored matrices keep the mirror in the scale, so the rotation stays a rotation.
+	if (glm::determinant(glm::mat3(matrix)) < 0) scale.x = -scale.x;
+	glm::mat3 rotationMatrix = glm::mat3(glm::vec3(matrix[0]) / scale.x, glm::vec3(matrix[1]) / scale.y, glm::vec3(matrix[2]) / scale.z);
+	position = glm::vec3(matrix[3]);
+	rotation = glm::quat_cast(rotationMatrix);
+}
+
+glm::quat ITransform::getWorldRotation() const {
+	if (TransformStore::getParent(transformHandle) == TransformStore::INVALID_HANDLE) return getRotation();
+	glm::vec3 position, scale;
+	glm::quat rotation;
+	decompose(getModelMatrix(), position, rotation, scale);
+	return glm::normalize(rotation);
+}
+
+void ITransform::setFromMatrix(const glm::mat4& matrix) {
+	glm::vec3 position, scale;
+	glm::quat rotation;
+	decompose(matrix, position, rotation, scale);
+	setPosition(position);
+	setRotation(rotation);
+	setScale(scale);
+}
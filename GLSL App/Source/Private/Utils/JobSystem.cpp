@@ -0,0 +1,248 @@
+#include "../stdafx.h"
+#include "Utils/JobSystem.h"
+#include <algorithm>
+
+
+// Index of the calling thread if it's a worker, otherwise 0, and the job it's running, which parallelFor() batches
+// are spawned under. Of the threads that aren't workers, only the main thread schedules jobs.
+static thread_local uint32_t threadIndex = 0;
+// Thread that getThreadIndex() reports as the main thread.
+static std::atomic<std::thread::id> mainThread;
+static thread_local JobSystem::JobHandle currentJob = nullptr;
+
+JobSystem::JobSystem() {
+	queues.reset(new WorkQueue[1]);
+	jobStorage.reset(new std::deque<Job>[1]);
+}
+
+JobSystem::~JobSystem() {
+	stop();
+}
+
+void JobSystem::start(unsigned int numThreads/* = 0*/) {
+	if (!workers.empty()) return;
+	if (numThreads == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	}
+	// One index is the main thread and one is kept for other threads.
+	numThreads = std::min(numThreads, (unsigned int)MAX_THREADS - 2);
+	setMainThread();
+
+	this->numThreads = numThreads + 1;
+	queues.reset(new WorkQueue[this->numThreads]);
+	jobStorage.reset(new std::deque<Job>[this->numThreads]);
+
+	stopping = false;
+	for (unsigned int i = 0; i < numThreads; i++) {
+		workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+	}
+}
+
+void JobSystem::stop() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+JobSystem::JobHandle JobSystem::schedule(std::function<void()> function, AccessMask reads, AccessMask writes, const std::vector<JobHandle>& dependencies/* = {}*/) {
+	Job* job = allocate();
+	job->function = std::move(function);
+	job->reads = reads;
+	job->writes = writes;
+
+	{
+		std::lock_guard<std::mutex> lock(dependencyMutex);
+		auto waitFor = [job](Job* other) {
+			if (other->finished) return;
+			other->continuations.push_back(job);
+			job->waitingOn++;
+		};
+		for (Job* other : scheduled) {
+			bool conflicts = (other->writes & (reads | writes)) || (writes & other->reads);
+			if (conflicts) waitFor(other);
+		}
+		for (Job* dependency : dependencies) {
+			if (dependency) waitFor(dependency);
+		}
+		scheduled.push_back(job);
+	}
+
+	release(job);
+	return job;
+}
+
+JobSystem::JobHandle JobSystem::parallelFor(size_t count, size_t batchSize, std::function<void(size_t begin, size_t end)> function,
+	AccessMask reads, AccessMask writes, const std::vector<JobHandle>& dependencies/* = {}*/) {
+	batchSize = std::max(batchSize, (size_t)1);
+	// Forks into batches once it runs, so the batches are only queued once its dependencies have finished.
+	return schedule([this, count, batchSize, function, reads, writes]() {
+		Job* parent = currentJob;
+		for (size_t begin = 0; begin < count; begin += batchSize) {
+			size_t end = std::min(begin + batchSize, count);
+			Job* batch = allocate();
+			batch->function = [function, begin, end]() { function(begin, end); };
+			batch->reads = reads;
+			batch->writes = writes;
+			batch->parent = parent;
+			batch->waitingOn = 0;
+			parent->unfinished++;
+			enqueue(batch);
+		}
+	}, reads, writes, dependencies);
+}
+
+void JobSystem::wait(JobHandle job) {
+	while (!job->done.load(std::memory_order_acquire)) {
+		Job* next = findJob(threadIndex);
+		if (next) execute(next);
+		else std::this_thread::yield();
+	}
+}
+
+void JobSystem::waitAll() {
+	for (Job* job : scheduled) {
+		wait(job);
+	}
+	scheduled.clear();
+	// Every job is done, so the workers are no longer touching any of them.
+	for (size_t i = 0; i < numThreads; i++) {
+		jobStorage[i].clear();
+	}
+
+	stats.jobs = jobsRun.exchange(0);
+	stats.stolen = jobsStolen.exchange(0);
+	stats.threads = isSingleThreaded() ? 1 : numThreads;
+}
+
+uint32_t JobSystem::getThreadIndex() {
+	if (threadIndex != 0) return threadIndex;
+	return (std::this_thread::get_id() == mainThread.load(std::memory_order_relaxed)) ? 0 : OTHER_THREAD_INDEX;
+}
+
+void JobSystem::setMainThread() {
+	mainThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+JobSystem::Job* JobSystem::allocate() {
+	// Only the calling thread allocates from its own storage.
+	std::deque<Job>& storage = jobStorage[threadIndex];
+	storage.emplace_back();
+	return &storage.back();
+}
+
+void JobSystem::release(Job* job) {
+	if (--job->waitingOn == 0) enqueue(job);
+}
+
+void JobSystem::enqueue(Job* job) {
+	if (isSingleThreaded()) {
+		execute(job);
+		return;
+	}
+
+	if (job->writes & ACCESS_MAIN_THREAD) {
+		std::lock_guard<std::mutex> lock(mainThreadQueue.mutex);
+		mainThreadQueue.jobs.push_back(job);
+		return;
+	}
+
+	{
+		WorkQueue& queue = queues[threadIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	queuedJobs++;
+	{
+		// Taken so a worker can't miss the notification between checking the count and sleeping.
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	workAvailable.notify_one();
+}
+
+void JobSystem::execute(Job* job) {
+	Job* previousJob = currentJob;
+	currentJob = job;
+	job->function();
+	currentJob = previousJob;
+	jobsRun++;
+	finish(job);
+}
+
+void JobSystem::finish(Job* job) {
+	if (--job->unfinished > 0) return;
+
+	std::vector<Job*> continuations;
+	{
+		std::lock_guard<std::mutex> lock(dependencyMutex);
+		job->finished = true;
+		continuations.swap(job->continuations);
+	}
+	for (Job* continuation : continuations) {
+		release(continuation);
+	}
+
+	// Marked done before the parent, which waitAll() may free everything after.
+	Job* parent = job->parent;
+	job->done.store(true, std::memory_order_release);
+	if (parent) finish(parent);
+}
+
+JobSystem::Job* JobSystem::findJob(uint32_t index) {
+	// Main thread jobs in the order they were queued.
+	if (index == 0) {
+		std::lock_guard<std::mutex> lock(mainThreadQueue.mutex);
+		if (!mainThreadQueue.jobs.empty()) {
+			Job* job = mainThreadQueue.jobs.front();
+			mainThreadQueue.jobs.pop_front();
+			return job;
+		}
+	}
+
+	// Newest job from the thread's own queue.
+	{
+		WorkQueue& queue = queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			Job* job = queue.jobs.back();
+			queue.jobs.pop_back();
+			queuedJobs--;
+			return job;
+		}
+	}
+
+	// Oldest job from the next thread that has one.
+	for (size_t offset = 1; offset < numThreads; offset++) {
+		WorkQueue& queue = queues[(index + offset) % numThreads];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			Job* job = queue.jobs.front();
+			queue.jobs.pop_front();
+			queuedJobs--;
+			jobsStolen++;
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+	threadIndex = index;
+	while (true) {
+		Job* job = findJob(index);
+		if (job) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workAvailable.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+		if (stopping) return;
+	}
+}
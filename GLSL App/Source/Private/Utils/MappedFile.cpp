@@ -0,0 +1,112 @@
+#include "../stdafx.h"
+#include "Utils/MappedFile.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+uint64_t MappedFile::getModifiedTime(const std::string& path) {
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0) return 0;
+	return (uint64_t)info.st_mtime;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		::close(file);
+		return false;
+	}
+
+	fileDescriptor = file;
+	data = (const unsigned char*)view;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (data) munmap((void*)data, size);
+	if (fileDescriptor >= 0) ::close(fileDescriptor);
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+
+uint64_t MappedFile::getModifiedTime(const std::string& path) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return 0;
+	return (uint64_t)info.st_mtime;
+}
+
+#endif
@@ -5,9 +5,60 @@
 #include "glm\gtx\vector_angle.hpp"
 #include "glm\gtx\rotate_vector.hpp"
 #include <ctime>
+#include <limits>
 #include "glm\gtc\type_ptr.hpp"
 #include "Input/InputManager.h"
 #include "Components/InteractableComponent.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/StagingBuffer.h"
+#include "Graphics/GeometryArena.h"
+#include "Utils/MeshUtils.h"
+
+
+typedef std::chrono::steady_clock Clock;
+
+static inline double secondsSince(const Clock::time_point& start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Returns the world space position, rotation and scale of an entity. */
+static WorldSnapshot::TransformState getWorldState(const Entity& entity) {
+	WorldSnapshot::TransformState state;
+	state.position = entity.getWorldPosition();
+	state.rotation = entity.getWorldRotation();
+	state.scale = entity.getWorldScale();
+	return state;
+}
+
+static WorldSnapshot::TransformState interpolate(const WorldSnapshot::TransformState& from, const WorldSnapshot::TransformState& to, float alpha) {
+	WorldSnapshot::TransformState state;
+	state.position = glm::mix(from.position, to.position, alpha);
+	state.rotation = glm::slerp(from.rotation, to.rotation, alpha);
+	state.scale = glm::mix(from.scale, to.scale, alpha);
+	return state;
+}
+
+/** Builds a render item from a world matrix and scale. */
+static World::RenderItem makeRenderItem(Entity* entity, const glm::mat4& matrix, const glm::vec3& scale) {
+	World::RenderItem item;
+	item.entity = entity;
+	item.matrix = matrix;
+	item.position = glm::vec3(matrix[3]);
+	glm::vec3 size = glm::abs(scale);
+	item.maxScale = glm::max(size.x, glm::max(size.y, size.z));
+	// Rotation doesn't change a sphere around the origin, so only the largest scale axis matters.
+	item.boundingRadius = entity->model.getBoundingRadius() * item.maxScale;
+	return item;
+}
+
+static World::RenderItem makeRenderItem(Entity* entity, const WorldSnapshot::TransformState& state) {
+	glm::mat4 matrix = glm::mat4_cast(state.rotation);
+	matrix[0] *= state.scale.x;
+	matrix[1] *= state.scale.y;
+	matrix[2] *= state.scale.z;
+	matrix[3] = glm::vec4(state.position, 1);
+	return makeRenderItem(entity, matrix, state.scale);
+}
 
 
 World::World() : camera(this), lightEntity(this) {
@@ -16,20 +67,37 @@ World::World() : camera(this), lightEntity(this) {
 }
 
 World::~World() {
+	stopSimulationThread();
 	/*for (auto* entity : entities) {
 		delete entity;
 	}*/
 }
 
 void World::init() {
+	// Before anything uploads through them.
+	StagingBuffer::init();
+	GeometryArena::init();
 	createShaders();
-	inputManager.init();
+	cameraBuffer.create(UniformBuffer::CAMERA_BINDING, sizeof(CameraBlock));
+	lightGrid.init();
+	inputManager.init(this);
+	assetLoader.start();
+	jobSystem.start();
+	// Toggles running every job on this thread in order, for debugging.
+	inputManager.addTriggerBinding('j', InputManager::INPUT_PRESSED, [this]() {
+		jobSystem.setSingleThreaded(!jobSystem.isSingleThreaded());
+	});
+	placeholderModel = MeshUtils::createCube(0.5f);
 
-	lightEntity = Entity(this, "assets/models/ball.obj");
+	// The light model loads alongside any other models, and the lights show the placeholder until it's ready.
+	lightEntity = Entity(this, placeholderModel);
+	getModelAsync(LIGHT_MODEL, Model::ImportSettings(), [this](bool success, const Model& model) {
+		if (success) lightEntity.setModel(model);
+	});
 
-	// Number of lights defined in the object fragment shader.
-	addLight(glm::vec3(10, 5, -5), glm::vec3(0.2), glm::vec3(0.8), glm::vec3(1));
-	addLight(glm::vec3(-5, -5, 0), glm::vec3(0), glm::vec3(0.2), glm::vec3(0.8));
+	// Scene lights. Radius is large enough to cover the whole scene.
+	addLight(glm::vec3(10, 5, -5), glm::vec3(0.2), glm::vec3(0.8), glm::vec3(1), 100);
+	addLight(glm::vec3(-5, -5, 0), glm::vec3(0), glm::vec3(0.2), glm::vec3(0.8), 100);
 
 	// Create the skybox cube mesh.
 	std::vector<Vertex> verts {
@@ -66,23 +134,96 @@ void World::init() {
 		6, 7, 3
 	};
 	// Texture is not bound since it is used differently to usual and handled during the world rendering.
-	skybox.addMesh(verts, indices, std::vector<Texture>(), 0);
+	skybox.addMesh(std::move(verts), std::move(indices), std::vector<Texture>(), 0);
 }
 
 Entity::EntityPtr World::createEntity(GLchar* path, Model::ImportSettings importSettings/* = Model::ImportSettings()*/) {
-	entities.push_back(Entity::EntityPtr(new Entity(this, path, importSettings)));
-	entitiesAndLights.push_back(entities.back());
-	return entities.back();
+	return createEntity(getModel(path, importSettings));
 }
 Entity::EntityPtr World::createEntity(Model model) {
 	entities.push_back(Entity::EntityPtr(new Entity(this, model)));
 	entitiesAndLights.push_back(entities.back());
+	sceneBVH.insert(entities.back().get(), entities.back()->getBounds());
+	entityIds[entities.back()->getId()] = entities.back().get();
+	sceneVersion++;
 	return entities.back();
 }
 
-void World::addLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular) {
-	lights.push_back(Light::Lightptr(new Light(this, "assets/models/ball.obj")));
+Entity::EntityPtr World::createEntityAsync(GLchar* path, Model::ImportSettings importSettings/* = Model::ImportSettings()*/, std::function<void(Entity&)> onLoaded/* = nullptr*/) {
+	Entity::EntityPtr entity = createEntity(placeholderModel);
+	std::string modelPath = path;
+	getModelAsync(path, importSettings, [entity, onLoaded, modelPath](bool success, const Model& model) {
+		if (!success) {
+			std::cout << "Failed to load '" << modelPath << "', showing the placeholder instead" << std::endl;
+			return;
+		}
+		entity->setModel(model);
+		if (onLoaded) onLoaded(*entity);
+	});
+	return entity;
+}
+
+Model World::getModel(GLchar* path, Model::ImportSettings importSettings/* = Model::ImportSettings()*/) {
+	std::string key = getModelKey(path, importSettings);
+	auto cached = modelCache.find(key);
+	if (cached != modelCache.end()) return cached->second;
+
+	return modelCache[key] = Model(path, importSettings);
+}
+
+void World::getModelAsync(const std::string& path, Model::ImportSettings importSettings, std::function<void(bool success, const Model&)> onLoaded) {
+	std::string key = getModelKey(path, importSettings);
+	auto cached = modelCache.find(key);
+	if (cached != modelCache.end()) {
+		onLoaded(true, cached->second);
+		return;
+	}
+
+	// Only the first request for a model starts loading it.
+	auto& callbacks = pendingModels[key];
+	callbacks.push_back(onLoaded);
+	if (callbacks.size() > 1) return;
+
+	assetLoader.load(path, importSettings, [this, key](bool success, const Model& model) {
+		// Take the callbacks first, since they may request more models.
+		auto callbacks = std::move(pendingModels[key]);
+		pendingModels.erase(key);
+		// Failures aren't cached, so a later request tries again.
+		if (!success) {
+			for (auto& callback : callbacks) {
+				callback(false, model);
+			}
+			return;
+		}
+
+		const Model& cachedModel = modelCache[key] = model;
+		for (auto& callback : callbacks) {
+			callback(true, cachedModel);
+		}
+	});
+}
+
+size_t World::loadModels(const std::vector<ModelRequest>& requests) {
+	for (auto& request : requests) {
+		getModelAsync(request.path, request.importSettings, [](bool, const Model&) {});
+	}
+	assetLoader.flush();
+
+	size_t loaded = 0;
+	for (auto& request : requests) {
+		if (modelCache.count(getModelKey(request.path, request.importSettings))) loaded++;
+	}
+	return loaded;
+}
+
+void World::addLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float radius/* = 50.f*/) {
+	lights.push_back(Light::Lightptr(new Light(this)));
 	Light::Lightptr light = lights.back();
+	// All lights share the same sphere mesh, shown once it's loaded.
+	light->model = placeholderModel;
+	getModelAsync(LIGHT_MODEL, Model::ImportSettings(), [light](bool success, const Model& model) {
+		if (success) light->setModel(model);
+	});
 	// Allow lights to be moved around.
 	light->addComponent<InteractableComponent>();
 	// Apply settings.
@@ -90,7 +231,11 @@ void World::addLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, g
 	light->ambient = ambient;
 	light->diffuse = diffuse;
 	light->specular = specular;
+	light->radius = radius;
 	entitiesAndLights.push_back(light);
+	sceneBVH.insert(light.get(), light->getBounds());
+	entityIds[light->getId()] = light.get();
+	sceneVersion++;
 }
 
 /*
@@ -103,72 +248,350 @@ void World::setSkyboxTexture(const char* rightfile, const char* leftFile, const
 }
 
 void World::update(float deltaTime) {
+	if (simulationThreaded) {
+		// Loaded models are set on entities the simulation reads, so they're uploaded between ticks.
+		std::lock_guard<std::mutex> lock(simulationMutex);
+		assetLoader.update();
+		runRenderTasks();
+		return;
+	}
+
+	// Finish any models loaded in the background. Entities they're set on are then updated as usual.
+	assetLoader.update();
+	simulate(deltaTime);
+}
+
+void World::simulate(float deltaTime) {
+	// Window input is queued while the simulation has its own thread.
+	inputManager.dispatchQueuedEvents();
 	camera.update(deltaTime);
-	inputManager.update(entitiesAndLights);	
+	if (!simulationThreaded) {
+		// Camera block is needed by the selection pass.
+		updateCameraBuffer(camera.getView());
+		// Only entities in view can be under the mouse.
+		cullEntities(getCameraFrustum(), entitiesAndLights, visibleEntitiesAndLights);
+	}
+	inputManager.update(visibleEntitiesAndLights);
+
+	// Components are updated a type at a time rather than entity by entity, in parallel where their access allows.
+	// This thread helps until they're done.
+	ComponentRegistry::update(deltaTime, jobSystem);
+	jobSystem.waitAll();
+
+	updateSceneBounds();
+}
 
-	for (auto& entity : entitiesAndLights) {
-		if (entity) entity->update(deltaTime);
+Entity* World::findEntity(GLuint id) {
+	auto found = entityIds.find(id);
+	return (found != entityIds.end()) ? found->second : nullptr;
+}
+
+void World::removeEntityId(const Entity* entity) {
+	auto found = entityIds.find(entity->getId());
+	if (found != entityIds.end() && found->second == entity) entityIds.erase(found);
+}
+
+void World::markBoundsDirty(Entity* entity) {
+	dirtyBounds.push_back(entity->getId());
+}
+
+void World::updateSceneBounds() {
+	// Computes the model matrices of everything that has moved, and queues the bounds of the moved entities.
+	TransformStore::update();
+	bool sceneMoved = false;
+	for (GLuint id : dirtyBounds) {
+		// Only entities in the scene are found. Others, such as the camera, stay flagged so they aren't queued again.
+		Entity* entity = findEntity(id);
+		if (!entity) continue;
+		entity->clearBoundsDirty();
+		if (sceneBVH.contains(entity)) sceneBVH.update(entity, entity->getBounds());
+		sceneMoved = true;
 	}
+	// Picking is skipped while this doesn't change, so only entities that can be picked count.
+	if (sceneMoved) sceneVersion++;
+	dirtyBounds.clear();
+	sceneBVH.rebuildIfDegraded();
 }
 
 void World::render() {
+	gatherRenderItems();
+	// Without the simulation thread the camera block was written by the update.
+	if (simulationThreaded) updateCameraBuffer(renderCamera);
+
+	// Lights have been updated, so rebuild the clustered light lists.
+	// Every light is binned, since lights outside the view can still reach visible objects.
+	updateLightBuffer();
+
+	// Entities may have moved during the update, so cull again before drawing.
+	Frustum frustum(renderCamera.projectionMatrix * renderCamera.viewMatrix);
+	numCulled = cullRenderItems(frustum, renderLights, visibleRenderLights);
+	numCulled += cullRenderItems(frustum, renderEntities, visibleRenderEntities);
+
 	// --- Lights
-	glUseProgram(lightShader);
-	updateVP(lightShader);
-	// Render each light.
-	for (unsigned int i=0; i < lights.size(); i++) {
-		// Update the object shader lights.
-		glUseProgram(objectShader);
-		ShaderLoader::setShaderValue(objectShader, ("lights[" + std::to_string(i) + "].position").c_str(), lights[i]->getPosition());
-		ShaderLoader::setShaderValue(objectShader, ("lights[" + std::to_string(i) + "].ambient").c_str(), lights[i]->ambient);
-		ShaderLoader::setShaderValue(objectShader, ("lights[" + std::to_string(i) + "].diffuse").c_str(), lights[i]->diffuse);
-		ShaderLoader::setShaderValue(objectShader, ("lights[" + std::to_string(i) + "].specular").c_str(), lights[i]->specular);
-
-		// Render a sphere for the light using the light shader.
-		glUseProgram(lightShader);
-		ShaderLoader::setShaderValue(lightShader, "lightColour", lights[i]->diffuse);
-		// Render the light.
-		lights[i]->render(lightShader);
+	lightShader.use();
+	// Render a sphere for each visible light using the light shader.
+	for (auto& item : visibleRenderLights) {
+		Light* light = static_cast<Light*>(item.entity);
+		lightShader.setValue(lightColourLocation, light->diffuse);
+		lightShader.setValue(lightShader.getUniforms().model, item.matrix);
+		light->model.render(lightShader);
 	}
 
 	// --- Render objects using the object shader.
-	glUseProgram(objectShader);
-
-	updateVP(objectShader);
-	// Also send camera position to the shader for specular lighting calculations.
-	ShaderLoader::setShaderValue(objectShader, ShaderLoader::Vars::VIEW_POSITION, camera.getPosition());
-
-	// Render entities.
-	for (auto& entity : entities) {
-		if (entity) entity->render(objectShader);
+	// Queue every entity mesh at its level of detail, then draw in state order. Entities sharing a mesh and level
+	// are drawn together with instancing.
+	renderQueue.clear();
+	lodSelector.beginFrame(renderCamera);
+	for (auto& item : visibleRenderEntities) {
+		const std::vector<Mesh::MeshPtr>& meshes = item.entity->model.getMeshes();
+		std::vector<uint8_t>& meshLODs = item.entity->getMeshLODs();
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::vec3 centre = glm::vec3(item.matrix * glm::vec4(meshes[i]->getBoundsCentre(), 1));
+			GLuint lod = lodSelector.select(*meshes[i], centre, item.maxScale, meshLODs[i]);
+			renderQueue.submit(objectShader, meshes[i].get(), item.matrix, lod);
+		}
 	}
+	renderQueue.render();
 
 	// --- Skybox
 	// Change depth method so values that are equal to the depth buffer content are still shown.
 	glDepthFunc(GL_LEQUAL);
 	// Render with the skybox shader.
-	glUseProgram(skyboxShader);
-	// Send view and projection.
-	ShaderLoader::setShaderValue(skyboxShader, ShaderLoader::Vars::PROJECTION, camera.projectionMatrix);
-	// Remove translation component from the view matrix so the skybox stays stationary.
-	ShaderLoader::setShaderValue(skyboxShader, ShaderLoader::Vars::VIEW, glm::mat4(glm::mat3(camera.viewMatrix)));
+	// View and projection come from the camera block.
+	skyboxShader.use();
 	// Use the cubemap texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
+	RenderState::bindTexture(0, GL_TEXTURE_CUBE_MAP, skyboxTexture);
 	skybox.render(skyboxShader);
 	glDepthFunc(GL_LESS);
 }
 
-void World::updateVP(GLuint& shaderProgram) {
-	// View.
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::VIEW, camera.viewMatrix);
+void World::updateCameraBuffer(const CameraView& view) {
+	CameraBlock cameraBlock;
+	cameraBlock.view = view.viewMatrix;
+	cameraBlock.projection = view.projectionMatrix;
+	cameraBlock.viewPosition = glm::vec4(view.position, 1);
+	cameraBuffer.update(cameraBlock);
+}
+
+void World::updateLightBuffer() {
+	lightInstances.clear();
+	for (auto& item : renderLights) {
+		lightInstances.push_back({ static_cast<Light*>(item.entity), item.position });
+	}
+	lightGrid.update(renderCamera, lightInstances);
+}
+
+Frustum World::getCameraFrustum() {
+	return Frustum(camera.projectionMatrix * camera.viewMatrix);
+}
+
+size_t World::cullRenderItems(const Frustum& frustum, const std::vector<RenderItem>& source, std::vector<RenderItem>& visible) {
+	cullSpheres.clear();
+	for (auto& item : source) {
+		cullSpheres.add(item.position, item.boundingRadius);
+	}
+	size_t numVisible = frustum.cullSpheres(cullSpheres, cullResults);
+
+	visible.clear();
+	for (size_t i = 0; i < source.size(); i++) {
+		if (cullResults[i]) visible.push_back(source[i]);
+	}
+	return source.size() - numVisible;
+}
+
+void World::gatherRenderItems() {
+	renderEntities.clear();
+	renderLights.clear();
+
+	if (!simulationThreaded) {
+		renderCamera = camera.getView();
+		for (auto& entity : entities) {
+			if (entity) renderEntities.push_back(makeRenderItem(entity.get(), entity->getModelMatrix(), entity->getWorldScale()));
+		}
+		for (auto& light : lights) {
+			if (light) renderLights.push_back(makeRenderItem(light.get(), light->getModelMatrix(), light->getWorldScale()));
+		}
+		return;
+	}
+
+	// Draw the world as it was at this moment, between the states before and after the latest tick.
+	snapshots.update();
+	const WorldSnapshot& snapshot = snapshots.getFrontBuffer();
+	float alpha = glm::clamp((float)((secondsSince(simulationStart) - snapshot.time) / snapshot.tickInterval), 0.f, 1.f);
+
+	const WorldSnapshot::CameraState& cameraState = snapshot.camera;
+	WorldSnapshot::TransformState cameraTransform = interpolate(cameraState.previous, cameraState.current, alpha);
+	renderCamera.projectionMatrix = cameraState.projectionMatrix;
+	renderCamera.viewMatrix = Camera::getViewMatrix(cameraTransform.position, cameraTransform.rotation);
+	renderCamera.position = cameraTransform.position;
+	renderCamera.FOV = cameraState.FOV;
+	renderCamera.screenWidth = cameraState.screenWidth;
+	renderCamera.screenHeight = cameraState.screenHeight;
+	renderCamera.nearClippingPlane = cameraState.nearClippingPlane;
+	renderCamera.farClippingPlane = cameraState.farClippingPlane;
+
+	for (auto& state : snapshot.entities) {
+		renderEntities.push_back(makeRenderItem(state.entity, interpolate(state.previous, state.current, alpha)));
+	}
+	for (auto& state : snapshot.lights) {
+		renderLights.push_back(makeRenderItem(state.entity, interpolate(state.previous, state.current, alpha)));
+	}
+}
+
+void World::startSimulationThread(double ticksPerSecond/* = 60*/) {
+	if (simulationThreaded) return;
+	tickInterval = 1.0 / ticksPerSecond;
+	simulationStats = SimulationStats();
+	lastEntityStates.clear();
+	lastLightStates.clear();
+	lastCameraState = getWorldState(camera);
+
+	// Start with the current state, so the render thread has something to draw before the first tick.
+	simulationStart = Clock::now();
+	publishSnapshot(0, 0);
+	snapshots.update();
+
+	inputManager.setQueueEvents(true);
+	simulationThreaded = true;
+	stopSimulation = false;
+	simulationThread = std::thread(&World::simulationLoop, this);
+}
+
+void World::stopSimulationThread() {
+	if (!simulationThreaded) return;
+	stopSimulation = true;
+	simulationThread.join();
+	simulationThreaded = false;
+	// This thread runs the updates and their jobs again.
+	JobSystem::setMainThread();
+
+	// Anything still queued is handled straight away from now on.
+	runRenderTasks();
+	inputManager.dispatchQueuedEvents();
+	inputManager.setQueueEvents(false);
+}
+
+void World::runOnRenderThread(std::function<void()> task) {
+	if (!simulationThreaded) {
+		task();
+		return;
+	}
+	std::lock_guard<std::mutex> lock(renderTasksMutex);
+	renderTasks.push_back(std::move(task));
+}
 
-	// Projection.
-	ShaderLoader::setShaderValue(shaderProgram, ShaderLoader::Vars::PROJECTION, camera.projectionMatrix);
+World::SimulationStats World::getSimulationStats() {
+	std::lock_guard<std::mutex> lock(simulationMutex);
+	return simulationStats;
+}
+
+void World::runRenderTasks() {
+	std::vector<std::function<void()>> tasks;
+	{
+		std::lock_guard<std::mutex> lock(renderTasksMutex);
+		tasks.swap(renderTasks);
+	}
+	for (auto& task : tasks) {
+		task();
+	}
+}
+
+void World::simulationLoop() {
+	// The updates and their jobs run on this thread until it stops, so the render thread no longer counts as the main thread.
+	JobSystem::setMainThread();
+	std::chrono::duration<double> interval(tickInterval);
+	uint64_t tick = 0;
+	while (!stopSimulation) {
+		// Each tick starts on its own schedule, so the simulation keeps step with the clock however long the ticks take.
+		Clock::time_point due = simulationStart + std::chrono::duration_cast<Clock::duration>(interval * (double)tick);
+		std::this_thread::sleep_until(due);
+		if (stopSimulation) break;
+
+		{
+			std::lock_guard<std::mutex> lock(simulationMutex);
+			Clock::time_point tickStart = Clock::now();
+			simulate((float)tickInterval);
+			publishSnapshot(tick + 1, tick * tickInterval);
+			simulationStats.ticks++;
+			simulationStats.lastTickMs = secondsSince(tickStart) * 1000;
+		}
+		tick++;
+
+		// After a stall, e.g. the window being dragged, only a few ticks are caught up and the rest are dropped.
+		uint64_t dueTicks = (uint64_t)(secondsSince(simulationStart) / tickInterval);
+		if (dueTicks > tick + MAX_CATCH_UP_TICKS) {
+			std::lock_guard<std::mutex> lock(simulationMutex);
+			simulationStats.skippedTicks += dueTicks - tick - MAX_CATCH_UP_TICKS;
+			tick = dueTicks - MAX_CATCH_UP_TICKS;
+		}
+	}
+}
+
+void World::publishSnapshot(uint64_t tick, double time) {
+	WorldSnapshot& snapshot = snapshots.getBackBuffer();
+	snapshot.tick = tick;
+	snapshot.time = time;
+	snapshot.tickInterval = tickInterval;
+
+	// The previous state of each entity is its state in the last snapshot. Entities are only ever added to the
+	// lists, so they keep their index. New entities start at rest.
+	auto gather = [](const std::vector<Entity*>& source, std::vector<WorldSnapshot::EntityState>& states, std::vector<WorldSnapshot::EntityState>& lastStates) {
+		states.clear();
+		for (size_t i = 0; i < source.size(); i++) {
+			Entity* entity = source[i];
+			if (!entity) continue;
+			WorldSnapshot::EntityState state;
+			state.entity = entity;
+			state.current = getWorldState(*entity);
+			bool existed = states.size() < lastStates.size() && lastStates[states.size()].entity == entity;
+			state.previous = existed ? lastStates[states.size()].current : state.current;
+			states.push_back(state);
+		}
+		lastStates = states;
+	};
+	std::vector<Entity*> source;
+	for (auto& entity : entities) source.push_back(entity.get());
+	gather(source, snapshot.entities, lastEntityStates);
+	source.clear();
+	for (auto& light : lights) source.push_back(light.get());
+	gather(source, snapshot.lights, lastLightStates);
+
+	WorldSnapshot::CameraState& cameraState = snapshot.camera;
+	cameraState.previous = lastCameraState;
+	cameraState.current = getWorldState(camera);
+	lastCameraState = cameraState.current;
+	cameraState.projectionMatrix = camera.projectionMatrix;
+	cameraState.FOV = camera.FOV;
+	cameraState.screenWidth = camera.screenWidth;
+	cameraState.screenHeight = camera.screenHeight;
+	cameraState.nearClippingPlane = camera.nearClippingPlane;
+	cameraState.farClippingPlane = camera.farClippingPlane;
+
+	snapshots.publish();
+}
+
+template<typename T>
+size_t World::cullEntities(const Frustum& frustum, const std::vector<std::shared_ptr<T>>& source, std::vector<std::shared_ptr<T>>& visible) {
+	// Gather bounding spheres into contiguous arrays for the batch test.
+	cullSpheres.clear();
+	for (auto& entity : source) {
+		if (entity) cullSpheres.add(entity->getWorldPosition(), entity->getBoundingRadius());
+		// Null entries are given a sphere that is always rejected.
+		else cullSpheres.add(glm::vec3(0), -std::numeric_limits<float>::infinity());
+	}
+	size_t numVisible = frustum.cullSpheres(cullSpheres, cullResults);
+
+	visible.clear();
+	for (size_t i = 0; i < source.size(); i++) {
+		if (cullResults[i]) visible.push_back(source[i]);
+	}
+	return source.size() - numVisible;
 }
 
 void World::createShaders() {
-	objectShader = ShaderLoader::createShaderProgram("shaders/ObjectShader/ObjectVertex.glsl", "shaders/ObjectShader/ObjectFragment.glsl");
-	lightShader = ShaderLoader::createShaderProgram("shaders/LightShader/LightVertex.glsl", "shaders/LightShader/LightFragment.glsl");
-	skyboxShader = ShaderLoader::createShaderProgram("shaders/CubemapShader/CubemapVertex.glsl", "shaders//CubemapShader/CubemapFragment.glsl");
+	objectShader = ShaderProgram("shaders/ObjectShader/ObjectVertex.glsl", "shaders/ObjectShader/ObjectFragment.glsl");
+	lightShader = ShaderProgram("shaders/LightShader/LightVertex.glsl", "shaders/LightShader/LightFragment.glsl");
+	skyboxShader = ShaderProgram("shaders/CubemapShader/CubemapVertex.glsl", "shaders//CubemapShader/CubemapFragment.glsl");
+
+	lightColourLocation = lightShader.getUniformLocation("lightColour");
 }
@@ -0,0 +1,212 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include "Utils/JobSystem.h"
+
+class Entity;
+class EntityComponent;
+
+/** Base of the per-type component pools, so the registry can update and free components without knowing their type. */
+class ComponentPoolBase {
+
+public:
+	virtual ~ComponentPoolBase() {}
+
+	/**
+	* Schedules update() of every component in the pool, in batches that run in parallel unless the component type
+	* writes JobSystem::ACCESS_MAIN_THREAD, in which case they run on the thread updating the World. Returns null if
+	* there is nothing to update.
+	*/
+	virtual JobSystem::JobHandle scheduleUpdate(float deltaTime, JobSystem& jobs) = 0;
+	/** Destroys a component and frees its slot. */
+	virtual void remove(EntityComponent* component) = 0;
+	virtual size_t size() const = 0;
+};
+
+/**
+* Storage for every component of one type.
+* Components are constructed in place in fixed-size chunks, so they are packed together in memory and never move
+* once created (input bindings hold pointers to them). Freed slots are reused by the next component added.
+* update() calls T::update() directly rather than through the vtable, so it can be inlined into the loop.
+* The access declared by T::UPDATE_READS and T::UPDATE_WRITES is used for the update job.
+*/
+template<typename T>
+class ComponentPool : public ComponentPoolBase {
+
+public:
+	/** Components per chunk. */
+	static constexpr uint32_t CHUNK_SIZE = 256;
+	/** Most slots per update batch. */
+	static constexpr size_t BATCH_SIZE = 64;
+
+protected:
+	struct Chunk {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[CHUNK_SIZE];
+		// Whether each slot holds a component.
+		uint8_t used[CHUNK_SIZE] = {};
+		// Number of used slots, and one past the last slot ever used, so the loops can stop early.
+		uint32_t count = 0;
+		uint32_t end = 0;
+
+		inline T* get(uint32_t index) { return reinterpret_cast<T*>(&slots[index]); };
+	};
+
+	std::vector<std::unique_ptr<Chunk>> chunks;
+	std::vector<uint32_t> freeSlots;
+	size_t count = 0;
+
+	// Components that don't override update() are skipped.
+	static constexpr bool HAS_UPDATE = !std::is_same<decltype(&T::update), void (EntityComponent::*)(float)>::value;
+
+public:
+	~ComponentPool() {
+		forEach([](T& component) { component.~T(); });
+	}
+
+	/** Constructs a component for an owner in a free slot. */
+	T* add(Entity* owner) {
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		} else {
+			if (chunks.empty() || chunks.back()->end == CHUNK_SIZE) chunks.emplace_back(new Chunk());
+			slot = (uint32_t)(chunks.size() - 1) * CHUNK_SIZE + chunks.back()->end;
+		}
+
+		Chunk& chunk = *chunks[slot / CHUNK_SIZE];
+		uint32_t index = slot % CHUNK_SIZE;
+		T* component = new (&chunk.slots[index]) T(owner);
+		component->poolSlot = slot;
+		chunk.used[index] = 1;
+		chunk.count++;
+		chunk.end = std::max(chunk.end, index + 1);
+		count++;
+		return component;
+	}
+
+	void remove(EntityComponent* component) override {
+		T* typedComponent = static_cast<T*>(component);
+		uint32_t slot = typedComponent->poolSlot;
+		Chunk& chunk = *chunks[slot / CHUNK_SIZE];
+		typedComponent->~T();
+		chunk.used[slot % CHUNK_SIZE] = 0;
+		chunk.count--;
+		freeSlots.push_back(slot);
+		count--;
+	}
+
+	/** Calls a function with every component in the pool, in memory order. */
+	template<typename Function>
+	void forEach(Function function) {
+		// Indexed, as the function may add components.
+		for (size_t c = 0; c < chunks.size(); c++) {
+			Chunk& chunk = *chunks[c];
+			if (chunk.count == 0) continue;
+			for (uint32_t i = 0; i < chunk.end; i++) {
+				if (chunk.used[i]) function(*chunk.get(i));
+			}
+		}
+	}
+
+	JobSystem::JobHandle scheduleUpdate(float deltaTime, JobSystem& jobs) override {
+		if (!HAS_UPDATE || count == 0) return nullptr;
+		// Components added before the batches run aren't updated until the next frame.
+		size_t numSlots = (chunks.size() - 1) * CHUNK_SIZE + chunks.back()->end;
+		return jobs.parallelFor(numSlots, BATCH_SIZE, [this, deltaTime](size_t begin, size_t end) {
+			update(begin, end, deltaTime);
+		}, T::UPDATE_READS, T::UPDATE_WRITES);
+	}
+
+	/** Calls update() on the components in a range of slots. */
+	void update(size_t begin, size_t end, float deltaTime) {
+		size_t slot = begin;
+		while (slot < end) {
+			Chunk& chunk = *chunks[slot / CHUNK_SIZE];
+			size_t chunkStart = slot - slot % CHUNK_SIZE;
+			size_t chunkEnd = std::min(end, chunkStart + chunk.end);
+			for (; slot < chunkEnd; slot++) {
+				if (chunk.used[slot - chunkStart]) chunk.get((uint32_t)(slot - chunkStart))->T::update(deltaTime);
+			}
+			slot = chunkStart + CHUNK_SIZE;
+		}
+	}
+
+	size_t size() const override { return count; };
+};
+
+/**
+* Owns the components of every entity, in a pool per component type.
+* Each component type is given a small integer ID the first time it's used, without RTTI, which indexes the pools
+* and each entity's component table, so finding a component is a single lookup. update() first calls beginPlay()
+* on the components added since the last update, then schedules the update of each pool on the JobSystem. Pools
+* whose declared access doesn't conflict are updated at the same time.
+*/
+class ComponentRegistry {
+
+protected:
+	struct Storage {
+		// Pool of each component type, indexed by type ID.
+		std::vector<ComponentPoolBase*> pools;
+		// Components waiting for beginPlay().
+		std::vector<EntityComponent*> beginPlayQueue;
+	};
+
+	// Created on first use and never destroyed, so entities freed during shutdown don't depend on static destruction order.
+	static Storage* storage;
+	// Types may first be used on any thread, e.g. the simulation thread or a job.
+	static std::atomic<size_t> nextTypeId;
+
+public:
+	/** Returns the ID of a component type. IDs are given out in the order types are first used. */
+	template<typename T>
+	static size_t getTypeId() {
+		static const size_t id = nextTypeId++;
+		return id;
+	}
+
+	/** Returns the pool of a component type, creating it the first time. */
+	template<typename T>
+	static ComponentPool<T>& getPool() {
+		size_t type = getTypeId<T>();
+		Storage& s = getStorage();
+		if (s.pools.size() <= type) s.pools.resize(type + 1, nullptr);
+		if (!s.pools[type]) s.pools[type] = new ComponentPool<T>();
+		return *static_cast<ComponentPool<T>*>(s.pools[type]);
+	}
+
+	/** Creates a component for an entity. Its beginPlay() is called at the start of the next update(). */
+	template<typename T>
+	static T* add(Entity* owner) {
+		T* component = getPool<T>().add(owner);
+		getStorage().beginPlayQueue.push_back(component);
+		return component;
+	}
+
+	/** Destroys a component. */
+	static void remove(size_t type, EntityComponent* component);
+
+	/**
+	* Calls a function with every component of a type, e.g. for a system that works on all of them at once.
+	* Parameter: Function function  Called as function(T& component).
+	*/
+	template<typename T, typename Function>
+	static void forEach(Function function) {
+		getPool<T>().forEach(function);
+	}
+
+	/**
+	* Begins play for new components on the calling thread, then schedules the update of every component.
+	* The updates have finished once the job system has been waited on. Components must not be added or removed
+	* by updates running in parallel.
+	*/
+	static void update(float deltaTime, JobSystem& jobs);
+
+protected:
+	static Storage& getStorage();
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "World.h"
+#include "Utils/JobSystem.h"
 
 class Entity;
 
@@ -10,18 +11,36 @@ private:
 	/** Entity that this component is attached to. */
 	Entity* owner = nullptr;
 
-	/** Flag for whether beginPlay has been called. */
+	/** Flag for whether beginPlay has been called. Set by the ComponentRegistry. */
 	bool hasBegunPlay = false;
 
+	/** Slot in the pool of the component's type. */
+	uint32_t poolSlot = 0;
+
+	friend class ComponentRegistry;
+	template<typename T> friend class ComponentPool;
+
 public:
+	/**
+	* Shared state the update() of the component type reads and writes (see JobSystem). Types that declare less than
+	* the default are updated in parallel batches, so their update() may only change their own entity's transform.
+	* Others are updated on the thread running the World's update, which is the simulation thread while it has one,
+	* so GL calls from update() go through World::runOnRenderThread().
+	*/
+	static constexpr JobSystem::AccessMask UPDATE_READS = JobSystem::ACCESS_ALL;
+	static constexpr JobSystem::AccessMask UPDATE_WRITES = JobSystem::ACCESS_ALL;
+
 	EntityComponent(Entity* owner);
 	~EntityComponent();
 
-	/** Called the first time this entity is updated. */
+	/** Called by the ComponentRegistry before the first update after the component is added. */
 	virtual void beginPlay();
 
-	/** Main update function called each frame. */
-	virtual void update(float deltaTime);
+	/**
+	* Main update function called each frame. Components without one aren't visited by the update loop.
+	* Called directly on the component's own type, so overrides should be declared in the most derived class.
+	*/
+	virtual void update(float deltaTime) {};
 
 	/** Returns the entity this component is attached to */
 	inline Entity* getOwner() { return owner; };
@@ -15,14 +15,12 @@ public:
 	/** Whether the axis should be in local or global space */
 	bool localSpace = true;
 
-protected:
-	// Pointer to the interactable. component of the owning entity, if there is one.
-	class InteractableComponent* interactableComponent;
-
 public:
-	RotatingComponent(Entity* owner);
+	// Finds the entity's interactable component, reads whether the entity is selected, and rotates it.
+	static constexpr JobSystem::AccessMask UPDATE_READS = JobSystem::ACCESS_INPUT | JobSystem::ACCESS_TRANSFORMS | JobSystem::ACCESS_SCENE;
+	static constexpr JobSystem::AccessMask UPDATE_WRITES = JobSystem::ACCESS_TRANSFORMS;
 
-	void beginPlay() override;
+	RotatingComponent(Entity* owner);
 
 	void update(float deltaTime) override;
 };
@@ -1,6 +1,18 @@
 #pragma once
 #include "Entity.h"
 
+/** What a camera sees: its matrices and projection settings, copied so they can be used without the camera. */
+struct CameraView {
+	glm::mat4 projectionMatrix;
+	glm::mat4 viewMatrix;
+	glm::vec3 position;
+
+	float FOV;
+	float screenWidth;
+	float screenHeight;
+	float nearClippingPlane;
+	float farClippingPlane;
+};
 
 class Camera : public Entity {
 
@@ -49,6 +61,11 @@ public:
 	/** Update the view and projection matrices using the current FOV, aspect ratio and clipping planes. */
 	void updateMatrices();
 
+	/** Returns a copy of the current matrices and projection settings. */
+	CameraView getView() const;
+	/** Returns the view matrix of a camera at a position and rotation. */
+	static glm::mat4 getViewMatrix(const glm::vec3& position, const glm::quat& rotation);
+
 	/** Rotate the camera right by delta. */
 	void lookRight(float deltaDegrees);
 	/** Rotate the camera up by delta, clamping at maxPitch. */
@@ -2,7 +2,10 @@
 
 #include "Transform.h"
 #include "Graphics/Model.h"
+#include "Scene/AABB.h"
+#include "Components/ComponentRegistry.h"
 #include <memory>
+#include <atomic>
 
 
 class EntityComponent;
@@ -12,17 +15,25 @@ class Entity : public ITransform {
 
 public:
 	typedef std::shared_ptr<Entity> EntityPtr;
-	typedef std::shared_ptr<EntityComponent> ComponentPtr;
 
 	Model model;
 
 protected:
-	//std::vector<EntityComponent*> components;
-	std::vector<ComponentPtr> components;
+	// Components owned by this entity, indexed by component type ID (see ComponentRegistry). Null where there is none.
+	std::vector<EntityComponent*> components;
 
 private:
 	// World instance this entity is in.
 	class World* world;
+	// Whether the entity is waiting for the world to update its scene bounds.
+	bool boundsDirty = false;
+	// Level of detail each mesh of the model was last drawn at. See LODSelector.
+	std::vector<uint8_t> meshLODs;
+
+	// Next ID to give out. 0 is reserved for no entity. Entities are created on the GL and simulation threads.
+	static std::atomic<GLuint> nextId;
+	// Unique ID of this entity, written to the selection buffer.
+	GLuint id = nextId++;
 
 public:
 	Entity(World* world);
@@ -30,33 +41,65 @@ public:
 	Entity(World* world, GLchar* path, Model::ImportSettings importSettings = Model::ImportSettings());
 	Entity(World* world, Model model);
 
+	/** Copies get a new ID and no components. */
+	Entity(const Entity& other);
+	Entity& operator=(const Entity& other);
+
 	~Entity();	
 
 	virtual void update(float deltaTime);
-	virtual void render(GLuint shaderProgram);
+	virtual void render(const ShaderProgram& shader);
+
+	/** Returns the radius of the entity's bounding sphere in world space, centred on its world position. */
+	float getBoundingRadius();
+	/** Replaces the entity's model, e.g. once a model loaded in the background is ready. */
+	void setModel(const Model& model);
+
+	/**
+	* Attaches the entity to a parent. Its position, rotation and scale are then relative to the parent, so it moves with it.
+	* Parameter: Entity* parent  Entity to attach to.
+	* Parameter: bool keepWorldTransform  Whether to stay where it is in the world, rather than keep its values and move to be relative to the parent.
+	* Returns: bool  False if the parent is this entity or is attached below it.
+	*/
+	bool attachTo(Entity* parent, bool keepWorldTransform = true);
+	/** Detaches the entity from its parent, by default staying where it is in the world. */
+	void detach(bool keepWorldTransform = true);
+	/** Returns the entity this one is attached to, or null. Entities are only attached to entities. */
+	inline Entity* getParent() const { return static_cast<Entity*>(getParentTransform()); };
+
+	/** Returns the level of detail each mesh of the model was last drawn at, one per mesh. */
+	std::vector<uint8_t>& getMeshLODs();
 
-	/** Adds a component to be owned by this entity. */
+	/** Adds a component to be owned by this entity. An entity has one component of each type, so an existing one is returned. */
 	template<typename T>
 	inline T* addComponent() {
-		components.emplace_back(new T(this));
-		return dynamic_cast<T*>(components.back().get());
+		size_t type = ComponentRegistry::getTypeId<T>();
+		if (components.size() <= type) components.resize(type + 1, nullptr);
+		if (!components[type]) components[type] = ComponentRegistry::add<T>(this);
+		return static_cast<T*>(components[type]);
 	}
 
 
 	/**
 	* Returns the component of the specified type attached to this entity, or null if one doesn't exist.
+	* Only matches the exact type, not components derived from it.
 	*/
 	template<typename T>
 	inline T* getComponent() {
-		for (auto component : components) {
-			// If the cast is not null, the component is of type T.
-			T* castComponent = dynamic_cast<T*>(component.get());
-			if (castComponent) return castComponent;
-		}
-		// Component not found, return null.
-		return nullptr;
+		size_t type = ComponentRegistry::getTypeId<T>();
+		return (type < components.size()) ? static_cast<T*>(components[type]) : nullptr;
 	}
 
 	inline World* getWorld() { return world; };
+	inline GLuint getId() const { return id; };
+
+	/** Returns the world space bounding box of the entity's bounding sphere. */
+	AABB getBounds();
+	/** Called by the world once the scene bounds have been updated. */
+	inline void clearBoundsDirty() { boundsDirty = false; };
+
+protected:
+	/** Queues the entity's scene bounds to be updated. */
+	void onTransformUpdated() override;
 };
 
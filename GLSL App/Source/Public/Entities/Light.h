@@ -10,6 +10,7 @@ public:
 	glm::vec3 ambient; // ambient intensity
 	glm::vec3 diffuse; // diffuse intensity
 	glm::vec3 specular; // specular intensity
+	float radius = 50; // Distance at which the light's contribution falls to 0.
 
 public:
 	Light(World* world);
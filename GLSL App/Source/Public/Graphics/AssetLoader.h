@@ -0,0 +1,140 @@
+#pragma once
+#include "glew.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Graphics/Model.h"
+
+/**
+* Loads models in the background.
+* A pool of worker threads reads and imports model files (see Model::import()) and decodes their textures. Each
+* worker keeps its own Assimp importer, so any number of models import at once.
+* Finished models wait in a bounded upload queue, and the GL thread creates their textures and buffers in
+* update(), a piece at a time, until the per-frame upload budget is used up. Workers stop taking new requests
+* while the models importing and waiting to be uploaded fill the upload queue, so decoded data doesn't pile up
+* faster than it can be uploaded.
+* Every request's callback is fired, including those that fail to load, so callers can tell a failure from a model
+* that is still loading.
+*/
+class AssetLoader {
+
+public:
+	/** Called on the GL thread once a model is ready, or has failed to load, in which case success is false and the model is empty. */
+	typedef std::function<void(bool success, const Model& model)> LoadedCallback;
+
+	/** Progress and timing counters. Times are totals in milliseconds. */
+	struct Stats {
+		unsigned int requested = 0;
+		unsigned int completed = 0;
+		unsigned int failed = 0;
+		// Requests waiting for a worker, being loaded and waiting to be uploaded.
+		unsigned int queued = 0;
+		unsigned int loading = 0;
+		unsigned int waitingForUpload = 0;
+		unsigned int texturesDecoded = 0;
+
+		// Model::import() on the workers, including reading the mesh cache or running Assimp.
+		double importMs = 0;
+		// Texture decoding on the workers.
+		double decodeMs = 0;
+		// Texture and buffer creation on the GL thread.
+		double uploadMs = 0;
+		// Upload time in the last update().
+		double lastUpdateMs = 0;
+	};
+
+	/** Maximum number of models importing and waiting to be uploaded together, which also limits the imports running at once. */
+	size_t maxPendingUploads = 4;
+	/** Time the GL thread may spend uploading per update(), in milliseconds. At least one upload is always made. */
+	double uploadBudgetMs = 4;
+
+protected:
+	/** A texture decoded on a worker. */
+	struct DecodedTexture {
+		std::string path;
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+	};
+
+	struct Request {
+		std::string path;
+		Model::ImportSettings importSettings;
+		LoadedCallback callback;
+		bool success = false;
+
+		// Loaded on a worker.
+		ModelData data;
+		std::vector<DecodedTexture> textures;
+
+		// Upload progress on the GL thread.
+		size_t texturesUploaded = 0;
+		size_t meshesCreated = 0;
+		Model model;
+	};
+	typedef std::unique_ptr<Request> RequestPtr;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	// Signalled when a request is added, the upload queue has space or the loader is stopping.
+	std::condition_variable workAvailable;
+	// Signalled when a loaded request is added to the upload queue.
+	std::condition_variable uploadReady;
+	bool stopping = false;
+
+	std::deque<RequestPtr> loadQueue;
+	std::deque<RequestPtr> uploadQueue;
+	// Request being uploaded. Only used on the GL thread.
+	RequestPtr currentUpload;
+
+	// Guarded by mutex.
+	Stats stats;
+
+public:
+	AssetLoader();
+	~AssetLoader();
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	/**
+	* Starts the worker threads.
+	* Parameter: unsigned int numThreads  Number of workers. 0 uses one less than the number of hardware threads.
+	*/
+	void start(unsigned int numThreads = 0);
+	/** Stops the workers once their current request is done. Queued requests are discarded. */
+	void stop();
+
+	/**
+	* Queues a model to be loaded.
+	* Parameter: const std::string& path  Path to the model file.
+	* Parameter: const Model::ImportSettings& importSettings  Settings to import with.
+	* Parameter: LoadedCallback callback  Called on the GL thread from update() once the model is ready.
+	*/
+	void load(const std::string& path, const Model::ImportSettings& importSettings, LoadedCallback callback);
+
+	/** Uploads loaded models until the budget is used up, firing the callbacks of any that finish. Call on the GL thread. */
+	void update();
+	/**
+	* Blocks until every queued model has loaded, uploading each as soon as its worker finishes and firing its callback.
+	* Used to load a batch of models up front, e.g. at startup. Call on the GL thread.
+	*/
+	void flush();
+
+	/** Returns a copy of the counters. */
+	Stats getStats();
+	/** Returns the fraction of requested models that have finished loading, 1 if nothing is loading. */
+	float getProgress();
+
+protected:
+	void workerLoop();
+	/** Imports the model with the worker's importer and decodes its textures. */
+	void loadRequest(Request& request, Assimp::Importer& importer);
+	/** Makes the next step of uploading the current request. Returns true when it is complete. */
+	bool uploadStep(Request& request);
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <vector>
+#include <cstdint>
+
+/**
+* Bounding spheres stored as separate arrays (structure of arrays), so the cull loop reads each component
+* contiguously and can be vectorised by the compiler.
+*/
+struct BoundingSphereArray {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+
+	inline void clear() { x.clear(); y.clear(); z.clear(); radius.clear(); };
+	inline size_t size() const { return x.size(); };
+
+	inline void add(const glm::vec3& centre, float sphereRadius) {
+		x.push_back(centre.x);
+		y.push_back(centre.y);
+		z.push_back(centre.z);
+		radius.push_back(sphereRadius);
+	}
+};
+
+/**
+* The six planes of a view frustum, extracted from a view-projection matrix.
+* Planes face inwards and are normalised, so the plane equation gives the signed distance to a point.
+*/
+class Frustum {
+
+public:
+	enum EPlane {
+		PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, NUM_PLANES
+	};
+
+	/** Spheres tested per block. Keeps a block's arrays in cache while every plane is tested against it. */
+	static constexpr size_t CULL_BLOCK_SIZE = 256;
+
+protected:
+	// xyz = normal, w = distance.
+	glm::vec4 planes[NUM_PLANES];
+
+public:
+	Frustum();
+	/** Parameter: const glm::mat4& viewProjection  Projection * view matrix to extract the planes from. */
+	Frustum(const glm::mat4& viewProjection);
+
+	/** Returns true if the sphere is at least partially inside the frustum. */
+	bool testSphere(const glm::vec3& centre, float radius) const;
+
+	/**
+	* Tests every sphere against the frustum.
+	* Parameter: const BoundingSphereArray& spheres  Spheres to test.
+	* Parameter: std::vector<uint8_t>& visible  Filled with 1 for each sphere at least partially inside, 0 otherwise.
+	* Returns: size_t  Number of visible spheres.
+	*/
+	size_t cullSpheres(const BoundingSphereArray& spheres, std::vector<uint8_t>& visible) const;
+
+	inline const glm::vec4& getPlane(EPlane plane) const { return planes[plane]; };
+};
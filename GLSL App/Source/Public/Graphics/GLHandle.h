@@ -0,0 +1,144 @@
+#pragma once
+#include "glew.h"
+#include <utility>
+#include "Graphics/RenderState.h"
+
+/**
+* Counts of the live GL objects created through GLHandle, by type, for finding leaks.
+* Everything is expected to have been destroyed by the time report() is called at shutdown.
+*/
+class GLObjects {
+
+public:
+	enum EType {
+		BUFFER = 0,
+		VERTEX_ARRAY,
+		TEXTURE,
+		PROGRAM,
+		SHADER,
+		FRAMEBUFFER,
+		RENDERBUFFER,
+		NUM_TYPES
+	};
+
+protected:
+	static int live[NUM_TYPES];
+	static int peak[NUM_TYPES];
+
+public:
+	static void onCreated(EType type);
+	static void onDestroyed(EType type);
+	inline static int getLive(EType type) { return live[type]; };
+	static const char* getTypeName(EType type);
+
+	/** Writes the objects still alive to the console. Returns the total. */
+	static int report();
+};
+
+/**
+* Owner of a single GL object name, deleted when the owner is destroyed.
+* Handles can be moved but not copied, so there is always exactly one owner. A handle converts to its GLuint,
+* so it can be passed straight to GL calls. The GL context must be current when a handle is created, reset or
+* destroyed. Deleting a program, vertex array or texture invalidates the RenderState cache, since GL can hand the
+* same name out again.
+*/
+template<typename Traits>
+class GLHandle {
+
+protected:
+	GLuint name = 0;
+
+public:
+	GLHandle() {}
+	/** Takes ownership of a name created elsewhere, e.g. by SOIL. */
+	explicit GLHandle(GLuint name) { reset(name); }
+	~GLHandle() { reset(); }
+
+	// Moving hands the name over without changing the live counts.
+	GLHandle(GLHandle&& other) { std::swap(name, other.name); }
+	GLHandle& operator=(GLHandle&& other) {
+		if (this != &other) {
+			reset();
+			std::swap(name, other.name);
+		}
+		return *this;
+	}
+	GLHandle(const GLHandle&) = delete;
+	GLHandle& operator=(const GLHandle&) = delete;
+
+	/** Creates a new object of the handle's type. */
+	static GLHandle create() { return GLHandle(Traits::create()); }
+
+	/** Deletes the owned object, if any, and takes ownership of another. */
+	void reset(GLuint newName = 0) {
+		if (name == newName) return;
+		if (name) {
+			Traits::destroy(name);
+			GLObjects::onDestroyed(Traits::TYPE);
+		}
+		name = newName;
+		if (name) GLObjects::onCreated(Traits::TYPE);
+	}
+
+	/** Gives up ownership without deleting the object. */
+	GLuint release() {
+		GLuint released = name;
+		if (name) GLObjects::onDestroyed(Traits::TYPE);
+		name = 0;
+		return released;
+	}
+
+	inline GLuint get() const { return name; };
+	inline operator GLuint() const { return name; };
+};
+
+struct GLBufferTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::BUFFER;
+	static GLuint create() { GLuint name; glGenBuffers(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+struct GLVertexArrayTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::VERTEX_ARRAY;
+	static GLuint create() { GLuint name; glGenVertexArrays(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); RenderState::invalidate(); }
+};
+struct GLTextureTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::TEXTURE;
+	static GLuint create() { GLuint name; glGenTextures(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteTextures(1, &name); RenderState::invalidate(); }
+};
+struct GLProgramTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::PROGRAM;
+	static GLuint create() { return glCreateProgram(); }
+	static void destroy(GLuint name) { glDeleteProgram(name); RenderState::invalidate(); }
+};
+struct GLFramebufferTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::FRAMEBUFFER;
+	static GLuint create() { GLuint name; glGenFramebuffers(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+struct GLRenderbufferTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::RENDERBUFFER;
+	static GLuint create() { GLuint name; glGenRenderbuffers(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteRenderbuffers(1, &name); }
+};
+
+typedef GLHandle<GLBufferTraits> GLBuffer;
+typedef GLHandle<GLVertexArrayTraits> GLVertexArray;
+typedef GLHandle<GLTextureTraits> GLTexture;
+typedef GLHandle<GLProgramTraits> GLProgram;
+typedef GLHandle<GLFramebufferTraits> GLFramebuffer;
+typedef GLHandle<GLRenderbufferTraits> GLRenderbuffer;
+
+/** Shaders take their stage when created, so are created with GLShader::create(type) rather than through traits alone. */
+struct GLShaderTraits {
+	static constexpr GLObjects::EType TYPE = GLObjects::SHADER;
+	static void destroy(GLuint name) { glDeleteShader(name); }
+};
+class GLShader : public GLHandle<GLShaderTraits> {
+public:
+	GLShader() {}
+	explicit GLShader(GLuint name) : GLHandle<GLShaderTraits>(name) {}
+	/** Creates a shader of a stage, e.g. GL_VERTEX_SHADER. */
+	static GLShader create(GLenum type) { return GLShader(glCreateShader(type)); }
+};
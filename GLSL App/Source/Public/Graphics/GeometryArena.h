@@ -0,0 +1,127 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include "Utils/RangeAllocator.h"
+#include "Graphics/GLHandle.h"
+#include <vector>
+
+struct Vertex;
+struct PackedVertex;
+
+/**
+* Shared storage for the geometry of every mesh.
+* All vertices of each vertex format are kept in one vertex buffer and all indices in one index buffer, with
+* ranges of each handed out by a free-list allocator. A single vertex array describes each format, so meshes are
+* drawn without changing vertex arrays, and many meshes can be drawn in one multi-draw call (see RenderQueue).
+* Indices are stored relative to their mesh's first vertex, so draws pass it as the base vertex.
+*
+* The buffers double in size when they run out of space. Ranges keep their offsets when they do.
+*/
+class GeometryArena {
+
+public:
+	/** Initial capacity of the buffers, in vertices and indices. */
+	static constexpr uint32_t INITIAL_VERTICES = 1 << 20;
+	static constexpr uint32_t INITIAL_INDICES = 1 << 22;
+
+	/** How vertices are stored on the GPU. */
+	enum EVertexFormat {
+		// Vertex as-is, 44 bytes.
+		FULL_VERTEX = 0,
+		// PackedVertex, 20 bytes. Positions must be dequantised with the range's positionOffset and positionScale.
+		PACKED_VERTEX = 1,
+		NUM_VERTEX_FORMATS
+	};
+
+	/** Geometry of a mesh in the arena. */
+	struct Range {
+		EVertexFormat format = FULL_VERTEX;
+		GLuint firstVertex = 0;
+		GLuint vertexCount = 0;
+		GLuint firstIndex = 0;
+		GLuint indexCount = 0;
+		// Stored position * positionScale + positionOffset gives the mesh position. Identity for full vertices.
+		glm::vec3 positionOffset = glm::vec3(0);
+		glm::vec3 positionScale = glm::vec3(1);
+	};
+
+	/** Usage of the buffers. */
+	struct Stats {
+		// Size and used part of the vertex buffers of every format, in bytes.
+		size_t vertexBytes = 0;
+		size_t vertexBytesUsed = 0;
+		uint32_t indexCapacity = 0;
+		uint32_t indicesUsed = 0;
+		// Number of separate free blocks in all buffers. Grows as the arena fragments.
+		size_t freeBlocks = 0;
+		unsigned int grows = 0;
+	};
+
+protected:
+	// Vertex array and vertex buffer of each format. The index buffer is shared.
+	static GLVertexArray vertexArrays[NUM_VERTEX_FORMATS];
+	static GLBuffer vertexBuffers[NUM_VERTEX_FORMATS];
+	static GLBuffer indexBuffer;
+	// Per-instance model matrices, used when they can't be streamed through the StagingBuffer.
+	static GLBuffer instanceBuffer;
+	static GLsizei instanceCapacity;
+
+	// Created in init() and never destroyed, so meshes freed during shutdown don't depend on static destruction order.
+	static RangeAllocator* vertexAllocators[NUM_VERTEX_FORMATS];
+	static RangeAllocator* indexAllocator;
+	static unsigned int grows;
+
+public:
+	/** Creates the buffers and vertex array. Must be done after the OpenGL context and the StagingBuffer are created. */
+	static void init();
+	/** Deletes the buffers and vertex arrays. Must be done before the OpenGL context is destroyed. Meshes can still be freed afterwards. */
+	static void shutdown();
+
+	/**
+	* Copies a mesh's geometry into the arena.
+	* Parameter: const Vertex* vertices  Vertex array.
+	* Parameter: GLuint vertexCount  Number of vertices.
+	* Parameter: const GLuint* indices  Triangle indices into the vertex array.
+	* Parameter: GLuint indexCount  Number of indices.
+	* Parameter: EVertexFormat format  Format to store the vertices in. They are converted if needed.
+	* Returns: Range  Where the geometry was placed.
+	*/
+	static Range allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, EVertexFormat format = FULL_VERTEX);
+	/** Returns a range to the free space. */
+	static void free(const Range& range);
+
+	/**
+	* Reads a range's vertex positions back from the GPU, dequantised if packed. Stalls until pending writes finish.
+	* Parameter: const Range& range  Geometry to read.
+	* Parameter: std::vector<glm::vec3>& positions  Receives a position for each vertex.
+	*/
+	static void readPositions(const Range& range, std::vector<glm::vec3>& positions);
+	/**
+	* Reads indices back from the GPU. Stalls until pending writes finish.
+	* Parameter: GLuint firstIndex  First index in the arena.
+	* Parameter: GLuint count  Number of indices.
+	* Parameter: std::vector<GLuint>& indices  Receives the indices, relative to their range's first vertex.
+	*/
+	static void readIndices(GLuint firstIndex, GLuint count, std::vector<GLuint>& indices);
+
+	/**
+	* Makes per-instance model matrices available to the instance attributes.
+	* Streamed through the StagingBuffer if possible, otherwise uploaded to the arena's own instance buffer, so the
+	* matrices are only valid until the next call.
+	* Returns: GLuint  Base instance to draw with to read the first matrix.
+	*/
+	static GLuint writeInstances(const glm::mat4* transforms, GLsizei count);
+
+	inline static GLuint getVertexArray(EVertexFormat format) { return vertexArrays[format]; };
+	/** Size in bytes of a vertex stored in a format. */
+	static GLsizeiptr getVertexSize(EVertexFormat format);
+	/** Whether meshes can be drawn with glMultiDrawElementsIndirect and per-draw data indexed by gl_DrawIDARB. */
+	static bool supportsMultiDraw();
+	static Stats getStats();
+
+protected:
+	/** Points a format's vertex array at the current buffers. */
+	static void setupVertexArray(EVertexFormat format);
+	/** Allocates a range of a buffer, growing the buffer if there isn't room. */
+	static uint32_t allocateRange(RangeAllocator& allocator, GLBuffer& buffer, GLsizeiptr elementSize, uint32_t count);
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include <cstdint>
+
+class Mesh;
+struct CameraView;
+
+/**
+* Chooses the level of detail to draw each mesh at from its size on screen.
+* The projected radius of the mesh's bounding sphere scales each level's simplification error (see MeshLOD) into
+* pixels, and the coarsest level within maxScreenError is drawn. A level only changes once its error is a
+* hysteresis fraction past the limit, so meshes near a switching distance don't flicker between levels.
+*/
+class LODSelector {
+
+public:
+	/** Largest simplification error to allow on screen, in pixels. */
+	float maxScreenError = 1.f;
+	/** Fraction either side of maxScreenError an error has to pass before the level changes. */
+	float hysteresis = 0.25f;
+	/** When disabled every mesh is drawn at full detail. */
+	bool enabled = true;
+
+protected:
+	glm::vec3 viewPosition;
+	// Pixels covered by one unit at a distance of one unit from the camera.
+	float pixelsPerUnit = 0;
+	float nearPlane = 0;
+
+public:
+	LODSelector();
+
+	/** Reads the camera position and projection. Call once per frame before selecting. */
+	void beginFrame(const CameraView& camera);
+
+	/**
+	* Returns the level of detail to draw a mesh at.
+	* Parameter: const Mesh& mesh  Mesh to draw.
+	* Parameter: const glm::vec3& centre  World position of the mesh's bounds centre (see Mesh::getBoundsCentre()).
+	* Parameter: float scale  Largest scale axis of the mesh's transform.
+	* Parameter: uint8_t& level  Level the mesh was last drawn at. Updated to the selected level.
+	*/
+	GLuint select(const Mesh& mesh, const glm::vec3& centre, float scale, uint8_t& level) const;
+};
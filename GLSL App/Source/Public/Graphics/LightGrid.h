@@ -0,0 +1,113 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include "Entities/Light.h"
+#include "Graphics/UniformBuffer.h"
+
+struct CameraView;
+
+/**
+* Clustered forward lighting.
+* The view frustum is split into a grid of clusters (screen tiles x exponential depth slices) built from the
+* camera projection. Each frame every light is binned into the clusters its sphere of influence touches, and the
+* fragment shader then only iterates the lights listed for its own cluster.
+*
+* Lights, cluster ranges and the light index list are stored in shader storage buffers. The grid dimensions
+* and depth slicing parameters are in the shared LightBlock uniform block.
+*/
+class LightGrid {
+
+public:
+	/** Number of clusters along each axis. Z is the number of depth slices. */
+	static constexpr int GRID_X = 16;
+	static constexpr int GRID_Y = 9;
+	static constexpr int GRID_Z = 24;
+	static constexpr int NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+
+	/** Shader storage binding points. Must match the bindings in ObjectFragment.glsl. */
+	enum EStorageBinding {
+		LIGHTS_BINDING = 0,
+		CLUSTERS_BINDING = 1,
+		LIGHT_INDICES_BINDING = 2
+	};
+
+	/** A light as stored in the light buffer (std430). */
+	struct GPULight {
+		// xyz = world position, w = radius.
+		glm::vec4 positionRadius;
+		glm::vec4 ambient;
+		glm::vec4 diffuse;
+		glm::vec4 specular;
+	};
+
+	/** A light and its world position for the frame, which may differ from the light's own, see World::render(). */
+	struct LightInstance {
+		const Light* light;
+		glm::vec3 position;
+	};
+
+	/** Range of the light index list used by a cluster. */
+	struct Cluster {
+		GLuint offset;
+		GLuint count;
+	};
+
+protected:
+	/** View-space bounding box of a cluster. */
+	struct ClusterBounds {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	/** A light touching a cluster, produced when binning. */
+	struct ClusterLight {
+		GLuint cluster;
+		GLuint light;
+	};
+
+	// Storage buffers.
+	GLBuffer lightBuffer;
+	GLBuffer clusterBuffer;
+	GLBuffer lightIndexBuffer;
+	// Grid parameters.
+	UniformBuffer lightBlockBuffer;
+	LightBlock lightBlock;
+
+	// Projection the cluster bounds were built with.
+	glm::mat4 clusterProjection;
+	float clusterNear = 0;
+	float clusterFar = 0;
+	std::vector<ClusterBounds> clusterBounds;
+
+	// Per-frame CPU data, kept between frames to avoid reallocating.
+	std::vector<GPULight> gpuLights;
+	std::vector<Cluster> clusters;
+	std::vector<GLuint> lightIndices;
+	std::vector<ClusterLight> clusterLights;
+
+public:
+	LightGrid();
+
+	/** Creates the GPU buffers. Must be done after the OpenGL context is created. */
+	void init();
+
+	/**
+	* Bins every light into the clusters of the camera's frustum and uploads the result.
+	* Parameter: const CameraView& camera  View being rendered.
+	* Parameter: const std::vector<LightInstance>& lights  Lights in the world.
+	*/
+	void update(const CameraView& camera, const std::vector<LightInstance>& lights);
+
+	/** Total number of light references across all clusters in the last update. */
+	inline size_t getNumLightIndices() const { return lightIndices.size(); };
+
+protected:
+	/** Rebuilds the view-space bounds of every cluster for the current projection. */
+	void buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+	/** Returns the depth slice a view-space depth (positive distance from the camera) falls in. */
+	int getDepthSlice(float depth) const;
+
+	/** Binds data to a storage binding point. Streamed through the StagingBuffer if possible, otherwise uploaded to the buffer, reallocating it if necessary. */
+	static void uploadStorage(GLuint buffer, GLuint binding, const void* data, size_t size);
+};
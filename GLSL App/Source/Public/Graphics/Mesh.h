@@ -2,7 +2,13 @@
 #include "glew.h"
 #include "glm/glm.hpp"
 #include <vector>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <assimp/types.h>
+#include "Graphics/ShaderProgram.h"
+#include "Graphics/TextureManager.h"
+#include "Graphics/GeometryArena.h"
 
 
 /**
@@ -27,10 +33,29 @@ struct Vertex {
 	}
 };
 
+/**
+* Compact vertex layout, stored on the GPU for meshes imported with ImportSettings::compactVertices.
+* Positions are quantised within the mesh bounds, see GeometryArena::Range. 20 bytes, against 44 for Vertex.
+*/
+struct PackedVertex {
+	// xyz = position, unsigned normalised within the mesh bounds. w is padding.
+	uint16_t position[4];
+	// Normal and tangent, signed normalised 10_10_10_2.
+	uint32_t normal;
+	uint32_t tangent;
+	// Texture coordinates, two half floats.
+	uint32_t texCoords;
+};
+
 struct Material {
 	glm::vec3 diffuse = glm::vec3(1); // Diffuse colour.
 	glm::vec3 specular = glm::vec3(1); // Specular colour.
 	float shininess = 12; // How shiny the object is.
+
+	inline bool operator==(const Material& other) const {
+		return diffuse == other.diffuse && specular == other.specular && shininess == other.shininess;
+	}
+	inline bool operator!=(const Material& other) const { return !(*this == other); };
 };
 
 struct Texture {
@@ -38,14 +63,98 @@ struct Texture {
 	const char* type;
 	aiString path;
 	unsigned char* data;
+	// Keeps the shared texture loaded while the mesh uses it.
+	TextureManager::TexturePtr handle;
+};
+
+/** A material map referenced by a mesh, before it is loaded. */
+struct TextureRef {
+	// One of ShaderLoader::Vars::MAT_*
+	const char* type;
+	// Path relative to the model directory.
+	std::string path;
+};
+
+/**
+* A level of detail of a mesh: a range of its index array, drawn with the same vertices as full detail.
+* See MeshSimplifier.
+*/
+struct MeshLOD {
+	GLuint firstIndex = 0;
+	GLuint indexCount = 0;
+	// Simplification error relative to the mesh's bounding radius. 0 at full detail.
+	float error = 0;
+};
+
+/** Which of a mesh's arrays are kept in host memory once it has been uploaded to the GeometryArena. */
+enum EGeometryResidency {
+	// Nothing is kept. Readers that need geometry later read it back from the GPU, see Mesh::getCollisionGeometry().
+	RELEASE_GEOMETRY = 0,
+	// Positions and full detail indices, e.g. for CPU picking or physics.
+	KEEP_COLLISION_GEOMETRY = 1,
+	// Every vertex attribute as well, e.g. for editing.
+	KEEP_ALL_GEOMETRY = 2
+};
+
+/**
+* Mesh arrays and material references loaded on the CPU, before any GL objects are created.
+* The arrays are either owned through the storage vectors or point into memory owned elsewhere, e.g. a mapped
+* MeshCache file. Moving keeps the pointers valid, copying doesn't, so it can only be moved.
+*/
+struct MeshData {
+	const Vertex* vertices = nullptr;
+	GLuint vertexCount = 0;
+	const GLuint* indices = nullptr;
+	GLuint indexCount = 0;
+	float boundingRadius = 0;
+	std::vector<TextureRef> textures;
+	// Levels of detail, as ranges of the index array. Empty if the whole array is the only level.
+	std::vector<MeshLOD> lods;
+	// Format to store the vertices in on the GPU.
+	GeometryArena::EVertexFormat vertexFormat = GeometryArena::FULL_VERTEX;
+	// Arrays the mesh keeps once it's uploaded.
+	EGeometryResidency residency = RELEASE_GEOMETRY;
+
+	// Owned arrays. Empty if the arrays are owned elsewhere.
+	std::vector<Vertex> vertexStorage;
+	std::vector<GLuint> indexStorage;
+
+	MeshData() {}
+	MeshData(MeshData&&) = default;
+	MeshData& operator=(MeshData&&) = default;
+	MeshData(const MeshData&) = delete;
+	MeshData& operator=(const MeshData&) = delete;
+
+	/** Takes ownership of the arrays and points at them. */
+	inline void setStorage(std::vector<Vertex>&& newVertices, std::vector<GLuint>&& newIndices) {
+		vertexStorage = std::move(newVertices);
+		indexStorage = std::move(newIndices);
+		vertices = vertexStorage.data();
+		vertexCount = (GLuint)vertexStorage.size();
+		indices = indexStorage.data();
+		indexCount = (GLuint)indexStorage.size();
+	}
 };
 
 class Mesh {
 public:
-	// Vertices that may have been rotated.
-	std::vector<Vertex> vertices;
-	// Array of vertex indices that make up each triangle.
-	std::vector<GLuint> triangleElements;
+	/** Meshes are shared between models (and so entities) by reference. */
+	typedef std::shared_ptr<Mesh> MeshPtr;
+
+	/** First vertex attribute location of the per-instance model matrix. Uses 4 consecutive locations. */
+	static constexpr GLuint INSTANCE_MATRIX_ATTRIBUTE = 4;
+
+	/** Geometry kept in host memory after upload. Which arrays are filled depends on the residency. */
+	struct CPUGeometry {
+		// Position of every vertex.
+		std::vector<glm::vec3> positions;
+		// Indices of the full detail triangles.
+		std::vector<GLuint> indices;
+		// Every vertex attribute. Only kept with KEEP_ALL_GEOMETRY.
+		std::vector<Vertex> vertices;
+	};
+
+	// Textures. Use addTexture() to add more so the texture set ID stays up to date.
 	std::vector<Texture> textures;
 	// Diffuse and specular maps take priority over material diffuse and specular settings.
 	Material material;
@@ -53,19 +162,104 @@ public:
 	float boundingRadius;
 
 protected:
-	// Vertex Array, Vertex Buffer and Element Buffer.
-	GLuint VAO, VBO, EBO;
-	// Orginal vertices before any rotation.
-	std::vector<Vertex> originVertices;
+	/** Geometry of a mesh, shared by its copies. Freed from the arena once the last of them is destroyed. */
+	struct SharedGeometry {
+		// Vertices and indices of every level of detail in the shared GeometryArena.
+		GeometryArena::Range range;
+		// Levels of detail, starting with full detail. Index ranges are relative to the range's first index.
+		std::vector<MeshLOD> lods;
+		// Arrays kept in host memory, and which are currently kept.
+		CPUGeometry cpuGeometry;
+		EGeometryResidency residency = RELEASE_GEOMETRY;
+		// Centre of the vertices' bounding box and the distance from it to the furthest vertex, in model space.
+		glm::vec3 boundsCentre;
+		float boundsRadius = 0;
+
+		~SharedGeometry();
+	};
+	std::shared_ptr<SharedGeometry> geometry;
+
+	// Set shared by every mesh with the same textures, for sorting draws. See addTexture().
+	TextureManager::TextureSetPtr textureSet;
 
 public:
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, float boundingRadius);
-	~Mesh();
+	/**
+	* Creates a mesh from arrays it takes ownership of. They are freed once uploaded unless the residency keeps them.
+	* Parameter: std::vector<MeshLOD> lods  Levels of detail in the index array. If empty, the whole array is full detail.
+	*/
+	Mesh(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, std::vector<Texture> textures, float boundingRadius,
+		std::vector<MeshLOD> lods = std::vector<MeshLOD>(), EGeometryResidency residency = RELEASE_GEOMETRY);
+	/**
+	* Creates a mesh from imported data. The GPU buffers are filled directly from its arrays, which may be in a mapped
+	* MeshCache file. Owned arrays the residency keeps are moved rather than copied.
+	* Parameter: MeshData&& data  Imported mesh, including its levels of detail, vertex format and residency.
+	* Parameter: std::vector<Texture> textures  Loaded material maps.
+	*/
+	Mesh(MeshData&& data, std::vector<Texture> textures);
+	/** Copies share the geometry but have their own textures and material, e.g. for one model to change its material. */
+	Mesh(const Mesh&) = default;
+	Mesh& operator=(const Mesh&) = delete;
+
+	/** Renders a single copy of the mesh using the shader's model matrix uniform. */
+	void render(const ShaderProgram& shader);
+
+	/**
+	* Renders a copy of the mesh for every transform in a single instanced draw call.
+	* The shader reads the model matrix from the INSTANCE_MATRIX_ATTRIBUTE attribute.
+	* Parameter: const ShaderProgram& shader  Shader to render with. Must be in use.
+	* Parameter: const glm::mat4* transforms  Model matrix for each instance.
+	* Parameter: GLsizei count  Number of instances.
+	*/
+	void renderInstanced(const ShaderProgram& shader, const glm::mat4* transforms, GLsizei count);
+
+	/**
+	* Binds textures and sets the material uniforms. Material maps the mesh doesn't have are pointed at a
+	* white texture, so the material colours are used as-is.
+	*/
+	void bindMaterial(const ShaderProgram& shader);
+	/** Sets the shader's position dequantisation uniforms for the mesh's vertex format. */
+	void bindGeometry(const ShaderProgram& shader);
+	/** Draws the mesh at a level of detail with the currently bound material. */
+	void draw(const ShaderProgram& shader, GLuint lod = 0);
+	/** Draws a copy of the mesh at a level of detail for every transform with the currently bound material. */
+	void drawInstanced(const ShaderProgram& shader, const glm::mat4* transforms, GLsizei count, GLuint lod = 0);
+
+	/** Adds a texture to the mesh. */
+	void addTexture(const Texture& texture);
 
-	void render(GLuint shaderProgram);
+	/**
+	* Returns the positions and full detail indices, e.g. for CPU picking or physics.
+	* If they weren't kept after upload, they're read back from the GeometryArena and kept from then on. That stalls
+	* until the GPU catches up, so meshes that are read regularly should be imported with KEEP_COLLISION_GEOMETRY.
+	*/
+	const CPUGeometry& getCollisionGeometry();
+	/** Returns the geometry kept in host memory, without reading anything back. */
+	inline const CPUGeometry& getCPUGeometry() const { return geometry->cpuGeometry; };
+	inline EGeometryResidency getResidency() const { return geometry->residency; };
+	/** Frees the host copies of the geometry, e.g. once a reader no longer needs them. */
+	void releaseCPUGeometry();
 
 	inline bool hasTextures() { return textures.size() > 0; };
+	inline const GeometryArena::Range& getGeometry() const { return geometry->range; };
+	/** Returns the geometry of one level of detail. Its index range covers only that level. */
+	GeometryArena::Range getLODGeometry(GLuint lod) const;
+	inline GLuint getLODCount() const { return (GLuint)geometry->lods.size(); };
+	inline const MeshLOD& getLOD(GLuint lod) const { return geometry->lods[lod]; };
+	/** Returns the centre of the mesh's bounding sphere in model space. Unlike boundingRadius it needn't be the origin. */
+	inline const glm::vec3& getBoundsCentre() const { return geometry->boundsCentre; };
+	/** Returns the radius of the bounding sphere around getBoundsCentre(). */
+	inline float getBoundsRadius() const { return geometry->boundsRadius; };
+	inline GLuint getTextureSetId() const { return textureSet ? textureSet->id : 0; };
+	/** Whether a mesh can be drawn in the same instanced draw: a copy of the same geometry with the same textures and material. */
+	inline bool isSameDraw(const Mesh& other) const {
+		return geometry == other.geometry && textureSet == other.textureSet && material == other.material;
+	};
+	/** Returns an identifier shared by a mesh and its copies, for ordering draws. */
+	inline const void* getGeometryId() const { return geometry.get(); };
 
 private:
-	void setupMesh();
+	/** Copies the vertices and indices into the GeometryArena and keeps the arrays its residency asks for. */
+	void setupMesh(MeshData& data);
+	/** Updates textureSet from the current textures. */
+	void updateTextureSet();
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+#include "glew.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include "Graphics/Mesh.h"
+#include "Utils/MappedFile.h"
+
+/**
+* Reads and writes .meshbin files, a binary copy of a model's imported meshes.
+* A cache file sits next to its source model, one per set of import settings. It stores the final vertex and
+* index arrays exactly as they are uploaded, so loading is a memory map with no parsing or post-processing.
+* The header records the format version, vertex size, source modified time and import settings, and a cache
+* that doesn't match is ignored and rewritten.
+* Files are written to a temporary file and renamed into place, so a reader never sees a partly written cache.
+* The file name includes the format version and the source's modified time, so a cache is never rewritten in place
+* while an earlier import still has it mapped, which Windows won't allow. Caches of older versions of a source are
+* left behind and can be deleted.
+*/
+class MeshCache {
+
+public:
+	/** Increment when the file layout, Vertex or the import processing changes. */
+	static constexpr uint32_t VERSION = 3;
+	static constexpr const char* EXTENSION = ".meshbin";
+
+	/**
+	* Held while a model is imported, from reading its cache to writing it. Threads importing the same file with the
+	* same settings key wait for the first to finish, then read the cache it wrote rather than importing again.
+	*/
+	class ImportGuard {
+
+	protected:
+		std::string cachePath;
+
+	public:
+		ImportGuard(const std::string& sourcePath, const std::string& settingsKey);
+		~ImportGuard();
+		ImportGuard(const ImportGuard&) = delete;
+		ImportGuard& operator=(const ImportGuard&) = delete;
+	};
+
+protected:
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t meshCount;
+		uint64_t sourceModifiedTime;
+		// Length of the import settings key that follows the header.
+		uint32_t settingsKeyLength;
+		uint32_t padding;
+	};
+
+	struct MeshHeader {
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t textureCount;
+		float boundingRadius;
+		// Number of MeshLOD ranges that follow the texture references.
+		uint32_t lodCount;
+	};
+
+public:
+	/** Returns the path of the cache file for a model and its import settings key, without the version part. */
+	static std::string getCachePath(const std::string& sourcePath, const std::string& settingsKey);
+	/** Returns the path of the cache file for a model, its import settings key and its modified time. */
+	static std::string getCachePath(const std::string& sourcePath, const std::string& settingsKey, uint64_t sourceModifiedTime);
+
+	/**
+	* Maps a model's cache file.
+	* Parameter: const std::string& sourcePath  Path to the source model file.
+	* Parameter: const std::string& settingsKey  Key of the import settings, see Model::ImportSettings::getKey().
+	* Parameter: MappedFile& file  Receives the mapping. Must stay open while the mesh data is in use.
+	* Parameter: std::vector<MeshData>& meshes  Filled with each mesh. Vertex and index arrays point into the mapping.
+	* Returns: bool  False if there is no cache or it is out of date or invalid.
+	*/
+	static bool read(const std::string& sourcePath, const std::string& settingsKey, MappedFile& file, std::vector<MeshData>& meshes);
+
+	/**
+	* Writes a model's cache file.
+	* Parameter: const std::string& sourcePath  Path to the source model file.
+	* Parameter: const std::string& settingsKey  Key of the import settings the meshes were imported with.
+	* Parameter: const std::vector<MeshData>& meshes  Imported meshes.
+	* Returns: bool  False if the file couldn't be written.
+	*/
+	static bool write(const std::string& sourcePath, const std::string& settingsKey, const std::vector<MeshData>& meshes);
+
+protected:
+	/** Returns the ShaderLoader::Vars::MAT_* constant matching a type name, or null if unknown. */
+	static const char* findTextureType(const std::string& type);
+	/**
+	* Moves a file over another, replacing it. Fails if the destination is open, e.g. mapped on Windows, which only
+	* happens to a cache that couldn't be read and so isn't mapped.
+	*/
+	static bool replaceFile(const std::string& from, const std::string& to);
+
+	// Cache paths being imported, see ImportGuard.
+	static std::mutex importMutex;
+	static std::condition_variable importFinished;
+	static std::set<std::string> importing;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "glew.h"
+#include <vector>
+#include <string>
+
+struct Vertex;
+
+/**
+* Reorders mesh data for faster rendering. Run on meshes after import or generation, before they're uploaded.
+* The pass:
+* - Removes degenerate triangles and any incomplete triangle at the end of the index list.
+* - Welds vertices that are exactly equal.
+* - Reorders triangles for the post-transform vertex cache with Tipsify (Sander et al. 2007), which also splits
+*   them into clusters.
+* - Sorts the clusters so those facing away from the mesh centre are drawn first, which reduces overdraw.
+* - Reorders vertices into the order the indices first use them, dropping any that aren't used.
+*
+* Cache efficiency is measured against a FIFO cache as ACMR (cache misses per triangle) and ATVR (cache misses
+* per vertex, 1 is ideal).
+*/
+class MeshOptimiser {
+
+public:
+	/** Size of the vertex cache being optimised for and simulated. */
+	static constexpr GLuint CACHE_SIZE = 16;
+	/**
+	* A cluster can end once its ACMR has fallen to this. Lower gives fewer, larger clusters, keeping more of the
+	* cache order, higher gives more for the overdraw sort to work with (lambda in Sander et al.).
+	*/
+	static constexpr float CLUSTER_ACMR_THRESHOLD = 0.75f;
+
+	/** Mesh sizes and simulated cache misses before and after optimising. Sums of stats can be reported together. */
+	struct Stats {
+		size_t triangles = 0;
+		size_t trianglesRemoved = 0;
+		size_t verticesBefore = 0;
+		size_t verticesAfter = 0;
+		size_t missesBefore = 0;
+		size_t missesAfter = 0;
+
+		inline float getACMRBefore() const { return triangles ? (float)missesBefore / (triangles + trianglesRemoved) : 0; };
+		inline float getACMRAfter() const { return triangles ? (float)missesAfter / triangles : 0; };
+		inline float getATVRBefore() const { return verticesBefore ? (float)missesBefore / verticesBefore : 0; };
+		inline float getATVRAfter() const { return verticesAfter ? (float)missesAfter / verticesAfter : 0; };
+
+		Stats& operator+=(const Stats& other);
+		/** Writes the stats to the console on one line. */
+		void print(const std::string& name) const;
+	};
+
+	/**
+	* Optimises a triangle list in place.
+	* Parameter: std::vector<Vertex>& vertices  Vertices. May be merged and reordered.
+	* Parameter: std::vector<GLuint>& indices  Triangle indices into the vertices. Reordered and remapped.
+	* Returns: Stats  Cache efficiency before and after.
+	*/
+	static Stats optimise(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+	/**
+	* Reorders triangles for the vertex cache and overdraw without changing the vertices, e.g. for a level of detail
+	* that shares the vertices of its full detail mesh. Degenerate triangles are removed.
+	*/
+	static void optimiseIndices(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+	/** Counts the misses of a FIFO vertex cache of CACHE_SIZE drawing the indices in order. */
+	static size_t simulateCache(const std::vector<GLuint>& indices, size_t vertexCount);
+
+protected:
+	/** Removes degenerate and incomplete triangles. Returns the number removed. */
+	static size_t removeDegenerates(std::vector<GLuint>& indices);
+	/** Merges identical vertices and remaps the indices to them. */
+	static void weldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+	/**
+	* Reorders triangles for the vertex cache.
+	* Parameter: std::vector<GLuint>& clusterStarts  Receives the first triangle of each cluster. A cluster starts
+	* wherever the cache is flushed, and wherever the ACMR of the cluster so far, drawn from an empty cache, is at most
+	* CLUSTER_ACMR_THRESHOLD.
+	*/
+	static void tipsify(std::vector<GLuint>& indices, size_t vertexCount, std::vector<GLuint>& clusterStarts);
+	/** Reorders the clusters, outward facing first. */
+	static void sortClusters(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<GLuint>& clusterStarts);
+	/** Reorders vertices into first use order and drops unused ones. */
+	static void remapVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+};
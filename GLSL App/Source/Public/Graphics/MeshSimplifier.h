@@ -0,0 +1,51 @@
+#pragma once
+#include "glew.h"
+#include <vector>
+
+struct Vertex;
+struct MeshLOD;
+
+/**
+* Builds levels of detail by quadric edge collapse (Garland & Heckbert 1997).
+* Each vertex gets a quadric measuring the squared distance to the planes of its triangles. Edges are collapsed
+* cheapest first, moving one end onto the other, and the merged quadric gives the error of later collapses.
+* Vertices are only ever removed, never moved, so every level indexes the vertices of the full detail mesh and
+* only needs its own indices.
+*
+* Vertices on open borders and texture or normal seams (where several vertices share a position) are locked so
+* the silhouette and attributes don't tear.
+*/
+class MeshSimplifier {
+
+public:
+	/** Most levels built per mesh, including full detail. */
+	static constexpr int MAX_LODS = 4;
+	/** Triangles each level aims for, relative to the level before it. */
+	static constexpr float LOD_RATIO = 0.5f;
+	/** Largest error a level may reach, relative to the mesh's bounding radius. */
+	static constexpr float MAX_ERROR = 0.05f;
+	/** Levels that don't remove at least this fraction of the previous level's triangles aren't kept. */
+	static constexpr float MIN_REDUCTION = 0.15f;
+
+	/**
+	* Simplifies a triangle list.
+	* Parameter: const std::vector<Vertex>& vertices  Vertices the indices refer to. Should already be optimised, see MeshOptimiser.
+	* Parameter: const std::vector<GLuint>& indices  Triangles to simplify.
+	* Parameter: size_t targetIndexCount  Number of indices to stop at.
+	* Parameter: float maxError  Error to stop at, relative to errorScale.
+	* Parameter: float errorScale  Size the errors are relative to, e.g. the bounding radius.
+	* Parameter: float* resultError  If set, receives the error of the result relative to errorScale.
+	* Returns: std::vector<GLuint>  Indices of the simplified triangles, into the same vertices.
+	*/
+	static std::vector<GLuint> simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount,
+		float maxError, float errorScale, float* resultError = nullptr);
+
+	/**
+	* Builds the level of detail chain of a mesh. Each level is simplified from the one before.
+	* Parameter: const std::vector<Vertex>& vertices  Mesh vertices.
+	* Parameter: std::vector<GLuint>& indices  Full detail indices. Each level's indices are appended.
+	* Parameter: float boundingRadius  Bounding radius of the mesh. Errors are stored relative to it.
+	* Parameter: std::vector<MeshLOD>& lods  Receives the levels, starting with full detail.
+	*/
+	static void buildLODs(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float boundingRadius, std::vector<MeshLOD>& lods);
+};
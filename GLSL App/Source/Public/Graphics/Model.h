@@ -1,20 +1,53 @@
 #pragma once
 #include "glew.h"
 #include <vector>
+#include <string>
 #include "Mesh.h"
+#include "Utils/MappedFile.h"
+#include "Graphics/MeshOptimiser.h"
 
-/** A Model is a collection of meshes. */
+namespace Assimp {
+	class Importer;
+}
+
+/** A model's meshes loaded on the CPU, ready to be created on the GL thread. See Model::import(). */
+struct ModelData {
+	std::string path;
+	// Directory the texture paths are relative to.
+	std::string baseDir;
+	std::vector<MeshData> meshes;
+	// Cache file the mesh arrays point into, if the model was loaded from its MeshCache file.
+	std::shared_ptr<MappedFile> cacheFile;
+};
+
+/**
+* A Model is a collection of meshes.
+* Meshes are reference counted, so copies of a model share the same GPU data. Changing the material or textures
+* of a copy first gives it its own copies of any shared meshes (which still share the geometry), so other copies,
+* e.g. the World's model cache and other entities, are left as they were.
+*/
 class Model {
 
 public :
 	/** Model import settings. */ 
 	struct ImportSettings {
 		bool invertYCoord = false;
+		/** Store vertices on the GPU in the compact PackedVertex format, at a small cost in precision. */
+		bool compactVertices = false;
+		/** Build simplified levels of detail for each mesh, see MeshSimplifier. */
+		bool generateLODs = true;
+		/** Arrays each mesh keeps in host memory after upload. */
+		EGeometryResidency residency = RELEASE_GEOMETRY;
+
+		/** Returns a string identifying these settings, for use in cache keys. */
+		inline std::string getKey() const { return getImportKey() + (compactVertices ? "compact" : "") + ((residency != RELEASE_GEOMETRY) ? "keep" + std::to_string((int)residency) : ""); };
+		/** Returns a string identifying the settings that change the imported arrays, for use in MeshCache file names. */
+		inline std::string getImportKey() const { return std::string(invertYCoord ? "invertY" : "") + (generateLODs ? "" : "noLOD"); };
+		inline GeometryArena::EVertexFormat getVertexFormat() const { return compactVertices ? GeometryArena::PACKED_VERTEX : GeometryArena::FULL_VERTEX; };
 	};
 
 protected:
-	std::vector<Mesh> meshes;
-	std::vector<Texture> loadedTextures;
+	std::vector<Mesh::MeshPtr> meshes;
 	std::string baseDir;
 
 	/** Import settings used for the current model. */
@@ -24,22 +57,55 @@ public:
 	Model();
 	Model(GLchar* path, ImportSettings importSettings = ImportSettings());
 
-	void render(GLuint shaderProgram);
+	void render(const ShaderProgram& shader);
 
 	/** Manually add a mesh to this model. */
-	void addMesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, float boundingRadius);
+	void addMesh(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, std::vector<Texture> textures, float boundingRadius,
+		std::vector<MeshLOD> lods = std::vector<MeshLOD>());
+	/**
+	* Creates a mesh from imported data and adds it to this model. Must be called on the GL thread.
+	* Parameter: MeshData&& data  Imported mesh. Its owned arrays are freed or kept by the mesh.
+	* Parameter: const std::string& textureDir  Directory the mesh's texture paths are relative to.
+	*/
+	void addMesh(MeshData&& data, const std::string& textureDir);
 
-	// Set the material for the whole model.
+	/**
+	* Loads a model file into CPU memory, from its MeshCache file if it is up to date, otherwise with Assimp.
+	* Makes no GL calls, so can be run on any thread.
+	* Parameter: const std::string& path  Path to the model file.
+	* Parameter: const ImportSettings& importSettings  Settings to import with.
+	* Parameter: ModelData& data  Receives the meshes.
+	* Returns: bool  False if the file couldn't be imported.
+	*/
+	static bool import(const std::string& path, const ImportSettings& importSettings, ModelData& data);
+	/**
+	* Imports with an existing Assimp importer, so a thread loading many models can keep one. The importer's scene is freed before returning.
+	* Importers aren't thread safe, so each thread needs its own.
+	*/
+	static bool import(const std::string& path, const ImportSettings& importSettings, ModelData& data, Assimp::Importer& importer);
+
+	// Set the material for the whole model. Doesn't affect other copies of the model.
 	void setMaterial(glm::vec3 diffuse, glm::vec3 specular, float shininess);
 	/**
-	* Add a texture to the whole model.
+	* Add a texture to the whole model. Doesn't affect other copies of the model.
 	* Parameter: const char* path  Path to the texture file.
 	* Parameter: const char* type  Type of texture, see ShaderLoader::Vars::MAT_*
 	*/
 	void addTexture(const char* path, const char* type);
 
+	inline const std::vector<Mesh::MeshPtr>& getMeshes() const { return meshes; };
+
+	/** Returns the radius of a sphere around the model origin that contains every mesh. */
+	float getBoundingRadius() const;
+
 protected:	
 	void loadModel(std::string path);
-	Mesh processMesh(struct aiMesh* mesh, const struct aiScene* scene);
-	std::vector<Texture> loadTextures(struct aiMaterial* mat, enum aiTextureType type, const char* typeName);
+	/** Replaces meshes shared with other models by copies of their own, before their material is changed. */
+	void makeMeshesUnique();
+	/** Converts an Assimp mesh to the vertex format and optimises it, adding its optimisation stats to stats. */
+	static MeshData processMesh(struct aiMesh* mesh, const struct aiScene* scene, const ImportSettings& importSettings, MeshOptimiser::Stats& stats);
+	/** Appends references to a material's maps of one type. */
+	static void getTextureRefs(struct aiMaterial* mat, enum aiTextureType type, const char* typeName, std::vector<TextureRef>& textures);
+	/** Loads a texture through the TextureManager. */
+	static Texture loadTexture(const std::string& path, const char* typeName);
 };
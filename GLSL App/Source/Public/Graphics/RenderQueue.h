@@ -0,0 +1,116 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include <cstdint>
+#include "Graphics/Mesh.h"
+#include "Graphics/ShaderProgram.h"
+
+/**
+* Collects the draws for a frame and renders them in state order.
+* Each draw gets a 64-bit sort key built from its program, texture set, material and geometry (vertex format and
+* position in the arena of the level of detail drawn), so sorting
+* the queue groups draws that share state. Consecutive draws of the same mesh with the same program are merged
+* into one instanced draw (per level of detail), and state that is already bound is skipped (see RenderState).
+*
+* Where multi-draw indirect is supported (see GeometryArena::supportsMultiDraw()), the instanced draws are
+* written as indirect commands instead, and every run with the same program, textures and vertex format is submitted
+* in a single glMultiDrawElementsIndirect call. Material colours and position dequantisation for each command are
+* in a storage buffer indexed by drawOffset + gl_DrawIDARB.
+*
+* Programs submitted to the queue must read the model matrix from the instance attribute when the "instanced"
+* uniform is set, and the material from the draw buffer when "multiDraw" is set, as the object shader does.
+*/
+class RenderQueue {
+
+public:
+	/** A single mesh draw. */
+	struct DrawItem {
+		uint64_t key;
+		const ShaderProgram* shader;
+		Mesh* mesh;
+		// Level of detail to draw the mesh at.
+		GLuint lod;
+		// Index of the model matrix in the transform list.
+		GLuint transformIndex;
+	};
+
+	/** Shader storage binding of the per-draw data. Follows LightGrid's bindings. */
+	static constexpr GLuint DRAW_DATA_BINDING = 3;
+
+	/** Material of an indirect draw (std430). Must match DrawData in ObjectFragment.glsl. */
+	struct DrawData {
+		glm::vec4 diffuseColour;
+		// w = shininess.
+		glm::vec4 specularColour;
+		// Position dequantisation of the mesh. w unused.
+		glm::vec4 positionOffset;
+		glm::vec4 positionScale;
+	};
+
+	/** Indirect draw command, laid out as glMultiDrawElementsIndirect reads it. */
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	/** Counters for the last render. */
+	struct Stats {
+		unsigned int items = 0;
+		// Instanced draws, or indirect commands with multi-draw.
+		unsigned int batches = 0;
+		unsigned int materialChanges = 0;
+		unsigned int multiDraws = 0;
+		// Triangles drawn, and how many there would be with every mesh at full detail.
+		unsigned int triangles = 0;
+		unsigned int fullDetailTriangles = 0;
+	};
+
+protected:
+	std::vector<DrawItem> items;
+	std::vector<glm::mat4> transforms;
+	// Model matrices of the batch being drawn, gathered contiguously. With multi-draw, those of the whole frame.
+	std::vector<glm::mat4> batchTransforms;
+	// Indirect commands and their materials for the frame, and the first item of each command.
+	std::vector<DrawCommand> commands;
+	std::vector<DrawData> drawData;
+	std::vector<const DrawItem*> commandItems;
+	Stats stats;
+
+public:
+	RenderQueue();
+
+	/**
+	* Adds a mesh to be drawn.
+	* Parameter: const ShaderProgram& shader  Shader to draw with. Must outlive the queued draw.
+	* Parameter: Mesh* mesh  Mesh to draw. Must outlive the queued draw.
+	* Parameter: const glm::mat4& transform  Model matrix.
+	* Parameter: GLuint lod  Level of detail to draw the mesh at, see LODSelector.
+	*/
+	void submit(const ShaderProgram& shader, Mesh* mesh, const glm::mat4& transform, GLuint lod = 0);
+
+	/** Removes every queued draw. Storage is kept to avoid reallocating the next frame. */
+	void clear();
+
+	/** Sorts and renders every queued draw. The queue is left as-is, call clear() before the next frame. */
+	void render();
+
+	inline size_t size() const { return items.size(); };
+	inline const Stats& getStats() const { return stats; };
+
+protected:
+	/** Renders the sorted items with an instanced draw per mesh. */
+	void renderBatches();
+	/** Renders the sorted items with a multi-draw per program and texture set. Returns false if the commands couldn't be streamed. */
+	bool renderMultiDraw();
+
+	/** Builds the sort key for a draw. Most significant fields are the most expensive to change. */
+	static uint64_t makeKey(const ShaderProgram& shader, const Mesh& mesh, GLuint lod);
+	/** Builds the geometry field of the sort key from a mesh's vertex format and position in the arena. */
+	static uint64_t makeGeometryKey(const GeometryArena::Range& geometry);
+	/** Hashes a material's values down to 16 bits. */
+	static uint64_t hashMaterial(const Material& material);
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include "glew.h"
+
+/**
+* Cache of the bound GL program, vertex array and textures.
+* Binds that match the current state are skipped. Everything that renders should bind through here so the
+* cache stays in sync with GL. The cache is invalidated at the start of each frame in case anything
+* (e.g. SOIL when loading textures) changed state directly.
+*/
+class RenderState {
+
+public:
+	/** Number of texture units tracked. */
+	static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+	/** State change counters for the current frame. */
+	struct Stats {
+		unsigned int programChanges = 0;
+		unsigned int vertexArrayChanges = 0;
+		unsigned int textureChanges = 0;
+		unsigned int drawCalls = 0;
+		/** Binds skipped because the state was already current. */
+		unsigned int redundantChanges = 0;
+	};
+
+protected:
+	/** Value used for cached state that is unknown. */
+	static constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+
+	static GLuint currentProgram;
+	static GLuint currentVertexArray;
+	static GLuint activeTextureUnit;
+	// Bound texture for each unit, per target.
+	static GLuint boundTextures2D[MAX_TEXTURE_UNITS];
+	static GLuint boundTexturesCube[MAX_TEXTURE_UNITS];
+
+	static Stats stats;
+
+public:
+	/** Resets the counters and forgets the cached state. Call once at the start of each frame. */
+	static void beginFrame();
+	/** Forgets the cached state so the next bind of everything is always made. */
+	static void invalidate();
+	/** Deletes the white texture. Must be done before the OpenGL context is destroyed. */
+	static void shutdown();
+
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	/**
+	* Binds a texture to a texture unit.
+	* Parameter: GLuint unit  Texture unit index, starting at 0.
+	* Parameter: GLenum target  GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP.
+	* Parameter: GLuint texture  Texture to bind.
+	*/
+	static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	/** Records a draw call in the frame counters. */
+	inline static void countDrawCall() { stats.drawCalls++; };
+
+	/** Returns a 1x1 white texture, created the first time it's requested. */
+	static GLuint getWhiteTexture();
+
+	inline static const Stats& getStats() { return stats; };
+};
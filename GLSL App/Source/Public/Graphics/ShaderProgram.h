@@ -0,0 +1,92 @@
+#pragma once
+#include "glew.h"
+#include <string>
+#include <unordered_map>
+#include "glm/glm.hpp"
+#include "Graphics/GLHandle.h"
+
+/**
+* A linked shader program with a cached uniform location table. Owns the program, so can be moved but not copied.
+* Every active uniform is introspected once after linking, so per-frame code sets values
+* through pre-resolved locations rather than going through glGetUniformLocation each time.
+*/
+class ShaderProgram {
+
+public:
+	/** Number of numbered material maps resolved per type, e.g. material.diffuse1 and material.diffuse2. */
+	static constexpr int MAX_MATERIAL_MAPS = 2;
+
+	/** Locations of the ShaderLoader::Vars uniforms. -1 if the program doesn't use the uniform. */
+	struct Uniforms {
+		// View, projection and view position are in the shared camera block, see UniformBuffer.
+		GLint model = -1;
+
+		// Material sampler locations, indexed by map number - 1.
+		GLint matDiffuse[MAX_MATERIAL_MAPS];
+		GLint matSpecular[MAX_MATERIAL_MAPS];
+		GLint matNormal[MAX_MATERIAL_MAPS];
+		GLint matDiffuseColour = -1;
+		GLint matSpecularColour = -1;
+		GLint matShininess = -1;
+		GLint matHasNormalMap = -1;
+
+		GLint entityId = -1;
+
+		GLint instanced = -1;
+		GLint multiDraw = -1;
+		GLint drawOffset = -1;
+		GLint positionOffset = -1;
+		GLint positionScale = -1;
+
+		Uniforms();
+	};
+
+protected:
+	// GL program, deleted with the ShaderProgram.
+	GLProgram program;
+	// Location of each active uniform, keyed on its name. Array uniforms are also stored without the [0] suffix.
+	std::unordered_map<std::string, GLint> uniformLocations;
+	// Pre-resolved locations of the common uniforms.
+	Uniforms uniforms;
+
+public:
+	ShaderProgram();
+	/**
+	* Compiles and links a program from a vertex and fragment shader file, then caches its uniform locations.
+	* Parameter: const char* vertexShaderFile  Path to the vertex shader file.
+	* Parameter: const char* fragmentShaderFile  Path to the fragment shader file.
+	*/
+	ShaderProgram(const char* vertexShaderFile, const char* fragmentShaderFile);
+
+	/** Binds this program for rendering. */
+	void use() const;
+
+	/**
+	* Returns the location of a uniform from the cached table, or -1 if it isn't active.
+	* This is a hash lookup, so resolve locations once up front rather than per frame.
+	*/
+	GLint getUniformLocation(const std::string& name) const;
+
+	/**
+	* Returns the location of a numbered material sampler.
+	* Parameter: const char* type  Type of map, see ShaderLoader::Vars::MAT_*
+	* Parameter: int number  Map number, starting at 1.
+	*/
+	GLint getMaterialMapLocation(const char* type, int number) const;
+
+	inline GLuint getHandle() const { return program.get(); };
+	inline const Uniforms& getUniforms() const { return uniforms; };
+
+	// Typed setters by pre-resolved location. The program must be in use. Location -1 is silently ignored by GL.
+	inline void setValue(GLint location, const glm::vec3& value) const { glUniform3f(location, value.x, value.y, value.z); }
+	inline void setValue(GLint location, const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+	inline void setValue(GLint location, float value) const { glUniform1f(location, value); }
+	inline void setValue(GLint location, int value) const { glUniform1i(location, value); }
+	inline void setValue(GLint location, GLuint value) const { glUniform1ui(location, value); }
+
+protected:
+	/** Queries every active uniform in the linked program and fills the location table. */
+	void cacheUniformLocations();
+	/** Resolves the ShaderLoader::Vars locations from the table. */
+	void resolveCommonUniforms();
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include "glew.h"
+#include <deque>
+#include "Graphics/GLHandle.h"
+
+/**
+* Ring buffer for streaming data to the GPU.
+* A single buffer is created with immutable storage (GL_ARB_buffer_storage) and kept persistently mapped, so data is
+* written straight into memory the GPU reads from rather than copied by the driver in glBufferData. Space is handed
+* out in order around the ring. A fence is placed at the start of each frame over the data written during the last
+* one, and space is only reused once the GPU has passed the fence that covers it.
+*
+* Static data (mesh geometry and textures) is copied from the ring into its final storage on the GPU. Per-frame data
+* (instance matrices and lights) is read by the shaders straight out of the ring.
+*
+* If buffer storage isn't supported, isSupported() returns false and callers upload the usual way.
+*/
+class StagingBuffer {
+
+public:
+	/** Size of the ring in bytes. */
+	static constexpr GLsizeiptr SIZE = 32 * 1024 * 1024;
+	/** Largest piece static uploads are split into, so a big upload doesn't need the whole ring to be free. */
+	static constexpr GLsizeiptr MAX_COPY_SIZE = SIZE / 4;
+
+	/** Space in the ring. data is null if no space could be given. */
+	struct Allocation {
+		// Mapped memory to write to.
+		void* data = nullptr;
+		// Byte offset of the space in the ring buffer.
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+
+		inline bool isValid() const { return data != nullptr; };
+	};
+
+	/** Counters for the current frame. */
+	struct Stats {
+		size_t bytesUploaded = 0;
+		unsigned int allocations = 0;
+		// Number of times and total time the CPU waited for the GPU to release space.
+		unsigned int fenceWaits = 0;
+		double fenceWaitMs = 0;
+		// Bytes written that the GPU may still be reading.
+		size_t bytesInFlight = 0;
+	};
+
+protected:
+	/** Fence over the data written between two fences. */
+	struct Fence {
+		GLsync sync;
+		GLsizeiptr bytes;
+	};
+
+	static GLBuffer buffer;
+	static unsigned char* mapped;
+	// Offset the next allocation starts from.
+	static GLsizeiptr head;
+	// Bytes behind the head that may still be in use, including those not yet fenced.
+	static GLsizeiptr usedBytes;
+	// Bytes written since the last fence.
+	static GLsizeiptr unfencedBytes;
+	// Fences in the order they were placed.
+	static std::deque<Fence> fences;
+	// Required offset alignment of shader storage ranges.
+	static GLint storageAlignment;
+
+	static Stats stats;
+
+public:
+	/** Creates and maps the ring. Must be done after the OpenGL context is created. */
+	static void init();
+	/** Unmaps and deletes the ring. Must be done before the OpenGL context is destroyed. */
+	static void shutdown();
+	/** Fences the data written during the last frame, frees any space the GPU has finished with and resets the counters. Call once at the start of each frame. */
+	static void beginFrame();
+
+	inline static bool isSupported() { return mapped != nullptr; };
+	inline static GLuint getBuffer() { return buffer; };
+	/** Offset alignment to use for allocations bound as shader storage. */
+	inline static GLint getStorageAlignment() { return storageAlignment; };
+	inline static const Stats& getStats() { return stats; };
+
+	/**
+	* Reserves space in the ring, waiting for the GPU to finish with earlier frames if it is full.
+	* The space is valid until the end of the frame; it must be written before any commands that read it are issued.
+	* Parameter: GLsizeiptr size  Number of bytes.
+	* Parameter: GLsizeiptr alignment  Alignment of the returned offset.
+	* Returns: Allocation  Reserved space. Invalid if buffer storage isn't supported, the size is larger than the ring,
+	* or the ring is full of data written this frame.
+	*/
+	static Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+
+	/**
+	* Copies data into part of a buffer through the ring. Falls back to glBufferSubData if the ring isn't supported or is full.
+	* Parameter: GLuint destination  Buffer to copy into. Must already have storage for the range.
+	* Parameter: GLintptr offset  Byte offset in the destination.
+	* Parameter: const void* data  Data to copy.
+	* Parameter: GLsizeiptr size  Number of bytes.
+	*/
+	static void uploadToBuffer(GLuint destination, GLintptr offset, const void* data, GLsizeiptr size);
+
+	/**
+	* Fills level 0 of the bound GL_TEXTURE_2D from a pixel unpack buffer in the ring, in bands of rows.
+	* The texture storage must already be allocated.
+	* Parameter: GLenum format  Pixel format of the data. Each channel is a GL_UNSIGNED_BYTE.
+	* Parameter: GLsizei width  Width in pixels.
+	* Parameter: GLsizei height  Height in pixels.
+	* Parameter: GLsizei channels  Bytes per pixel.
+	* Parameter: const unsigned char* pixels  Tightly packed rows of pixels.
+	* Returns: bool  False if the ring isn't supported, in which case nothing is uploaded.
+	*/
+	static bool uploadTexture2D(GLenum format, GLsizei width, GLsizei height, GLsizei channels, const unsigned char* pixels);
+
+protected:
+	/** Fences the data written since the last fence. */
+	static void placeFence();
+	/** Frees the space behind the oldest fence, waiting for the GPU to pass it if wait is true. Returns false if it wasn't freed. */
+	static bool retireFence(bool wait);
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "glew.h"
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <mutex>
+#include "Graphics/GLHandle.h"
+
+/**
+* Process-wide cache of 2D textures loaded from file.
+* Textures are keyed on their canonical path and load flags, so every model and Model::addTexture call that
+* asks for the same file shares one GL texture. Handles are reference counted, and textures nothing holds
+* a handle to any more can be freed with evictUnreferenced().
+*/
+class TextureManager {
+
+public:
+	/** SOIL flags used when none are given. */
+	static const unsigned int DEFAULT_FLAGS;
+
+	/** A loaded texture. */
+	struct Entry {
+		// Deleted once the last handle to the entry is released.
+		GLTexture id;
+		// Canonical path and flags the texture is keyed on.
+		std::string key;
+		GLint width = 0;
+		GLint height = 0;
+		// Estimated GPU memory, including mipmaps.
+		size_t bytes = 0;
+	};
+	typedef std::shared_ptr<const Entry> TexturePtr;
+
+	/** A list of textures meshes draw with. Meshes with the same textures in the same order share one, see getTextureSet(). */
+	struct TextureSet {
+		// Small ID for sorting draws. Reused once the set is released.
+		GLuint id;
+		std::vector<GLuint> textures;
+	};
+	typedef std::shared_ptr<const TextureSet> TextureSetPtr;
+
+	/** Cache counters. */
+	struct Stats {
+		size_t textures = 0;
+		size_t bytes = 0;
+		unsigned int hits = 0;
+		unsigned int misses = 0;
+		unsigned int evicted = 0;
+	};
+
+protected:
+	static std::unordered_map<std::string, std::shared_ptr<Entry>> textures;
+	static Stats stats;
+
+	/** Texture sets in use, keyed on their textures, and the IDs of released sets. */
+	struct TextureSetStorage {
+		// Meshes are created and copied on the loading, GL and simulation threads.
+		std::mutex mutex;
+		std::map<std::vector<GLuint>, std::weak_ptr<const TextureSet>> sets;
+		std::vector<GLuint> freeIds;
+		GLuint nextId = 0;
+	};
+	/** Created on first use and never destroyed, so meshes freed during shutdown don't depend on static destruction order. */
+	static TextureSetStorage& getTextureSetStorage();
+	/** Deleter of a set, which removes it and frees its ID once the last mesh using it is gone. */
+	static void releaseTextureSet(const TextureSet* set);
+
+	static std::string getKey(const std::string& path, unsigned int flags);
+	/** Measures a newly created texture and adds it to the cache. A failed texture (id 0) is returned without being cached. */
+	static TexturePtr addEntry(const std::string& key, GLuint id, unsigned int flags);
+	/** Creates a GL texture from decoded pixels. Uploaded through the StagingBuffer where the flags allow, otherwise by SOIL. */
+	static GLuint createTexture(const unsigned char* pixels, int width, int height, int channels, unsigned int flags);
+
+public:
+	/**
+	* Returns a handle to a texture, loading it the first time it's requested.
+	* Parameter: const std::string& path  Path to the image file.
+	* Parameter: unsigned int flags  SOIL load flags.
+	* Returns: TexturePtr  Shared handle. The texture id is 0 if the file couldn't be loaded, which isn't cached, so
+	* the next request tries the file again.
+	*/
+	static TexturePtr load(const std::string& path, unsigned int flags = DEFAULT_FLAGS);
+
+	/**
+	* Uploads an image decoded elsewhere, e.g. on a loading thread, and adds it to the cache.
+	* If the file has already been loaded with the same flags the existing texture is returned instead. As with
+	* load(), a texture that couldn't be created isn't cached.
+	* Parameter: const std::string& path  Path the image was decoded from.
+	* Parameter: const unsigned char* pixels  Decoded pixels, see SOIL_load_image().
+	* Parameter: int width, int height, int channels  Image size and number of channels.
+	* Parameter: unsigned int flags  SOIL load flags.
+	*/
+	static TexturePtr create(const std::string& path, const unsigned char* pixels, int width, int height, int channels, unsigned int flags = DEFAULT_FLAGS);
+
+	/**
+	* Returns the set of a list of textures, shared with every mesh using the same list, for sorting draws.
+	* Parameter: const std::vector<GLuint>& textureIds  Texture ids in the order they're bound.
+	* Returns: TextureSetPtr  Shared handle. The set is removed once the last handle is released.
+	*/
+	static TextureSetPtr getTextureSet(const std::vector<GLuint>& textureIds);
+
+	/** Returns true if a file has already been loaded with the given flags. */
+	static bool isLoaded(const std::string& path, unsigned int flags = DEFAULT_FLAGS);
+
+	/** Frees every texture that no handle refers to. Returns the number freed. */
+	static size_t evictUnreferenced();
+	/** Drops the whole cache, e.g. at shutdown. Textures still referenced are freed when their last handle is. */
+	static void clear();
+
+	/** Returns the number of handles to a texture, excluding the manager's own. */
+	static long getReferenceCount(const TexturePtr& texture);
+
+	inline static const Stats& getStats() { return stats; };
+
+	/** Returns a path with its directories resolved, so different spellings of the same file match. */
+	static std::string getCanonicalPath(const std::string& path);
+};
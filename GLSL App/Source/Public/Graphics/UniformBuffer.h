@@ -0,0 +1,82 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include "Graphics/GLHandle.h"
+
+/**
+* Per-frame camera data. Matches the std140 layout of CameraBlock in the shaders.
+*/
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 projection;
+	// xyz = camera position. w is padding.
+	glm::vec4 viewPosition;
+};
+
+/**
+* Per-frame clustered lighting parameters. Matches the std140 layout of LightBlock in ObjectFragment.glsl.
+* The lights themselves are in shader storage buffers, see LightGrid.
+*/
+struct LightBlock {
+	// xyz = number of clusters along each axis, w = number of lights.
+	glm::uvec4 gridSize;
+	// xy = viewport size in pixels. zw unused.
+	glm::vec4 screenSize;
+	// x = near plane, y = far plane, z = depth slice scale, w = depth slice bias.
+	glm::vec4 depthSlicing;
+	// rgb = ambient of every light added together, applied everywhere rather than per cluster. w unused.
+	glm::vec4 ambientLight;
+};
+
+/**
+* A uniform buffer object attached to a fixed binding point.
+* Blocks are bound to the same points in every program when it is linked (see bindBlocks()),
+* so writing a buffer once per frame updates every program that reads it.
+*/
+class UniformBuffer {
+
+public:
+	/** Fixed binding points shared by all programs. */
+	enum EBindingPoint {
+		CAMERA_BINDING = 0,
+		LIGHT_BINDING = 1
+	};
+
+	/** Block names used in the shaders. */
+	struct Blocks {
+		static constexpr const char* CAMERA = "CameraBlock";
+		static constexpr const char* LIGHTS = "LightBlock";
+	};
+
+protected:
+	GLBuffer buffer;
+	GLuint bindingPoint = 0;
+	GLsizeiptr size = 0;
+
+public:
+	UniformBuffer();
+
+	/**
+	* Creates the buffer storage and attaches it to a binding point. Must be done after the OpenGL context is created.
+	* Parameter: EBindingPoint bindingPoint  Binding point to attach to.
+	* Parameter: GLsizeiptr size  Size of the block in bytes.
+	*/
+	void create(EBindingPoint bindingPoint, GLsizeiptr size);
+
+	/**
+	* Writes data into the buffer.
+	* Parameter: const void* data  Data to write.
+	* Parameter: GLsizeiptr dataSize  Number of bytes to write.
+	* Parameter: GLintptr offset  Byte offset into the buffer.
+	*/
+	void update(const void* data, GLsizeiptr dataSize, GLintptr offset = 0);
+
+	/** Writes a whole block struct into the buffer. */
+	template<typename T>
+	inline void update(const T& block) { update(&block, sizeof(T)); }
+
+	inline GLuint getHandle() const { return buffer; };
+
+	/** Binds every known block in a linked program to its fixed binding point. Blocks the program doesn't declare are skipped. */
+	static void bindBlocks(GLuint program);
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include "glew.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include "Entities/Entity.h"
+#include "Graphics/ShaderProgram.h"
+#include "Graphics/GLHandle.h"
+
+/**
+* Finds the entity under the mouse by rendering entity IDs into an offscreen R32UI buffer.
+* The buffer is rendered at a fraction of the screen resolution, scissored to the pixel under the mouse, and the
+* pixel is copied into one of a ring of pixel buffers with a fence. The result is read a frame or two later once
+* its fence has signalled, so the CPU never waits for the GPU to finish the selection pass.
+*/
+class GPUPicker {
+
+public:
+	/** Number of readbacks that can be in flight at once. */
+	static constexpr int NUM_READBACKS = 3;
+
+	/** Timing counters. */
+	struct Stats {
+		// Frames between requesting the last result and reading it.
+		unsigned int latencyFrames = 0;
+		// Time spent mapping and reading the last result, in milliseconds.
+		double readbackMs = 0;
+		// Readbacks waiting on the GPU.
+		unsigned int pending = 0;
+		// Frames skipped because every readback buffer was in flight.
+		unsigned int skippedFrames = 0;
+		unsigned int completed = 0;
+	};
+
+	/** Screen resolution is divided by this to get the ID buffer resolution. */
+	int resolutionDivisor = 2;
+
+protected:
+	/** A pixel buffer and the fence of the copy into it. */
+	struct Readback {
+		GLBuffer buffer;
+		GLsync fence = 0;
+		// Frame the copy was requested on.
+		unsigned int frame = 0;
+	};
+
+	ShaderProgram shader;
+
+	GLFramebuffer framebuffer;
+	GLTexture idTexture;
+	GLRenderbuffer depthBuffer;
+	glm::ivec2 bufferSize = glm::ivec2(0);
+
+	Readback readbacks[NUM_READBACKS];
+	// Next readback to issue and oldest readback in flight.
+	int nextReadback = 0;
+	int oldestReadback = 0;
+	unsigned int frame = 0;
+
+	Stats stats;
+
+public:
+	GPUPicker();
+
+	/** Creates the shader and readback buffers. Must be done after the OpenGL context is created. */
+	void init();
+
+	/**
+	* Renders the ID buffer at the mouse position and queues the pixel to be read back.
+	* Parameter: const std::vector<Entity::EntityPtr>& entities  Entities that can be picked.
+	* Parameter: const glm::vec2& mousePos  Mouse position in window pixels, from the top left.
+	* Parameter: const glm::vec2& screenSize  Window size in pixels.
+	*/
+	void render(const std::vector<Entity::EntityPtr>& entities, const glm::vec2& mousePos, const glm::vec2& screenSize);
+
+	/**
+	* Reads the newest finished readback, if any.
+	* Parameter: GLuint& entityId  Set to the ID under the mouse when the readback was requested, 0 for none.
+	* Returns: bool  True if a result was read.
+	*/
+	bool poll(GLuint& entityId);
+
+	inline const Stats& getStats() const { return stats; };
+
+protected:
+	/** Recreates the ID buffer if the size has changed. */
+	void resize(const glm::ivec2& size);
+};
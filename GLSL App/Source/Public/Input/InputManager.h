@@ -4,12 +4,20 @@
 #include "glm/glm.hpp"
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
 #include "Entities/Entity.h"
+#include "Graphics/ShaderProgram.h"
+#include "Scene/BVH.h"
+#include "Input/GPUPicker.h"
 
 /** Manages input bindings. 
 
 Two bindings exist, a trigger binding, which is called when the specified button is pressed or released,
 and an axis binding which is called with the axis value, such as mouse movement delta.
+
+While the world simulates on its own thread, events from the window are queued and the bindings are called from
+dispatchQueuedEvents() at the start of each tick, so they change the world on the thread that owns it.
 */
 class InputManager {
 
@@ -39,36 +47,80 @@ public:
 		MOUSE_OVER, MOUSE_OUT
 	};
 
+	// How the entity under the mouse is found.
+	enum EPickingMode {
+		// Ray cast against the scene BVH and mesh triangles on the CPU.
+		PICK_CPU,
+		// Entity IDs rendered offscreen and the pixel under the mouse read back asynchronously, see GPUPicker.
+		PICK_GPU
+	};
+
 	float mouseSensitivity = 0.1f;
+	EPickingMode pickingMode = PICK_CPU;
 
 protected:
-	typedef std::map<EInputTrigger, std::vector<TriggerBinding>> TriggerMap;
-	typedef std::map<EInputEvent, std::vector<TriggerBinding>> EventMap;
+	/** A callback and the object it was added for, so it can be removed with removeBindings(). */
+	template<typename Callback>
+	struct Binding {
+		Callback callback;
+		const void* owner;
+	};
+	typedef std::map<EInputTrigger, std::vector<Binding<TriggerBinding>>> TriggerMap;
+	typedef std::map<EInputEvent, std::vector<Binding<TriggerBinding>>> EventMap;
 
 	// Stores trigger bindings for a key.
 	std::map<unsigned char, TriggerMap> triggerBindings;
 	std::map<EMouseButton, TriggerMap> mouseTriggerBindings;
 	// Stores mouse value bindings.
-	std::map<EMouseAxis, std::vector<ValueBinding>> mouseAxisBindings;
+	std::map<EMouseAxis, std::vector<Binding<ValueBinding>>> mouseAxisBindings;
 
 	// Event bindings
 	std::map<Entity*, EventMap> entityEventBindings;
+	// Set when removeBindings() has cleared callbacks, which are erased in the next update().
+	bool bindingsRemoved = false;
 
 	glm::vec2 currentMousePos, lastMousePos;
 	// Entity currently under the mouse.
-	Entity* selectedEntity;
-
-	// Shader used for rendering the selection buffer.
-	GLuint selectionShader;
+	Entity* selectedEntity = nullptr;
+
+	// Offscreen ID buffer used in GPU picking mode.
+	GPUPicker gpuPicker;
+
+	// World being picked from.
+	class World* world = nullptr;
+	// State the last CPU pick was made with. Picking is skipped while none of it changes.
+	glm::vec2 pickMousePos = glm::vec2(-1);
+	glm::mat4 pickViewProjection;
+	unsigned int pickSceneVersion = 0;
+	// Candidates from the scene BVH, kept between picks to avoid reallocating.
+	std::vector<BVH::RayHit> pickCandidates;
+	// Meshes whose collision geometry is being read back on the render thread. Picked by their bounding sphere until then.
+	std::set<const Mesh*> pendingReadbacks;
+
+	/** A window event waiting to be dispatched. */
+	struct QueuedEvent {
+		enum EType { MOUSE, MOUSE_MOVED, KEY_DOWN, KEY_UP } type;
+		int button;
+		int state;
+		unsigned char key;
+		int x;
+		int y;
+	};
+	// Whether window events are queued rather than dispatched straight away.
+	bool queueEvents = false;
+	std::mutex eventMutex;
+	std::vector<QueuedEvent> queuedEvents;
+	// Events being dispatched, swapped with the queue so the window can keep adding to it.
+	std::vector<QueuedEvent> dispatchingEvents;
 
 public:
 	InputManager();
 
 	// Call once the OpenGL context has been created.
-	void init();
+	void init(class World* world);
 
-	// Call each frame. World is used for entity selection.
-	void update(std::vector<Entity::EntityPtr> entities);
+	// Call each frame. Entities are the ones that can be selected in GPU picking mode.
+	void update(const std::vector<Entity::EntityPtr>& entities);
 
 	// Glut input callbacks.
 	void onMouse(int button, int state, int x, int y);
@@ -76,38 +128,86 @@ public:
 	void onKeyDown(unsigned char key, int x, int y);
 	void onKeyUp(unsigned char key, int x, int y);
 
+	/** Queues window events rather than dispatching them, e.g. while another thread owns the world. Change with nothing queued. */
+	inline void setQueueEvents(bool queueEvents) { this->queueEvents = queueEvents; };
+	/** Calls the bindings for every queued event, in the order they arrived. */
+	void dispatchQueuedEvents();
+
 
 	/**
 	* Adds a trigger binding for a key.
 	* Parameter: unsigned char key  Key to add a binding for.
 	* Parameter: EInputTrigger triggerType  Input type that triggers the callback.
 	* Parameter: triggerBinding callback  Callback to trigger.
+	* Parameter: const void* owner  Object the callback uses, which removes it with removeBindings() when destroyed.
 	*/
-	void addTriggerBinding(unsigned char key, EInputTrigger triggerType, TriggerBinding callback);
+	void addTriggerBinding(unsigned char key, EInputTrigger triggerType, TriggerBinding callback, const void* owner = nullptr);
 	// Adds a trigger binding for multiple keys.
-	void addTriggerBinding(std::vector<unsigned char> keys, EInputTrigger triggerType, TriggerBinding callback);
+	void addTriggerBinding(std::vector<unsigned char> keys, EInputTrigger triggerType, TriggerBinding callback, const void* owner = nullptr);
 
 	/**
 	* Adds a trigger binding for a mouse button.
 	* Parameter: EMouseButton mouseButton  Mouse button to add a binding for.
 	* Parameter: EInputTrigger triggerType  Input type that triggers the callback.
 	* Parameter: triggerBinding callback  Callback to trigger.
+	* Parameter: const void* owner  Object the callback uses, see removeBindings().
 	*/
-	void addTriggerBinding(EMouseButton mouseButton, EInputTrigger triggerType, TriggerBinding callback);
+	void addTriggerBinding(EMouseButton mouseButton, EInputTrigger triggerType, TriggerBinding callback, const void* owner = nullptr);
 
 	/**
 	* Adds a value binding for a mouse axis.
 	* Parameter: EMouseAxis mouseAxis  Axis to add a binding for.
 	* Parameter: valueBinding callback  Callback to trigger, passing the axis value.
+	* Parameter: const void* owner  Object the callback uses, see removeBindings().
 	*/
-	void addValueBinding(EMouseAxis mouseAxis, ValueBinding callback);
+	void addValueBinding(EMouseAxis mouseAxis, ValueBinding callback, const void* owner = nullptr);
 
-	void adddEventBinding(Entity* target, EInputEvent inputEvent, TriggerBinding callback);
+	void adddEventBinding(Entity* target, EInputEvent inputEvent, TriggerBinding callback, const void* owner = nullptr);
+
+	/**
+	* Removes every binding added for an owner, e.g. when it's destroyed, so its callbacks don't fire on whatever
+	* reuses its memory. Safe to call from a binding.
+	*/
+	void removeBindings(const void* owner);
+
+	/**
+	* Casts a ray into the world and returns the nearest entity whose mesh triangles it hits.
+	* Parameter: const glm::vec3& origin  World space ray origin.
+	* Parameter: const glm::vec3& direction  Normalised world space ray direction.
+	* Parameter: float maxDistance  Length of the ray.
+	* Parameter: float* hitDistance  If set, receives the distance to the hit.
+	* Returns: Entity*  Hit entity, or null if nothing was hit.
+	*/
+	Entity* raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance = nullptr);
+
+	inline Entity* getSelectedEntity() { return selectedEntity; };
+	inline const GPUPicker& getGPUPicker() const { return gpuPicker; };
 
 protected:
+	/** Finds the entity under the mouse from the ID buffer. The result is from a previous frame. */
+	void pickGPU(const std::vector<Entity::EntityPtr>& entities);
+	/** Finds the entity under the mouse by casting a ray through it. Does nothing if the mouse, camera and scene haven't changed. */
+	void pickCPU();
+	/** Changes the selected entity, firing mouse out and over events. */
+	void setSelectedEntity(Entity* entity);
+
+	// Fire the bindings for each kind of window event.
+	void handleMouse(int button, int state, int x, int y);
+	void handleMouseMoved(int x, int y);
+	void handleKeyDown(unsigned char key);
+	void handleKeyUp(unsigned char key);
+	void queueEvent(const QueuedEvent& event);
+
 	// Fires callbacks for a specified trigger.
 	void processTriggers(EInputTrigger triggerType, TriggerMap& triggers);
 	// Fires callbacks for a specific event on a specific entity.
 	void processEvents(EInputEvent inputEvent, EventMap& events);
+	/** Erases the bindings cleared by removeBindings(). */
+	void eraseRemovedBindings();
+	// Clears the callbacks of an owner's bindings in a list, returning whether any were cleared.
+	template<typename Callback>
+	static bool clearBindings(std::vector<Binding<Callback>>& bindings, const void* owner);
+	template<typename Callback>
+	static void eraseClearedBindings(std::vector<Binding<Callback>>& bindings);
 };
 
@@ -0,0 +1,68 @@
+#pragma once
+#include "glm/glm.hpp"
+
+/** Axis aligned bounding box. */
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() {}
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	/** Returns the box containing a sphere. */
+	inline static AABB fromSphere(const glm::vec3& centre, float radius) {
+		return AABB(centre - glm::vec3(radius), centre + glm::vec3(radius));
+	}
+
+	/** Returns the box containing both boxes. */
+	inline static AABB merge(const AABB& a, const AABB& b) {
+		return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+
+	inline glm::vec3 getCentre() const { return (min + max) * 0.5f; };
+	inline glm::vec3 getExtents() const { return max - min; };
+
+	/** Surface area. Used as the cost of a node when building the tree. */
+	inline float getSurfaceArea() const {
+		glm::vec3 size = max - min;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	/** Returns true if this box fully contains the other. */
+	inline bool contains(const AABB& other) const {
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+	}
+
+	inline bool overlaps(const AABB& other) const {
+		return min.x <= other.max.x && max.x >= other.min.x
+			&& min.y <= other.max.y && max.y >= other.min.y
+			&& min.z <= other.max.z && max.z >= other.min.z;
+	}
+
+	/** Returns true if the box is within radius of the centre. */
+	inline bool overlapsSphere(const glm::vec3& centre, float radius) const {
+		glm::vec3 closest = glm::clamp(centre, min, max);
+		glm::vec3 offset = closest - centre;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	/**
+	* Slab test against a ray.
+	* Parameter: const glm::vec3& origin  Ray origin.
+	* Parameter: const glm::vec3& inverseDirection  1 / ray direction for each axis.
+	* Parameter: float maxDistance  Length of the ray.
+	* Parameter: float& entryDistance  Set to the distance along the ray the box is entered, 0 if the origin is inside.
+	* Returns: bool  True if the ray hits the box within maxDistance.
+	*/
+	inline bool intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entryDistance) const {
+		glm::vec3 t1 = (min - origin) * inverseDirection;
+		glm::vec3 t2 = (max - origin) * inverseDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+		float entry = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.f));
+		float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+		entryDistance = entry;
+		return entry <= exit;
+	}
+};
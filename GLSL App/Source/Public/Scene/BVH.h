@@ -0,0 +1,119 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <vector>
+#include <unordered_map>
+#include "Scene/AABB.h"
+#include "Graphics/Frustum.h"
+
+class Entity;
+
+/**
+* Dynamic bounding volume hierarchy over entity bounds.
+* Leaves store a "fat" box, enlarged by a margin, so small movements only need the leaf checked rather than
+* the tree changed. Leaves that leave their fat box are removed and reinserted, with the tree kept balanced
+* by rotations as it is modified. As objects move the tree quality slowly degrades, so rebuildIfDegraded()
+* rebuilds the whole tree top-down once its cost has grown past a threshold.
+*/
+class BVH {
+
+public:
+	/** A leaf hit by a ray query. */
+	struct RayHit {
+		Entity* entity;
+		// Distance along the ray the leaf's box is entered.
+		float distance;
+	};
+
+	/** Extra size added around each leaf, as a fraction of its size, plus a minimum in world units. */
+	float fatMarginScale = 0.1f;
+	float fatMarginMin = 0.1f;
+	/** Tree is rebuilt when its cost is this many times the cost after the last rebuild. */
+	float rebuildThreshold = 1.5f;
+
+protected:
+	static constexpr int NULL_NODE = -1;
+
+	struct Node {
+		AABB bounds;
+		int parent = NULL_NODE;
+		int left = NULL_NODE;
+		int right = NULL_NODE;
+		// Leaf height is 0. Free nodes are -1.
+		int height = 0;
+		// Entity of a leaf, null for internal nodes.
+		Entity* entity = nullptr;
+
+		inline bool isLeaf() const { return left == NULL_NODE; };
+	};
+
+	std::vector<Node> nodes;
+	int root = NULL_NODE;
+	// Head of the linked list of unused nodes, chained through parent.
+	int freeList = NULL_NODE;
+	// Leaf node of each entity.
+	std::unordered_map<Entity*, int> leaves;
+	// Summed surface area of the internal nodes after the last rebuild.
+	float rebuildCost = 0;
+
+	// Traversal stack, kept between queries to avoid reallocating.
+	mutable std::vector<int> stack;
+
+public:
+	BVH();
+
+	/**
+	* Adds an entity to the tree.
+	* Parameter: Entity* entity  Entity to add. Must not already be in the tree.
+	* Parameter: const AABB& bounds  World space bounds of the entity.
+	*/
+	void insert(Entity* entity, const AABB& bounds);
+	/** Removes an entity from the tree. Entities not in the tree are ignored. */
+	void remove(Entity* entity);
+	/**
+	* Updates the bounds of an entity. The tree only changes if the new bounds don't fit in the leaf's fat box.
+	* Returns: bool  True if the leaf was moved.
+	*/
+	bool update(Entity* entity, const AABB& bounds);
+
+	/** Rebuilds the tree from scratch, top-down. */
+	void rebuild();
+	/** Rebuilds the tree if its cost has grown past rebuildThreshold since the last rebuild. */
+	bool rebuildIfDegraded();
+
+	/**
+	* Finds every leaf hit by a ray.
+	* Parameter: const glm::vec3& origin  Ray origin.
+	* Parameter: const glm::vec3& direction  Normalised ray direction.
+	* Parameter: float maxDistance  Length of the ray.
+	* Parameter: std::vector<RayHit>& hits  Cleared, then filled with the hits sorted nearest first.
+	*/
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<RayHit>& hits) const;
+	/** Finds every leaf overlapping a sphere. Results are appended. */
+	void querySphere(const glm::vec3& centre, float radius, std::vector<Entity*>& results) const;
+	/** Finds every leaf at least partially inside a frustum. Results are appended. */
+	void queryFrustum(const Frustum& frustum, std::vector<Entity*>& results) const;
+
+	inline bool contains(Entity* entity) const { return leaves.count(entity) > 0; };
+	inline size_t size() const { return leaves.size(); };
+	/** Height of the tree. 0 when empty or with a single leaf. */
+	inline int getHeight() const { return (root == NULL_NODE) ? 0 : nodes[root].height; };
+	/** Summed surface area of the internal nodes. Lower is a better tree. */
+	float getCost() const;
+
+protected:
+	int allocateNode();
+	void freeNode(int node);
+
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	/** Walks from a node to the root, refitting bounds and rebalancing. */
+	void refitAncestors(int node);
+	/** Rotates the subtree at a node if its children are unbalanced. Returns the new subtree root. */
+	int balance(int node);
+
+	/** Recursively builds a subtree from a range of leaves. Returns its root. */
+	int buildTopDown(int* leafNodes, int count);
+
+	/** Appends every leaf entity under a node. */
+	void collectLeaves(int node, std::vector<Entity*>& results) const;
+};
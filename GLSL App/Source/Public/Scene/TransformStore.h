@@ -0,0 +1,168 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+class ITransform;
+
+/**
+* Storage for the position, rotation and scale of every transform, kept as separate arrays (structure of arrays).
+* Each ITransform holds a handle to its slot. Changing a transform only writes its components and flags the slot,
+* then update() computes the model matrices of every flagged slot in one batch, once per frame, and everything
+* drawing or picking the transform reads the cached matrix.
+*
+* A slot can have a parent, in which case its components are relative to the parent's world matrix. Slots with
+* a parent are kept in a flat list in depth-first order, so every parent comes before its children and each subtree
+* is a contiguous range, and their local and world matrices are stored in arrays in the same order. Only the ranges
+* of subtrees that have moved are walked, propagating world matrices down the arrays from parents earlier in the
+* same arrays. The list is only rebuilt when a parent changes. Each slot also links its children, so they're found
+* without scanning every slot.
+*
+* The batch is split into blocks whose components are gathered into contiguous arrays, and the rotation and scale
+* part of each block's matrices is computed with SSE intrinsics, AVX when the build targets it, or scalar code on
+* other platforms.
+*
+* Jobs on the JobSystem workers may change transforms in parallel, as long as each slot is only changed by one job.
+* Slots they change are listed per thread and merged before the matrices are next read on the main thread.
+*/
+class TransformStore {
+
+public:
+	typedef uint32_t Handle;
+	static constexpr Handle INVALID_HANDLE = 0xFFFFFFFF;
+
+	/** Transforms computed per block. */
+	static constexpr size_t BLOCK_SIZE = 64;
+
+	/** Counters for the last update(). */
+	struct Stats {
+		size_t transforms = 0;
+		// Matrices computed in the batch.
+		size_t updated = 0;
+		// Matrices computed on their own since the previous update(), for transforms read before the batch.
+		size_t computedOnDemand = 0;
+		// Slots with a parent, and those whose world matrix was rebuilt from their parent's.
+		size_t attached = 0;
+		size_t hierarchyUpdated = 0;
+	};
+
+protected:
+	/** A slot with a parent, in the depth-first hierarchy list. */
+	struct HierarchyNode {
+		Handle handle;
+		Handle parent;
+		// Index of the parent in the list, or INVALID_HANDLE if the parent has no parent itself.
+		uint32_t parentIndex;
+		// Index after the last descendant, so the node's subtree is the range from its own index up to this.
+		uint32_t subtreeEnd;
+	};
+
+	struct Storage {
+		std::vector<float> positionX, positionY, positionZ;
+		std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+		std::vector<float> scaleX, scaleY, scaleZ;
+		// World matrix of each slot without a parent, valid once the slot isn't dirty.
+		std::vector<glm::mat4> matrices;
+		std::vector<Handle> parents;
+		// Children of each slot as a linked list: its first child, and each child's neighbours in its parent's list.
+		std::vector<Handle> firstChildren;
+		std::vector<Handle> nextSiblings;
+		std::vector<Handle> previousSiblings;
+		// Slots with a parent in depth-first order. Rebuilt before matrices are next computed when hierarchyChanged is set.
+		std::vector<HierarchyNode> hierarchy;
+		// Matrix relative to the parent, world matrix and whether it moved in the current update() of each slot in
+		// the hierarchy list, in the same order.
+		std::vector<glm::mat4> hierarchyLocalMatrices;
+		std::vector<glm::mat4> hierarchyMatrices;
+		std::vector<uint8_t> hierarchyMoved;
+		// Index of each slot in the hierarchy list, or INVALID_HANDLE.
+		std::vector<uint32_t> hierarchyIndices;
+		bool hierarchyChanged = false;
+		// Whether the slot has changed since the last update(), and whether its matrix is out of date.
+		std::vector<uint8_t> changed;
+		std::vector<uint8_t> matrixDirty;
+		// Transform using each slot. Null for free slots.
+		std::vector<ITransform*> owners;
+		// Slots changed since the last update(), each listed once.
+		std::vector<Handle> changedSlots;
+		// Slots changed on each thread but the main thread, indexed by JobSystem::getThreadIndex(), and whether any are
+		// waiting to be merged. Threads other than the workers share one list, so only one may change transforms at a
+		// time, e.g. the render thread while it holds World::lockSimulation().
+		std::vector<std::vector<Handle>> threadChangedSlots;
+		std::atomic<bool> threadChangesPending{ false };
+		std::vector<Handle> freeSlots;
+		// Scratch lists for update(), kept to avoid reallocating.
+		std::vector<Handle> updating;
+		std::vector<Handle> computing;
+		std::vector<uint32_t> subtreeStarts;
+		Stats stats;
+		// Matrices computed on demand since the last update().
+		size_t computedOnDemand = 0;
+	};
+
+	// Created on first use and never destroyed, so transforms freed during shutdown don't depend on static destruction order.
+	static Storage* storage;
+
+public:
+	/** Allocates an identity transform for an owner. */
+	static Handle create(ITransform* owner);
+	/** Frees a slot. Its handle can be given out again. Its children are detached, keeping their local values. */
+	static void destroy(Handle handle);
+	/** Copies the position, rotation and scale of one slot into another. */
+	static void copy(Handle from, Handle to);
+
+	/**
+	* Sets the parent of a slot. Its position, rotation and scale are then relative to the parent.
+	* Parameter: Handle handle  Slot to attach.
+	* Parameter: Handle parent  Slot to attach to, or INVALID_HANDLE to detach.
+	* Returns: bool  False if the parent is the slot itself or one of its descendants.
+	*/
+	static bool setParent(Handle handle, Handle parent);
+	inline static Handle getParent(Handle handle) { return storage->parents[handle]; };
+	inline static ITransform* getOwner(Handle handle) { return storage->owners[handle]; };
+
+	static void setPosition(Handle handle, const glm::vec3& position);
+	/** The rotation is expected to be normalised. */
+	static void setRotation(Handle handle, const glm::quat& rotation);
+	static void setScale(Handle handle, const glm::vec3& scale);
+
+	inline static glm::vec3 getPosition(Handle handle) {
+		return glm::vec3(storage->positionX[handle], storage->positionY[handle], storage->positionZ[handle]);
+	};
+	inline static glm::quat getRotation(Handle handle) {
+		return glm::quat(storage->rotationW[handle], storage->rotationX[handle], storage->rotationY[handle], storage->rotationZ[handle]);
+	};
+	inline static glm::vec3 getScale(Handle handle) {
+		return glm::vec3(storage->scaleX[handle], storage->scaleY[handle], storage->scaleZ[handle]);
+	};
+	/**
+	* Returns the world matrix. Transforms changed since the last update() are computed on their own first, and the
+	* matrix of a slot with a parent is rebuilt from its ancestors if anything has moved since then. Only call on the
+	* main thread, as it may compute and cache matrices.
+	*/
+	static const glm::mat4& getMatrix(Handle handle);
+
+	/** Flags a transform as changed without changing it, e.g. when something its bounds depend on has changed. */
+	static void markChanged(Handle handle);
+
+	/**
+	* Computes the matrices of every transform changed since the last call and notifies their owners
+	* (see ITransform::onTransformUpdated()). Call once per frame after everything has moved.
+	*/
+	static void update();
+
+	inline static const Stats& getStats() { return getStorage().stats; };
+
+protected:
+	static Storage& getStorage();
+	/** Adds the slots changed on job threads to the main list. Call on the main thread with no jobs running. */
+	static void mergeThreadChanges();
+	/** Computes the matrices of a list of slots relative to their parents, a block at a time. */
+	static void computeMatrices(const Handle* handles, size_t count);
+	/** Rebuilds the depth-first list of slots with a parent. */
+	static void sortHierarchy();
+	/** Rebuilds the world matrices of the subtrees below every slot that has moved. */
+	static void updateHierarchy();
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <vector>
+#include <cstdint>
+
+class Entity;
+
+/**
+* State of the world published by the simulation thread after each tick, for the render thread to draw.
+* Each transform is stored as it was before and after the tick, so the renderer can interpolate to any time within
+* the tick without waiting for the next one. Transforms are in world space.
+*/
+struct WorldSnapshot {
+	struct TransformState {
+		glm::vec3 position = glm::vec3(0);
+		glm::quat rotation;
+		glm::vec3 scale = glm::vec3(1);
+	};
+
+	struct EntityState {
+		Entity* entity = nullptr;
+		TransformState previous;
+		TransformState current;
+	};
+
+	/** Only the camera transform is interpolated. The projection is the one it had after the tick. */
+	struct CameraState {
+		TransformState previous;
+		TransformState current;
+		glm::mat4 projectionMatrix;
+		float FOV = 0;
+		float screenWidth = 0;
+		float screenHeight = 0;
+		float nearClippingPlane = 0;
+		float farClippingPlane = 0;
+	};
+
+	std::vector<EntityState> entities;
+	// Entities of the world's lights, in the same order.
+	std::vector<EntityState> lights;
+	CameraState camera;
+
+	uint64_t tick = 0;
+	// Simulation clock time the tick started at, in seconds. The current states are for one interval later.
+	double time = 0;
+	double tickInterval = 0;
+};
@@ -3,21 +3,28 @@
 #include "Utils/Utils.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/quaternion.hpp"
+#include "Scene/TransformStore.h"
 
-/** A transform containing position, rotation and directional data. */
+/**
+* A transform containing position, rotation and directional data.
+* The components are kept in the TransformStore, and the transform holds a handle to its slot. Copies get their own
+* slot with the same values, without a parent.
+* Once a transform has a parent its position, rotation and scale are relative to the parent. The world versions
+* are read from the model matrix.
+*/
 class ITransform {
 
-private:
-	glm::vec3 position;
-	glm::fquat rotation;
-	glm::vec3 scale = glm::vec3(1);
+	friend class TransformStore;
 
-	// Directional vectors. Defaulted to global direction vectors.
-	glm::vec3 forwardVector = FORWARD_VECTOR;
-	glm::vec3 rightVector = RIGHT_VECTOR;
-	glm::vec3 upVector = UP_VECTOR;
+private:
+	TransformStore::Handle transformHandle;
 
 public:
+	ITransform();
+	ITransform(const ITransform& other);
+	ITransform& operator=(const ITransform& other);
+	virtual ~ITransform();
+
 	/**
 	* Sets the position of the entity to the specified position.
 	* Parameter: glm::vec3 newPosition  Position to move the entity to.
@@ -55,11 +62,43 @@ public:
 	void setScale(glm::vec3 scaleFactor);
 	void setScale(float scaleFactor);
 
-	inline glm::vec3 getPosition() { return position; }
-	inline glm::fquat getRotation() { return rotation; }
-	inline glm::vec3 getScale() { return scale; };
+	inline glm::vec3 getPosition() const { return TransformStore::getPosition(transformHandle); }
+	inline glm::fquat getRotation() const { return TransformStore::getRotation(transformHandle); }
+	inline glm::vec3 getScale() const { return TransformStore::getScale(transformHandle); };
+
+	// Directional vectors, rotated from the global direction vectors when requested.
+	inline glm::vec3 getForwardVector() const { return FORWARD_VECTOR * getRotation(); }
+	inline glm::vec3 getRightVector() const { return RIGHT_VECTOR * getRotation(); }
+	inline glm::vec3 getUpVector() const { return UP_VECTOR * getRotation(); }
+
+	/** Returns the world matrix built from the position, rotation and scale and those of any parents. Cached by the TransformStore. */
+	inline const glm::mat4& getModelMatrix() const { return TransformStore::getMatrix(transformHandle); };
+	inline TransformStore::Handle getTransformHandle() const { return transformHandle; };
+
+	/** Returns the position in world space. The same as getPosition() without a parent. */
+	inline glm::vec3 getWorldPosition() const { return glm::vec3(getModelMatrix()[3]); };
+	/** Returns the size of the world space scale along each local axis. */
+	glm::vec3 getWorldScale() const;
+	/** Returns the rotation in world space. The same as getRotation() without a parent. */
+	glm::quat getWorldRotation() const;
+
+protected:
+	/**
+	* Sets the parent transform, or detaches from it if null.
+	* Parameter: ITransform* parent  Transform to attach to.
+	* Parameter: bool keepWorldTransform  Whether to keep the world transform, rather than keep the local values and move to be relative to the parent.
+	* Returns: bool  False if the parent is this transform or one of its children.
+	*/
+	bool setParent(ITransform* parent, bool keepWorldTransform);
+	inline ITransform* getParentTransform() const {
+		TransformStore::Handle parent = TransformStore::getParent(transformHandle);
+		return (parent != TransformStore::INVALID_HANDLE) ? TransformStore::getOwner(parent) : nullptr;
+	};
+	/** Sets the position, rotation and scale from a matrix. Shear, e.g. from a non-uniformly scaled parent, is lost. */
+	void setFromMatrix(const glm::mat4& matrix);
 
-	inline glm::vec3 getForwardVector() { return forwardVector; }
-	inline glm::vec3 getRightVector() { return rightVector; }
-	inline glm::vec3 getUpVector() { return upVector; }
-};
\ No newline at end of file
+	/** Flags the transform as changed, so onTransformUpdated() is called even though it hasn't moved. */
+	inline void markTransformChanged() { TransformStore::markChanged(transformHandle); };
+	/** Called by TransformStore::update() once per frame if the position, rotation or scale has changed. */
+	virtual void onTransformUpdated() {}
+};
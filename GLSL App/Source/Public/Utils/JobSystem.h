@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+* Runs jobs on a pool of worker threads for the frame update.
+* Each thread has its own queue. A thread takes the newest job from its own queue, so jobs it spawns run while
+* their data is still in cache, and an idle thread steals the oldest job from another queue. The main thread, which
+* is whichever thread schedules jobs and waits on them, helps run jobs while it waits. That isn't the GL thread while
+* the World runs its simulation on its own thread.
+*
+* Jobs declare the shared state they read and write as access masks. A job scheduled after another whose access
+* conflicts with it (either writes what the other uses) waits for it to finish, so jobs touching the same state run in
+* the order they were scheduled and everything else runs in parallel. Jobs can also wait on each other explicitly.
+* parallelFor() forks a job into batches and is finished once all of them are (join).
+*
+* In single-threaded mode every job runs on the calling thread as soon as it can, which is in the order they were
+* scheduled, for debugging.
+*/
+class JobSystem {
+
+public:
+	typedef uint32_t AccessMask;
+	/** Shared state a job can read or write. */
+	enum EAccess : AccessMask {
+		ACCESS_NONE = 0,
+		// Positions, rotations and scales in the TransformStore. Batches of a job may each write the transforms of their own entities.
+		ACCESS_TRANSFORMS = 1 << 0,
+		// The InputManager, and input state kept by components, e.g. whether an InteractableComponent is selected.
+		ACCESS_INPUT = 1 << 1,
+		ACCESS_CAMERA = 1 << 2,
+		// The World's entity lists, scene bounds and model cache, and adding or removing components.
+		ACCESS_SCENE = 1 << 3,
+		// State only used on the thread that schedules jobs and waits on them. Jobs writing this are run on that thread
+		// while it waits. It's the simulation thread while the World has one, so GL calls go through
+		// World::runOnRenderThread() instead.
+		ACCESS_MAIN_THREAD = 1 << 4,
+		ACCESS_ALL = 0xFFFFFFFF
+	};
+
+	/** Most threads, including the main thread and the index shared by threads that aren't workers or the main thread. */
+	static constexpr size_t MAX_THREADS = 64;
+	/** Index of threads that are neither a worker nor the main thread, e.g. the render thread while the simulation has its own. */
+	static constexpr uint32_t OTHER_THREAD_INDEX = MAX_THREADS - 1;
+
+	/** Counters for the jobs run since the last waitAll(). */
+	struct Stats {
+		size_t jobs = 0;
+		// Jobs taken from another thread's queue.
+		size_t stolen = 0;
+		// Threads running jobs, including the main thread.
+		size_t threads = 1;
+	};
+
+protected:
+	struct Job {
+		std::function<void()> function;
+		AccessMask reads = ACCESS_NONE;
+		AccessMask writes = ACCESS_NONE;
+		// Job that spawned this one, which isn't finished until this is.
+		Job* parent = nullptr;
+		// The job itself plus its unfinished children.
+		std::atomic<uint32_t> unfinished{ 1 };
+		// Unfinished jobs this is waiting on, plus one held while it's being scheduled.
+		std::atomic<uint32_t> waitingOn{ 1 };
+		// Set once the job and its children have finished. Nothing touches the job afterwards.
+		std::atomic<bool> done{ false };
+		// Jobs waiting on this one, and whether it has finished. Guarded by dependencyMutex.
+		std::vector<Job*> continuations;
+		bool finished = false;
+	};
+
+public:
+	/** Refers to a scheduled job until the next waitAll(). */
+	typedef Job* JobHandle;
+
+protected:
+	/** Jobs ready to run on one thread. The owner takes from the back and thieves from the front. */
+	struct alignas(64) WorkQueue {
+		std::mutex mutex;
+		std::deque<Job*> jobs;
+	};
+
+	std::vector<std::thread> workers;
+	// Queue of each thread, main thread first.
+	std::unique_ptr<WorkQueue[]> queues;
+	// Jobs that must run on the main thread.
+	WorkQueue mainThreadQueue;
+	size_t numThreads = 1;
+	// Jobs allocated by each thread, freed together in waitAll(). Deques, so jobs never move.
+	std::unique_ptr<std::deque<Job>[]> jobStorage;
+	// Jobs scheduled since the last waitAll(), in order, to find conflicts.
+	std::vector<Job*> scheduled;
+	std::mutex dependencyMutex;
+
+	// Jobs in the worker queues, which sleeping workers wait for.
+	std::atomic<size_t> queuedJobs{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	bool stopping = false;
+	bool singleThreaded = false;
+
+	std::atomic<size_t> jobsRun{ 0 };
+	std::atomic<size_t> jobsStolen{ 0 };
+	Stats stats;
+
+public:
+	JobSystem();
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	/**
+	* Starts the worker threads, and makes the calling thread the main thread (see setMainThread()).
+	* Parameter: unsigned int numThreads  Number of workers. 0 uses one less than the number of hardware threads.
+	*/
+	void start(unsigned int numThreads = 0);
+	/** Stops the workers. Call with no jobs scheduled. */
+	void stop();
+
+	/**
+	* Schedules a job. Call on the main thread.
+	* Parameter: std::function<void()> function  Work to do.
+	* Parameter: AccessMask reads  Shared state the job reads.
+	* Parameter: AccessMask writes  Shared state the job writes.
+	* Parameter: const std::vector<JobHandle>& dependencies  Jobs to wait for, on top of those with conflicting access.
+	* Returns: JobHandle  The job, to wait on or depend on.
+	*/
+	JobHandle schedule(std::function<void()> function, AccessMask reads, AccessMask writes, const std::vector<JobHandle>& dependencies = {});
+	/**
+	* Schedules a job that splits a range into batches, which run in parallel with the same access. Call on the main thread.
+	* Parameter: size_t count  Size of the range.
+	* Parameter: size_t batchSize  Most items per batch.
+	* Parameter: std::function<void(size_t begin, size_t end)> function  Called for each batch.
+	* Returns: JobHandle  Job that is finished once every batch is.
+	*/
+	JobHandle parallelFor(size_t count, size_t batchSize, std::function<void(size_t begin, size_t end)> function,
+		AccessMask reads, AccessMask writes, const std::vector<JobHandle>& dependencies = {});
+
+	/** Runs jobs on the calling thread until a job and its children have finished. */
+	void wait(JobHandle job);
+	/** Waits for every scheduled job, then frees them. Handles are invalid afterwards. Call on the main thread once per frame. */
+	void waitAll();
+
+	/** Runs every job on the main thread, in the order they were scheduled. Change with no jobs scheduled. */
+	inline void setSingleThreaded(bool singleThreaded) { this->singleThreaded = singleThreaded; };
+	inline bool isSingleThreaded() const { return singleThreaded || workers.empty(); };
+	inline const Stats& getStats() const { return stats; };
+
+	/**
+	* Returns the index of the calling thread: 0 on the main thread, 1 and up on the workers, and OTHER_THREAD_INDEX on
+	* any other thread.
+	*/
+	static uint32_t getThreadIndex();
+	/**
+	* Makes the calling thread the main thread, which schedules jobs and waits on them. Only one thread is the main
+	* thread at a time, so the thread it's handed over from gets OTHER_THREAD_INDEX. Call with no jobs scheduled.
+	*/
+	static void setMainThread();
+
+protected:
+	Job* allocate();
+	/** Releases the hold taken while scheduling, queueing the job if it has nothing left to wait for. */
+	void release(Job* job);
+	void enqueue(Job* job);
+	void execute(Job* job);
+	/** Counts a job or one of its children as finished, then releases the jobs waiting on it. */
+	void finish(Job* job);
+	/** Takes a job from the thread's own queue, or steals one. Returns null if every queue is empty. */
+	Job* findJob(uint32_t index);
+	void workerLoop(uint32_t index);
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+* A read-only memory mapped file. The file is unmapped when the object is destroyed.
+*/
+class MappedFile {
+
+protected:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+	// Mappings can't be shared.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	* Maps a file into memory, closing any file already open.
+	* Returns: bool  False if the file doesn't exist, is empty or couldn't be mapped.
+	*/
+	bool open(const std::string& path);
+	void close();
+
+	inline bool isOpen() const { return data != nullptr; };
+	inline const unsigned char* getData() const { return data; };
+	inline size_t getSize() const { return size; };
+
+	/**
+	* Returns the last modified time of a file, or 0 if it doesn't exist.
+	* The units are platform dependent, so the value should only be compared against others from this function.
+	*/
+	static uint64_t getModifiedTime(const std::string& path);
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "Entities/Entity.h"
+#include "Graphics/MeshOptimiser.h"
+#include "Graphics/MeshSimplifier.h"
 
 class MeshUtils {
 
@@ -46,31 +48,74 @@ public:
 			}
 		}
 
-		// Triangulation.
-		int numFaces = verts.size();
-		int numTriangles = numFaces * 2;
-		int numIndices = numTriangles * 3;
-		indices.resize(numIndices);
+		// Triangulation. Two triangles per side of each ring.
+		indices.resize(rings * sides * 6);
 
 		int index = 0;
-		for (int seg = 0; seg <= rings; seg++) {
+		for (int seg = 0; seg < rings; seg++) {
 			for (int side = 0; side < sides; side++) {
 				int current = side + seg * (sides + 1);
-				int next = side + ((seg < rings) ? (seg + 1) * (sides + 1) : 0);
-				if (index < numIndices - 6) {
-					indices[index++] = current;
-					indices[index++] = next;
-					indices[index++] = next + 1;
+				int next = side + (seg + 1) * (sides + 1);
+				indices[index++] = current;
+				indices[index++] = next;
+				indices[index++] = next + 1;
 
-					indices[index++] = current;
-					indices[index++] = next + 1;
-					indices[index++] = current + 1;
-				}
+				indices[index++] = current;
+				indices[index++] = next + 1;
+				indices[index++] = current + 1;
 			}
 		}
+		MeshOptimiser::optimise(verts, indices).print("torus");
+
+		// Bounding radius from the furthest vertex, since the ring is offset from the origin.
+		float boundingRadius = 0;
+		for (auto& vert : verts) {
+			boundingRadius = glm::max(boundingRadius, glm::length(vert.position));
+		}
+
+		std::vector<MeshLOD> lods;
+		MeshSimplifier::buildLODs(verts, indices, boundingRadius, lods);
 
 		Model torusModel = Model();
-		torusModel.addMesh(verts, indices, std::vector<Texture>(), outerRadius);
+		torusModel.addMesh(std::move(verts), std::move(indices), std::vector<Texture>(), boundingRadius, lods);
 		return torusModel;
 	}
+
+	/**
+	* Creates a cube mesh centred on the origin, with a separate face for each side so normals are flat.
+	* Parameter: float halfSize  Distance from the centre to each face.
+	* Returns:   Model  Created cube model.
+	*/
+	inline static Model createCube(float halfSize) {
+		// Normal, and the right and up axes across the face, for each side.
+		const glm::vec3 faces[6][3] = {
+			{ glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) },
+			{ glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0) },
+			{ glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0) },
+			{ glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0) },
+			{ glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1) },
+			{ glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) }
+		};
+		const glm::vec2 corners[4] = { glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(1, 1), glm::vec2(0, 1) };
+
+		std::vector<Vertex> verts;
+		std::vector<GLuint> indices;
+		for (auto& face : faces) {
+			GLuint first = verts.size();
+			for (auto& corner : corners) {
+				glm::vec2 offset = corner * 2.f - 1.f;
+				Vertex vert = Vertex((face[0] + face[1] * offset.x + face[2] * offset.y) * halfSize);
+				vert.normal = face[0];
+				vert.texCoords = corner;
+				vert.tangent = face[1];
+				verts.push_back(vert);
+			}
+			indices.insert(indices.end(), { first, first + 1, first + 2, first + 2, first + 3, first });
+		}
+		MeshOptimiser::optimise(verts, indices).print("cube");
+
+		Model cubeModel = Model();
+		cubeModel.addMesh(std::move(verts), std::move(indices), std::vector<Texture>(), glm::sqrt(3.f) * halfSize);
+		return cubeModel;
+	}
 };
\ No newline at end of file
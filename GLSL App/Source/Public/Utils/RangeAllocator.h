@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+/**
+* First-fit allocator of ranges in a linear space, e.g. elements of a GPU buffer. Only offsets are handed out;
+* the memory itself is managed by the owner.
+* Free space is kept as blocks ordered by offset. Freed ranges are merged with the blocks either side of them.
+*/
+class RangeAllocator {
+
+public:
+	/** Offset returned when there is no block large enough. */
+	static constexpr uint32_t INVALID = 0xFFFFFFFF;
+
+protected:
+	// Size of each free block, keyed on its offset.
+	std::map<uint32_t, uint32_t> freeBlocks;
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+
+public:
+	RangeAllocator(uint32_t capacity = 0) {
+		grow(capacity);
+	}
+
+	/** Returns the offset of a free range of the size, or INVALID if there isn't one. */
+	inline uint32_t allocate(uint32_t size) {
+		if (size == 0) return 0;
+		for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block) {
+			if (block->second < size) continue;
+
+			uint32_t offset = block->first;
+			uint32_t remaining = block->second - size;
+			freeBlocks.erase(block);
+			if (remaining > 0) freeBlocks[offset + size] = remaining;
+			used += size;
+			return offset;
+		}
+		return INVALID;
+	}
+
+	/** Returns a range given by allocate() to the free space. */
+	inline void free(uint32_t offset, uint32_t size) {
+		if (size == 0) return;
+		used -= size;
+
+		auto next = freeBlocks.lower_bound(offset);
+		// Merge with the following block.
+		if (next != freeBlocks.end() && offset + size == next->first) {
+			size += next->second;
+			next = freeBlocks.erase(next);
+		}
+		// Merge with the preceding block.
+		if (next != freeBlocks.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+		freeBlocks[offset] = size;
+	}
+
+	/** Adds space to the end. Existing ranges are unchanged. */
+	inline void grow(uint32_t newCapacity) {
+		if (newCapacity <= capacity) return;
+		uint32_t oldCapacity = capacity;
+		capacity = newCapacity;
+		// Added as a freed range so it joins a free block at the end.
+		used += newCapacity - oldCapacity;
+		free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	inline uint32_t getCapacity() const { return capacity; };
+	inline uint32_t getUsed() const { return used; };
+	inline size_t getNumFreeBlocks() const { return freeBlocks.size(); };
+	/** Size of the largest range that can currently be allocated. */
+	inline uint32_t getLargestFreeBlock() const {
+		uint32_t largest = 0;
+		for (auto& block : freeBlocks) {
+			if (block.second > largest) largest = block.second;
+		}
+		return largest;
+	}
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+* Hands the newest version of a value from one thread to another without either of them waiting.
+* The writer fills the back buffer and publishes it by swapping it with the middle buffer. The reader swaps the
+* middle buffer for its front buffer whenever a newer value has been published, so it always reads a complete
+* value and the writer always has a buffer to fill. Versions published faster than they're read are skipped.
+*/
+template<typename T>
+class TripleBuffer {
+
+protected:
+	// Flag in the middle index set while it holds a value the reader hasn't taken.
+	static constexpr uint8_t NEW_VALUE = 4;
+	static constexpr uint8_t INDEX_MASK = 3;
+
+	T buffers[3];
+	std::atomic<uint8_t> middle{ 1 };
+	// Only used by the writer and reader respectively.
+	uint8_t back = 0;
+	uint8_t front = 2;
+
+public:
+	/** Returns the buffer to fill. It still holds whatever was written to it before. Writer only. */
+	inline T& getBackBuffer() { return buffers[back]; };
+	/** Makes the back buffer the newest value. Writer only. */
+	inline void publish() {
+		back = middle.exchange(back | NEW_VALUE, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	/** Takes the newest value if one has been published since the last call. Returns whether it did. Reader only. */
+	inline bool update() {
+		if (!(middle.load(std::memory_order_acquire) & NEW_VALUE)) return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	/** Returns the value taken by the last update(). Reader only. */
+	inline const T& getFrontBuffer() const { return buffers[front]; };
+};
@@ -7,6 +7,7 @@
 #include "GL/freeglut.h"
 #include "glm/detail/type_vec.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include "Graphics/GLHandle.h"
 
 // Small number for small float comparison accuracy.
 #define SMALL_NUMBER 0.00001
@@ -34,9 +35,9 @@ public:
 	};
 
 	/** Loads a texture from a file using SOIL. */
-	inline static int loadTexture(const char* path) {
+	inline static GLTexture loadTexture(const char* path) {
 		std::cout << "Loading texture: " << path << std::endl;
-		return SOIL_load_OGL_texture(path, SOIL_LOAD_AUTO, 0, SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS);
+		return GLTexture(SOIL_load_OGL_texture(path, SOIL_LOAD_AUTO, 0, SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS));
 	}
 	inline static unsigned char* loadTextureRaw(const char* path, int width, int height) {
 		std::cout << "Loading texture: " << path << std::endl;
@@ -49,9 +50,9 @@ public:
 	};
 
 	/** Loads a cubemap from a file using SOIL. Each file is a single face on the cube. */
-	inline static int loadCubemap(const char* rightfile, const char* leftFile, const char* topFile, const char* bottomFile, const char* backFile, const char* frontFile) {
+	inline static GLTexture loadCubemap(const char* rightfile, const char* leftFile, const char* topFile, const char* bottomFile, const char* backFile, const char* frontFile) {
 		std::cout << "Loading cubemap" << std::endl;
-		GLuint cubemap = SOIL_load_OGL_cubemap(rightfile, leftFile, topFile, bottomFile, backFile, frontFile, SOIL_LOAD_AUTO, 0, 0);
+		GLTexture cubemap = GLTexture(SOIL_load_OGL_cubemap(rightfile, leftFile, topFile, bottomFile, backFile, frontFile, SOIL_LOAD_AUTO, 0, 0));
 		// Ensure the cubemap stretches from edge to edge to prevent seams.
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -88,11 +89,11 @@ public:
 	struct Vars {
 		/** Model matrix. */
 		static constexpr const char* MODEL = "model";
-		/**View matrix. */
+		/** View matrix. Member of the camera uniform block. */
 		static constexpr const char* VIEW = "view";
-		/** Projection matrix. */
+		/** Projection matrix. Member of the camera uniform block. */
 		static constexpr const char* PROJECTION = "projection";
-		/** Camera position. */
+		/** Camera position. Member of the camera uniform block. */
 		static constexpr const char* VIEW_POSITION = "viewPosition";
 
 		/** Material diffuse. Should be followed by a number e.g. diffuse1 */
@@ -110,8 +111,18 @@ public:
 		/** Whether the material has a valid normal map set. */
 		static constexpr const char* MAT_HAS_NORMALMAP = "material.hasNormalMap";
 
-		/** Selection colour code. */
-		static constexpr const char* COLOUR_CODE = "colourCode";
+		/** Entity ID written to the selection buffer. */
+		static constexpr const char* ENTITY_ID = "entityId";
+
+		/** Whether the model matrix comes from the per-instance attribute rather than MODEL. */
+		static constexpr const char* INSTANCED = "instanced";
+		/** Whether the material comes from the draw buffer, indexed by DRAW_OFFSET + gl_DrawIDARB. */
+		static constexpr const char* MULTI_DRAW = "multiDraw";
+		/** Index in the draw buffer of the first draw of a multi-draw call. */
+		static constexpr const char* DRAW_OFFSET = "drawOffset";
+		/** Offset and scale to dequantise compact vertex positions with. See GeometryArena::Range. */
+		static constexpr const char* POSITION_OFFSET = "positionOffset";
+		static constexpr const char* POSITION_SCALE = "positionScale";
 	};	
 
 public:
@@ -223,12 +234,15 @@ public:
 		}
 	}
 
-	inline static GLuint createShaderProgram(GLuint& vertexShader, GLuint& fragmentShader) {
-		GLuint programObj = glCreateProgram();
+	inline static GLProgram createShaderProgram(GLuint vertexShader, GLuint fragmentShader) {
+		GLProgram programObj = GLProgram::create();
 		glAttachShader(programObj, vertexShader);
 		glAttachShader(programObj, fragmentShader);
 
 		glLinkProgram(programObj);
+		// The linked program doesn't need the shaders, so detach them to let them be deleted.
+		glDetachShader(programObj, vertexShader);
+		glDetachShader(programObj, fragmentShader);
 
 		// Check if the link was successful.
 		GLint result;
@@ -255,11 +269,11 @@ public:
 	* Compiles a vertex and fragment shader and creates a GL Shader program with them.
 	* Parameter: const char* vertexShaderFile  Path to the vertex shader file.
 	* Parameter: const char* fragmentShaderFile  Path to the fragment shader file.
-	* Returns: GLuint  Created shader program handle.
+	* Returns: GLProgram  Created shader program. The shaders are deleted once it's linked.
 	*/
-	inline static GLuint createShaderProgram(const char* vertexShaderFile, const char* fragmentShaderFile) {
-		GLuint vertexShaderObj = glCreateShader(GL_VERTEX_SHADER);
-		GLuint fragmentShaderObj = glCreateShader(GL_FRAGMENT_SHADER);
+	inline static GLProgram createShaderProgram(const char* vertexShaderFile, const char* fragmentShaderFile) {
+		GLShader vertexShaderObj = GLShader::create(GL_VERTEX_SHADER);
+		GLShader fragmentShaderObj = GLShader::create(GL_FRAGMENT_SHADER);
 
 		// Read and compile the shaders.
 		ShaderLoader::loadShader(vertexShaderObj, vertexShaderFile);
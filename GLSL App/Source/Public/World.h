@@ -1,5 +1,12 @@
 #pragma once
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "glm\gtc\matrix_transform.hpp"
 #include "Graphics/Model.h"
 #include "Utils\Utils.h"
@@ -7,11 +14,59 @@
 #include "Entities/Camera.h"
 #include "Input/InputManager.h"
 #include "Entities/Light.h"
+#include "Graphics/ShaderProgram.h"
+#include "Graphics/UniformBuffer.h"
+#include "Graphics/LightGrid.h"
+#include "Graphics/RenderQueue.h"
+#include "Graphics/Frustum.h"
+#include "Graphics/LODSelector.h"
+#include "Graphics/AssetLoader.h"
+#include "Scene/BVH.h"
+#include "Utils/JobSystem.h"
+#include "Utils/TripleBuffer.h"
+#include "Scene/WorldSnapshot.h"
 
 
 class World {
 
+public:
+	/** A model file and the settings to import it with, see loadModels(). */
+	struct ModelRequest {
+		std::string path;
+		Model::ImportSettings importSettings;
+
+		ModelRequest(const std::string& path) : path(path) {}
+		ModelRequest(const std::string& path, const Model::ImportSettings& importSettings) : path(path), importSettings(importSettings) {}
+	};
+
+	/** Model every light is drawn with. */
+	static constexpr const char* LIGHT_MODEL = "assets/models/ball.obj";
+
+	/** An entity or light to draw, with its world transform for the frame. */
+	struct RenderItem {
+		Entity* entity;
+		glm::mat4 matrix;
+		glm::vec3 position;
+		// Largest world scale axis, and the bounding radius scaled by it.
+		float maxScale;
+		float boundingRadius;
+	};
+
+	/** Counters for the simulation thread. */
+	struct SimulationStats {
+		uint64_t ticks = 0;
+		// Ticks dropped to catch up after the simulation fell behind.
+		uint64_t skippedTicks = 0;
+		// Time taken by the last tick, in milliseconds.
+		double lastTickMs = 0;
+	};
+
+	/** Most ticks run back to back to catch up before the rest are dropped. */
+	static constexpr int MAX_CATCH_UP_TICKS = 5;
+
 protected:
+	// Entities and lights keyed on their ID. Declared first so it's destroyed last, after every entity that removes itself from it.
+	std::unordered_map<GLuint, Entity*> entityIds;
 	// Input manager for the world.
 	class InputManager inputManager;
 
@@ -21,7 +76,7 @@ protected:
 	// Skybox cube model.
 	Model skybox;
 	// Cubemap texture to use for the skybox.
-	GLuint skyboxTexture;
+	GLTexture skyboxTexture;
 
 	// Lights in the world.
 	std::vector<Light::Lightptr> lights;
@@ -32,10 +87,76 @@ protected:
 	// Entity to render lights with. Reused for each light in the scene.
 	Entity lightEntity;
 
+	// Models loaded from file, keyed on path and import settings, so entities using the same file share meshes.
+	std::map<std::string, Model> modelCache;
+	// Loads models in the background for createEntityAsync().
+	AssetLoader assetLoader;
+	// Runs the component updates in parallel.
+	JobSystem jobSystem;
+	// Callbacks waiting for each model being loaded in the background, keyed the same as the model cache.
+	std::map<std::string, std::vector<std::function<void(bool success, const Model&)>>> pendingModels;
+	// Model shown by entities whose own model is still loading.
+	Model placeholderModel;
+	// Bounds of every entity and light, for spatial queries.
+	BVH sceneBVH;
+	// IDs of entities that have moved since the scene bounds were last updated. Looked up when the bounds are updated,
+	// so an entity destroyed in between is skipped.
+	std::vector<GLuint> dirtyBounds;
+	// Incremented whenever an entity or light in the scene is added or moves.
+	unsigned int sceneVersion = 0;
+
+	// Entities and lights inside the camera frustum, rebuilt before selection.
+	std::vector<Entity::EntityPtr> visibleEntitiesAndLights;
+	// Culling scratch data, kept between frames to avoid reallocating.
+	BoundingSphereArray cullSpheres;
+	std::vector<uint8_t> cullResults;
+	// Number of entities and lights rejected by the last render cull.
+	size_t numCulled = 0;
+
+	// Entity draws for the current frame, sorted by state and merged into instanced draws.
+	RenderQueue renderQueue;
+	// Picks the level of detail of each entity mesh from its size on screen.
+	LODSelector lodSelector;
+
 	// Shaders.
-	GLuint objectShader;
-	GLuint lightShader;
-	GLuint skyboxShader;
+	ShaderProgram objectShader;
+	ShaderProgram lightShader;
+	ShaderProgram skyboxShader;
+	// Light shader colour location.
+	GLint lightColourLocation;
+
+	// --- Simulation thread, see startSimulationThread().
+	std::thread simulationThread;
+	// Held by the simulation thread during each tick, and by anything changing the world from another thread while it runs.
+	std::mutex simulationMutex;
+	std::atomic<bool> stopSimulation{ false };
+	bool simulationThreaded = false;
+	double tickInterval = 1.0 / 60;
+	std::chrono::steady_clock::time_point simulationStart;
+	// Guarded by simulationMutex.
+	SimulationStats simulationStats;
+	// Snapshots from the simulation thread for the render thread.
+	TripleBuffer<WorldSnapshot> snapshots;
+	// Entity states of the last published snapshot, the previous states of the next. Simulation thread only.
+	std::vector<WorldSnapshot::EntityState> lastEntityStates;
+	std::vector<WorldSnapshot::EntityState> lastLightStates;
+	WorldSnapshot::TransformState lastCameraState;
+	// Work for the render thread queued by the simulation thread, e.g. window calls made by input bindings.
+	std::mutex renderTasksMutex;
+	std::vector<std::function<void()>> renderTasks;
+
+	// What is drawn this frame, from the current transforms or interpolated from the latest snapshot. Render thread only.
+	CameraView renderCamera;
+	std::vector<RenderItem> renderEntities;
+	std::vector<RenderItem> renderLights;
+	std::vector<RenderItem> visibleRenderEntities;
+	std::vector<RenderItem> visibleRenderLights;
+	std::vector<LightGrid::LightInstance> lightInstances;
+
+	// Per-frame uniform blocks shared by every shader program.
+	UniformBuffer cameraBuffer;
+	// Clustered light lists for the object shader.
+	LightGrid lightGrid;
 
 public:
 	World();
@@ -46,32 +167,137 @@ public:
 
 	/**
 	* Creates an entity in the world with the specified model and returns a reference.
+	* Entities created from the same file share its meshes, so are rendered together with instancing.
 	* Parameter: GLchar* path  Path to the model to use for the entity.
 	* Returns: EntityPtr  Created entity reference.
 	*/
 	Entity::EntityPtr createEntity(GLchar* path, Model::ImportSettings importSettings = Model::ImportSettings());
 	Entity::EntityPtr createEntity(Model model);
+	/**
+	* Creates an entity that shows a placeholder until its model has loaded in the background.
+	* If the model fails to load, the failure is logged and the entity keeps the placeholder.
+	* Parameter: GLchar* path  Path to the model to use for the entity.
+	* Parameter: Model::ImportSettings importSettings  Settings to import with.
+	* Parameter: std::function<void(Entity&)> onLoaded  Called once the entity's model is set, e.g. to add textures to it. Not called if loading fails.
+	* Returns: EntityPtr  Created entity reference.
+	*/
+	Entity::EntityPtr createEntityAsync(GLchar* path, Model::ImportSettings importSettings = Model::ImportSettings(), std::function<void(Entity&)> onLoaded = nullptr);
+
+	/**
+	* Returns the model for a file, loading it the first time it's requested.
+	* Parameter: GLchar* path  Path to the model file.
+	* Parameter: Model::ImportSettings importSettings  Settings to import with. Different settings are cached separately.
+	* Returns: Model  Model sharing the cached meshes.
+	*/
+	Model getModel(GLchar* path, Model::ImportSettings importSettings = Model::ImportSettings());
+	/**
+	* Gets the model for a file, loading it in the background if it isn't cached.
+	* Requests for a file that is already loading share the same load.
+	* Parameter: const std::string& path  Path to the model file.
+	* Parameter: Model::ImportSettings importSettings  Settings to import with.
+	* Parameter: std::function<void(bool success, const Model&)> onLoaded  Called with the model once it's ready, or
+	* with false and an empty model if it failed to load. Called immediately if it's cached.
+	*/
+	void getModelAsync(const std::string& path, Model::ImportSettings importSettings, std::function<void(bool success, const Model&)> onLoaded);
+	/**
+	* Loads a batch of models into the model cache and waits for them, e.g. at startup.
+	* The files are imported in parallel on the asset loader's workers and uploaded on this thread as each one finishes,
+	* so entities created from them afterwards get their models straight away. Models already cached are skipped.
+	* Anything else queued on the asset loader is also finished before this returns.
+	* Parameter: const std::vector<ModelRequest>& requests  Models to load.
+	* Returns: size_t  Number of the requested models that are now cached.
+	*/
+	size_t loadModels(const std::vector<ModelRequest>& requests);
 
 	// Adds a light to the world.
 	//void addLight(Light& light);
-	void addLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular);
+	void addLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float radius = 50.f);
 
 	/** Create and set a new skybox texture. Each file is a face on the cube. */
 	void setSkyboxTexture(const char* rightfile, const char* leftFile, const char* topFile, const char* bottomFile, const char* backFile, const char* frontFile);
 
-	// Update entities in the world.
+	/**
+	* Updates the world by a frame. While the simulation has its own thread, this only uploads loaded models and
+	* runs the tasks queued for the render thread.
+	*/
 	void update(float deltaTime);
-	// Render the world.
+	/** Render the world. While the simulation has its own thread, the latest snapshot is drawn, interpolated to the current time. */
 	void render();
 
-	/** Updates the View, Projection uniforms for a shader. */
-	void updateVP(GLuint& ShaderProgram);
+	/**
+	* Moves the simulation onto its own thread, which updates the world at a fixed tick rate and publishes a snapshot
+	* of the transforms after each tick. The render thread draws the snapshots, interpolated between the states before
+	* and after the tick, so it can render as often as it likes while the simulation steps by the same amount each tick.
+	* Window input is queued and applied at the start of each tick, and picking is done on the CPU.
+	* Components are updated from the simulation thread, including jobs writing JobSystem::ACCESS_MAIN_THREAD, so
+	* anything needing the GL context must be passed to runOnRenderThread().
+	* Anything changing the world from the render thread must hold lockSimulation() while the thread runs.
+	* Parameter: double ticksPerSecond  Fixed simulation rate.
+	*/
+	void startSimulationThread(double ticksPerSecond = 60);
+	/** Waits for the current tick, then moves the simulation back into update(). */
+	void stopSimulationThread();
+	inline bool isSimulationThreaded() const { return simulationThreaded; };
+	/** Locks the world against the simulation thread until the lock is released. Does nothing to wait for without the thread. */
+	inline std::unique_lock<std::mutex> lockSimulation() { return std::unique_lock<std::mutex>(simulationMutex); };
+	/** Runs a task on the render thread before its next frame, or straight away if the simulation doesn't have its own thread. */
+	void runOnRenderThread(std::function<void()> task);
+	/** Returns a copy of the simulation counters. */
+	SimulationStats getSimulationStats();
+
+	/** Queues an entity's scene bounds to be updated at the end of the world update. Entities not in the scene are ignored. */
+	void markBoundsDirty(Entity* entity);
+	/** Computes the model matrices of every transform that has changed (see TransformStore), then updates the scene bounds of every entity that has moved. */
+	void updateSceneBounds();
+
+	/** Writes the camera view, projection and position to the shared camera block. */
+	void updateCameraBuffer(const CameraView& view);
+	/** Bins every light into the clustered light grid for the current camera. */
+	void updateLightBuffer();
 	
 	inline InputManager& getInputManager() { return inputManager; };
 	inline Camera& getCamera() { return camera; };
+	inline const RenderQueue& getRenderQueue() const { return renderQueue; };
+	inline LODSelector& getLODSelector() { return lodSelector; };
+	inline size_t getNumCulled() const { return numCulled; };
+	inline const BVH& getSceneBVH() const { return sceneBVH; };
+	inline AssetLoader& getAssetLoader() { return assetLoader; };
+	inline JobSystem& getJobSystem() { return jobSystem; };
+	/** Returns the entity or light with an ID, or null if there isn't one. */
+	Entity* findEntity(GLuint id);
+	/** Removes a destroyed entity from the ID map. Called by ~Entity(). */
+	void removeEntityId(const Entity* entity);
+	/** Returns a counter that changes whenever an entity or light in the scene has been added or moved. The camera and other entities outside the scene don't change it. */
+	inline unsigned int getSceneVersion() const { return sceneVersion; };
 	//inline std::vector<Entity*>& getEntities() { return entities; };
 	inline std::vector<Entity::EntityPtr>& getEntities() { return entities; };
 
 protected:
 	void createShaders();
+	/** Returns the model cache key of a file imported with some settings. */
+	inline static std::string getModelKey(const std::string& path, const Model::ImportSettings& importSettings) { return path + "|" + importSettings.getKey(); };
+
+	/** Steps the camera, input, components and scene bounds. Called by update(), or each tick on the simulation thread. */
+	void simulate(float deltaTime);
+	void simulationLoop();
+	/** Publishes the world state after a tick for the render thread. Also used to publish the starting state. */
+	void publishSnapshot(uint64_t tick, double time);
+	/** Runs the tasks queued for the render thread. */
+	void runRenderTasks();
+	/** Fills the render lists for the frame. */
+	void gatherRenderItems();
+	/** Tests the bounding sphere of each item against a frustum, filling visible with those at least partially inside. Returns the number culled. */
+	size_t cullRenderItems(const Frustum& frustum, const std::vector<RenderItem>& source, std::vector<RenderItem>& visible);
+
+	/** Returns the frustum of the camera's current view and projection. */
+	Frustum getCameraFrustum();
+	/**
+	* Tests the bounding sphere of each entity against a frustum.
+	* Parameter: const Frustum& frustum  Frustum to test against.
+	* Parameter: const std::vector<std::shared_ptr<T>>& source  Entities to test.
+	* Parameter: std::vector<std::shared_ptr<T>>& visible  Cleared, then filled with the entities that are at least partially inside.
+	* Returns: size_t  Number of entities culled.
+	*/
+	template<typename T>
+	size_t cullEntities(const Frustum& frustum, const std::vector<std::shared_ptr<T>>& source, std::vector<std::shared_ptr<T>>& visible);
 };
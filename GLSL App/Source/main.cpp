@@ -17,6 +17,14 @@
 #include "Components/RotatingComponent.h"
 #include "Components/InteractableComponent.h"
 #include "Utils/MeshUtils.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/TextureManager.h"
+#include "Graphics/StagingBuffer.h"
+#include "Graphics/GeometryArena.h"
+#include "Graphics/GLHandle.h"
+#include <memory>
+#include <chrono>
+#include <cstring>
 
 void init();
 void idle();
@@ -27,15 +35,19 @@ void onMouse(int button, int state, int x, int y);
 void onMouseMoved(int x, int y);
 void onKeyDown(unsigned char key, int x, int y);
 void onKeyUp(unsigned char key, int x, int y);
+void onClose();
 
 Entity::EntityPtr createTorus(float outerRadius, float innerRadius, int majorSegments, int minorSegments);
 
 
-// Current world instance.
-World world;
+// Current world instance. Destroyed in onClose() while the GL context still exists.
+std::unique_ptr<World> world;
+
+// Whether the world is simulated on its own thread, set with --threaded.
+bool threadedSimulation = false;
 
 // Delta time and FPS vars.
-int lastElapsedTime = 0; // Last time the delta time was calculated.
+std::chrono::steady_clock::time_point lastFrameTime = std::chrono::steady_clock::now(); // Last time the delta time was calculated.
 float frameTimeCounter = 0; // Frame time counter for counting seconds.
 int frame; // frame counter for calculating fps.
 float deltaTime; // Last frame delta time.
@@ -45,6 +57,9 @@ int fps; // Current FPS.
 
 int main(int argc, char** argv) {
 	glutInit(&argc, argv);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threaded") == 0) threadedSimulation = true;
+	}
 	glutInitWindowPosition(10, 10);
 	glutInitWindowSize(1280, 720);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
@@ -57,6 +72,9 @@ int main(int argc, char** argv) {
 	glutKeyboardUpFunc(onKeyUp);
 	glutMouseFunc(onMouse);
 	glutMotionFunc(onMouseMoved);
+	glutCloseFunc(onClose);
+	// Return from the main loop when the window closes rather than exiting the process straight away.
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 
 	glewInit();
 	init();
@@ -69,8 +87,9 @@ int main(int argc, char** argv) {
 void init() {
 	glEnable(GL_DEPTH_TEST);
 
-	world.init();
-	world.setSkyboxTexture(
+	world.reset(new World());
+	world->init();
+	world->setSkyboxTexture(
 		"assets/skybox/sea/sea_rt.jpg",
 		"assets/skybox/sea/sea_lf.jpg",
 		"assets/skybox/sea/sea_up.jpg",
@@ -79,36 +98,57 @@ void init() {
 		"assets/skybox/sea/sea_ft.jpg"
 	);
 
-	Entity::EntityPtr cube1 = world.createEntity("assets/models/cube.obj");
-	cube1->model.addTexture("assets/models/crate_diffuse.jpg", ShaderLoader::Vars::MAT_DIFFUSE);
-	cube1->model.addTexture("assets/models/crate_specular.jpg", ShaderLoader::Vars::MAT_SPECULAR);
-	cube1->model.addTexture("assets/models/crate_normal.jpg", ShaderLoader::Vars::MAT_NORMAL);
-	cube1->model.setMaterial(
-		glm::vec3(1), // diffuse
-		glm::vec3(4), // specular
-		64 // shininess,
-	);
+	// High-poly models are stored with compact vertices.
+	Model::ImportSettings shipImportSettings;
+	shipImportSettings.compactVertices = true;
+	Model::ImportSettings hulkImportSettings;
+	hulkImportSettings.invertYCoord = true; // Y texture coord needs inverting.
+	hulkImportSettings.compactVertices = true;
+
+	// Import the startup models in parallel and wait for them, along with the light model the world queued.
+	int loadStartTime = glutGet(GLUT_ELAPSED_TIME);
+	size_t modelsLoaded = world->loadModels({
+		World::ModelRequest("assets/models/cube.obj"),
+		World::ModelRequest("assets/models/ship/ship.obj", shipImportSettings),
+		World::ModelRequest("assets/models/wall/wall.obj"),
+		World::ModelRequest("assets/models/Hulk/Hulk.obj", hulkImportSettings)
+	});
+	std::cout << "Loaded " << modelsLoaded << " models in " << glutGet(GLUT_ELAPSED_TIME) - loadStartTime << "ms" << std::endl;
+
+	// The models are cached, so these get them straight away. Textures and materials are applied in the callbacks.
+	Entity::EntityPtr cube1 = world->createEntityAsync("assets/models/cube.obj", Model::ImportSettings(), [](Entity& entity) {
+		entity.model.addTexture("assets/models/crate_diffuse.jpg", ShaderLoader::Vars::MAT_DIFFUSE);
+		entity.model.addTexture("assets/models/crate_specular.jpg", ShaderLoader::Vars::MAT_SPECULAR);
+		entity.model.addTexture("assets/models/crate_normal.jpg", ShaderLoader::Vars::MAT_NORMAL);
+		entity.model.setMaterial(
+			glm::vec3(1), // diffuse
+			glm::vec3(4), // specular
+			64 // shininess,
+		);
+	});
 	cube1->setPosition(2, 0, 0);
 	cube1->addComponent<InteractableComponent>();
 	RotatingComponent* cubeRotComp = cube1->addComponent<RotatingComponent>();
 	cubeRotComp->axis = UP_VECTOR - RIGHT_VECTOR;
 	cubeRotComp->speed = 10;
 
-	Entity::EntityPtr ship = world.createEntity("assets/models/ship/ship.obj");
-	ship->model.addTexture("assets/models/ship/SF_Corvette-F3_specular.jpg", ShaderLoader::Vars::MAT_SPECULAR);
+	Entity::EntityPtr ship = world->createEntityAsync("assets/models/ship/ship.obj", shipImportSettings, [](Entity& entity) {
+		entity.model.addTexture("assets/models/ship/SF_Corvette-F3_specular.jpg", ShaderLoader::Vars::MAT_SPECULAR);
+	});
 	ship->setPosition(20, -5, 0);
 	ship->addComponent<InteractableComponent>();
 	RotatingComponent* shipRotComp = ship->addComponent<RotatingComponent>();
 	shipRotComp->axis = UP_VECTOR;
 	shipRotComp->speed = 20;
 
-	Entity::EntityPtr wall = world.createEntity("assets/models/wall/wall.obj");
-	wall->model.addTexture("assets/models/wall/brickwall_normal.jpg", ShaderLoader::Vars::MAT_NORMAL);
-	wall->model.setMaterial(
-		glm::vec3(1),
-		glm::vec3(3),
-		100
-	);
+	Entity::EntityPtr wall = world->createEntityAsync("assets/models/wall/wall.obj", Model::ImportSettings(), [](Entity& entity) {
+		entity.model.addTexture("assets/models/wall/brickwall_normal.jpg", ShaderLoader::Vars::MAT_NORMAL);
+		entity.model.setMaterial(
+			glm::vec3(1),
+			glm::vec3(3),
+			100
+		);
+	});
 	wall->setPosition(10, 0, -10);
 	wall->rotateBy(90, wall->getRightVector());
 	wall->addComponent<InteractableComponent>();
@@ -116,13 +156,11 @@ void init() {
 	wallRotComp->axis = wall->getUpVector();
 	wallRotComp->speed = 5;
 
-	Model::ImportSettings hulkImportSettings;
-	hulkImportSettings.invertYCoord = true; // Y texture coord needs inverting.
-	auto hulk = world.createEntity("assets/models/Hulk/Hulk.obj", hulkImportSettings);
+	auto hulk = world->createEntityAsync("assets/models/Hulk/Hulk.obj", hulkImportSettings);
 	hulk->setPosition(20, -5, 10);
 	hulk->addComponent<InteractableComponent>();
 
-	auto torus = world.createEntity(MeshUtils::createTorus(1, 0.8f, 25, 20));
+	auto torus = world->createEntity(MeshUtils::createTorus(1, 0.8f, 25, 20));
 	torus->model.addTexture("assets/models/crate_diffuse.jpg", ShaderLoader::Vars::MAT_DIFFUSE);
 	torus->model.setMaterial(
 		glm::vec3(1),
@@ -136,7 +174,7 @@ void init() {
 	torusRotComp->speed = 5;
 	torusRotComp->axis = RIGHT_VECTOR;
 
-	auto torus2 = world.createEntity(MeshUtils::createTorus(2, 1, 30, 30));
+	auto torus2 = world->createEntity(MeshUtils::createTorus(2, 1, 30, 30));
 	torus2->model.addTexture("assets/models/wall/brickwall.jpg", ShaderLoader::Vars::MAT_DIFFUSE);
 	torus2->model.setMaterial(
 		glm::vec3(1),
@@ -149,13 +187,27 @@ void init() {
 	RotatingComponent* torus2RotComp = torus2->addComponent<RotatingComponent>();
 	torus2RotComp->speed = 10;
 	torus2RotComp->axis = UP_VECTOR + RIGHT_VECTOR;
+
+	const TextureManager::Stats& textureStats = TextureManager::getStats();
+	std::cout << "Textures: " << textureStats.textures << " loaded (" << textureStats.bytes / (1024 * 1024) << " MB), "
+		<< textureStats.hits << " shared" << std::endl;
+
+	// Everything is set up, so the simulation can take over updating the world.
+	if (threadedSimulation) {
+		world->startSimulationThread(60);
+		std::cout << "Simulating at 60 ticks per second on its own thread" << std::endl;
+	}
 }
 
 void idle() {
+	// The world is gone once the window starts closing.
+	if (!world) return;
+
 	// Update delta time.
-	int elapsedTime = glutGet(GLUT_ELAPSED_TIME);
-	deltaTime = (elapsedTime - lastElapsedTime) * 0.001f;
-	lastElapsedTime = elapsedTime;
+	// GLUT's clock only counts whole milliseconds, too coarse to interpolate between simulation ticks.
+	std::chrono::steady_clock::time_point frameTime = std::chrono::steady_clock::now();
+	deltaTime = std::chrono::duration<float>(frameTime - lastFrameTime).count();
+	lastFrameTime = frameTime;
 
 	// Calculate frames per second.
 	frame++;
@@ -166,20 +218,51 @@ void idle() {
 		frameTimeCounter -= 1.f; // Minus 1, rather than setting to 0, so no time is discarded.
 		frame = 0;
 	}
-	std::cout << "\rFPS: " << fps << std::flush;
+	const RenderState::Stats& renderStats = RenderState::getStats();
+	// The simulation thread updates the job stats during each tick.
+	JobSystem::Stats jobStats;
+	{
+		auto lock = world->lockSimulation();
+		jobStats = world->getJobSystem().getStats();
+	}
+	World::SimulationStats simulationStats = world->getSimulationStats();
+	std::cout << "\rFPS: " << fps
+		<< "  Culled: " << world->getNumCulled()
+		<< "  Draws: " << renderStats.drawCalls
+		<< "  Programs: " << renderStats.programChanges
+		<< "  VAOs: " << renderStats.vertexArrayChanges
+		<< "  Textures: " << renderStats.textureChanges
+		<< "  Skipped: " << renderStats.redundantChanges
+		<< "  Tris: " << world->getRenderQueue().getStats().triangles / 1000 << "k/" << world->getRenderQueue().getStats().fullDetailTriangles / 1000 << "k"
+		<< "  Upload: " << StagingBuffer::getStats().bytesUploaded / 1024 << " KB"
+		<< "  Fence wait: " << StagingBuffer::getStats().fenceWaitMs << " ms"
+		<< "  Jobs: " << jobStats.jobs << " on " << jobStats.threads << " threads"
+		<< "  Loading: " << (int)(world->getAssetLoader().getProgress() * 100) << "%";
+	if (world->isSimulationThreaded()) {
+		std::cout << "  Ticks: " << simulationStats.ticks << " (" << simulationStats.skippedTicks << " skipped, "
+			<< simulationStats.lastTickMs << " ms)";
+	}
+	std::cout
+		<< "   " << std::flush;
 	//
 
 	glutPostRedisplay();
 }
 
 void display() {
+	if (!world) return;
+	// Forget cached GL state and reset the frame counters.
+	RenderState::beginFrame();
+	// Fence last frame's streamed data.
+	StagingBuffer::beginFrame();
+
 	glClearColor(0, 0, 0, 1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// Update the world.
-	world.update(deltaTime);
+	world->update(deltaTime);
 	// Render the world.
-	world.render();
+	world->render();
 
 	glutSwapBuffers();
 }
@@ -187,27 +270,44 @@ void display() {
 void reshape(int w, int h) {
 	if (h == 0) h = 1;
 	glViewport(0, 0, w, h);
+	if (!world) return;
 
-	// Update camera rendering settings.
-	world.getCamera().updateMatrices(70.f, w, h, 1.f, 300.f);
+	// Update camera rendering settings. The simulation thread reads them during each tick.
+	auto lock = world->lockSimulation();
+	world->getCamera().updateMatrices(70.f, w, h, 1.f, 300.f);
 
 	glutPostRedisplay();
 }
 
 
 //--- Input.
+// Input can still arrive after onClose() has destroyed the world.
 void onMouse(int button, int state, int x, int y) {
-	world.getInputManager().onMouse(button, state, x, y);
+	if (!world) return;
+	world->getInputManager().onMouse(button, state, x, y);
 }
 
 void onMouseMoved(int x, int y) {
-	world.getInputManager().onMouseMoved(x, y);
+	if (!world) return;
+	world->getInputManager().onMouseMoved(x, y);
 }
 
 void onKeyDown(unsigned char key, int x, int y) {
-	world.getInputManager().onKeyDown(key, x, y);
+	if (!world) return;
+	world->getInputManager().onKeyDown(key, x, y);
 }
 
 void onKeyUp(unsigned char key, int x, int y) {
-	world.getInputManager().onKeyUp(key, x, y);
-}
\ No newline at end of file
+	if (!world) return;
+	world->getInputManager().onKeyUp(key, x, y);
+}
+
+void onClose() {
+	// Everything owning GL objects is freed while the context is still current, then anything left over is reported.
+	world.reset();
+	TextureManager::clear();
+	GeometryArena::shutdown();
+	StagingBuffer::shutdown();
+	RenderState::shutdown();
+	GLObjects::report();
+}
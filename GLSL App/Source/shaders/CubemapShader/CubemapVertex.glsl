@@ -3,8 +3,12 @@
 // Renders a cubemapped object.
 layout (location = 0) in vec3 position;
 
-uniform mat4 view;
-uniform mat4 projection;
+// Per-frame camera data shared by all programs.
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
 
 out vec3 texCoord;
 
@@ -12,5 +16,6 @@ out vec3 texCoord;
 void main(void) 
 {
 	texCoord = position;
-	gl_Position = (projection * view * vec4(position, 1.0f)).xyww;	
+	// Remove the translation component from the view matrix so the skybox stays stationary.
+	gl_Position = (projection * mat4(mat3(view)) * vec4(position, 1.0f)).xyww;	
 }
\ No newline at end of file
@@ -1,4 +1,4 @@
-#version 400 core
+#version 430 core
 
 struct Material {
 	// Diffuse maps.
@@ -19,63 +19,129 @@ struct Material {
 	float shininess;
 };
 
+// Must match LightGrid::GPULight.
 struct Light {
-	vec3 position;
-	vec3 ambient; // Ambient intensity & colour.
-	vec3 diffuse; // Diffuse intensity & colour.
-	vec3 specular; // Specular intensity & colour.
+	vec4 positionRadius; // xyz = position, w = radius of influence.
+	vec4 ambient; // Ambient intensity & colour. Applied through ambientLight rather than per cluster.
+	vec4 diffuse; // Diffuse intensity & colour.
+	vec4 specular; // Specular intensity & colour.
+};
+
+
+// Material of each draw in a multi-draw. Must match RenderQueue::DrawData.
+struct DrawData {
+	vec4 diffuseColour;
+	vec4 specularColour; // w = shininess.
+	vec4 positionOffset;
+	vec4 positionScale;
 };
 
 
 uniform Material material;
-#define NUM_LIGHTS 2
-uniform Light lights[NUM_LIGHTS];
 
-uniform vec3 viewPosition;
+// Clustered lighting. Bindings must match LightGrid::EStorageBinding.
+layout (std430, binding = 0) readonly buffer LightBuffer {
+	Light lights[];
+};
+// Offset (x) and count (y) into lightIndices for each cluster.
+layout (std430, binding = 1) readonly buffer ClusterBuffer {
+	uvec2 clusters[];
+};
+layout (std430, binding = 2) readonly buffer LightIndexBuffer {
+	uint lightIndices[];
+};
+// Binding must match RenderQueue::DRAW_DATA_BINDING.
+layout (std430, binding = 3) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+// Per-frame cluster grid parameters.
+layout (std140) uniform LightBlock {
+	uvec4 gridSize; // xyz = clusters along each axis, w = number of lights.
+	vec4 screenSize; // xy = viewport size in pixels.
+	vec4 depthSlicing; // x = near, y = far, z = depth slice scale, w = depth slice bias.
+	vec4 ambientLight; // rgb = ambient of every light added together.
+};
+
+// Per-frame camera data shared by all programs.
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
+
 in vec2 texCoord;
 in vec3 normal;
 in vec3 fragPosition;
 in mat3 tbn; // Tangent, bitangent normal matrix for converting from tangent to world space.
+flat in int drawIndex; // Index into draws, or -1 to use the material uniforms.
 vec3 worldNormal; // Tangent normal converted with the tangent, bitangent, normal matrix to world space.
+// Material colours, from the uniforms or the draw buffer.
+vec3 diffuseColour;
+vec3 specularColour;
+float shininess;
 
 out vec4 colour;
 
 vec4 calcLight(Light light, vec4 objDiffuse, vec4 objSpecular) {
-	// Ambient lighting.
-	vec3 ambientLighting = light.ambient;
+	// Smooth falloff to 0 at the light radius, so the light can be culled beyond it. Only the diffuse and specular
+	// lighting falls off, as ambient lighting is added for every light in main().
+	vec3 toLight = light.positionRadius.xyz - fragPosition;
+	float distanceRatio = length(toLight) / light.positionRadius.w;
+	float attenuation = clamp(1.0 - pow(distanceRatio, 4.0), 0.0, 1.0);
+	attenuation *= attenuation;
 
 	// Diffuse lighting.
-	vec3 lightDir = normalize(light.position - fragPosition);
-	vec3 diffuseLighting = max(dot(worldNormal, lightDir), 0.f) * light.diffuse;
+	vec3 lightDir = normalize(toLight);
+	vec3 diffuseLighting = max(dot(worldNormal, lightDir), 0.f) * light.diffuse.rgb * attenuation;
 
 	// Blinn-Phong Specular value based on angle between the normal and the half vector between the view and the light.
 	vec3 viewDir = normalize(viewPosition - fragPosition);
 	vec3 halfDir = normalize(lightDir + viewDir);
-	vec3 specularLighting = pow(max(dot(worldNormal, halfDir), 0.f), material.shininess) * light.specular;
+	vec3 specularLighting = pow(max(dot(worldNormal, halfDir), 0.f), shininess) * light.specular.rgb * attenuation;
 
 	// Combine lighting components.
-	vec4 fragColour = vec4(ambientLighting, 1) * objDiffuse;
-	fragColour += vec4(diffuseLighting, 1) * objDiffuse;
+	vec4 fragColour = vec4(diffuseLighting, 1) * objDiffuse;
 	fragColour += vec4(specularLighting, 1) * objSpecular;
 
 	return fragColour;
 }
 
+// Returns the index of the cluster this fragment is in.
+uint getClusterIndex() {
+	// Exponential depth slice from the view-space depth.
+	float depth = -(view * vec4(fragPosition, 1)).z;
+	uint slice = uint(max(log(depth) * depthSlicing.z + depthSlicing.w, 0.0));
+	slice = min(slice, gridSize.z - 1);
+	// Screen tile.
+	uvec2 tile = uvec2(gl_FragCoord.xy / screenSize.xy * vec2(gridSize.xy));
+	tile = min(tile, gridSize.xy - 1);
+	return tile.x + gridSize.x * (tile.y + gridSize.y * slice);
+}
+
 void main(void)
 {
+	diffuseColour = material.diffuseColour;
+	specularColour = material.specularColour;
+	shininess = material.shininess;
+	if (drawIndex >= 0) {
+		diffuseColour = draws[drawIndex].diffuseColour.rgb;
+		specularColour = draws[drawIndex].specularColour.rgb;
+		shininess = draws[drawIndex].specularColour.w;
+	}
+
 	// Diffuse map colour of the fragment.
 	vec4 diffuse1 = texture(material.diffuse1, texCoord);
 	// For second textures.
 	//vec4 diffuse2 = texture(material.diffuse2, texCoord);
 	//vec4 objDiffuse = (diffuse1 + diffuse2) * vec4(material.diffuseColour, 1);
-	vec4 objDiffuse = (diffuse1) * vec4(material.diffuseColour, 1);
+	vec4 objDiffuse = (diffuse1) * vec4(diffuseColour, 1);
 
 	// Specular map colour of the fragment.
 	vec4 specular1 = texture(material.specular1, texCoord);
 	// For second textures.
 	//vec4 specular2 = texture(material.specular2, texCoord);
 	//vec4 objSpecular = (specular1 + specular2) * vec4(material.specularColour, 1);
-	vec4 objSpecular = (specular1) * vec4(material.specularColour, 1);
+	vec4 objSpecular = (specular1) * vec4(specularColour, 1);
 
 	worldNormal = normal; // Default to the normal.	
 	// If there's a normal map, use the normal map sample normal and convert to
@@ -89,9 +155,11 @@ void main(void)
 		worldNormal = normalize(tbn * worldNormal);
 	}
 	
-	// Calculate Blinn-phong shading for each light.
-	for (int i=0; i < NUM_LIGHTS; i++) {
-		colour += calcLight(lights[i], objDiffuse, objSpecular);
+	// Ambient lighting of every light, then Blinn-phong shading for each light in this fragment's cluster.
+	colour = vec4(ambientLight.rgb, 1) * objDiffuse;
+	uvec2 cluster = clusters[getClusterIndex()];
+	for (uint i=0; i < cluster.y; i++) {
+		colour += calcLight(lights[lightIndices[cluster.x + i]], objDiffuse, objSpecular);
 	}
 	//colour = vec4(1);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
-#version 400 core
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
 
 //uniform float uStretch;
 //attribute float someAttribute // A value specific to this vertex. Uniform is global.
@@ -8,6 +9,8 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 vertNormal;
 layout (location = 2) in vec2 vertTexCoord;
 layout (location = 3) in vec3 vertTangent;
+// Per-instance model matrix, used instead of the model uniform when instanced is set.
+layout (location = 4) in mat4 instanceModel;
 
 out vec2 texCoord;
 out vec3 normal;
@@ -17,24 +20,58 @@ out vec3 fragPosition; // Fragment position in world space.
 // as the calculations would be done less times. However for this project, due to time constraints, 
 // the tangent normal is instead converted to world space.
 out mat3 tbn; 
+// Index of this draw's material in the draw buffer, or -1 to use the material uniforms.
+flat out int drawIndex;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool instanced;
+// Set when drawn with glMultiDrawElementsIndirect. drawOffset is the draw buffer index of the call's first draw.
+uniform bool multiDraw;
+uniform int drawOffset;
+// Compact vertex positions are stored within the mesh bounds. Identity for full vertices.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Per-draw data for multi-draw. Must match RenderQueue::DrawData.
+struct DrawData {
+	vec4 diffuseColour;
+	vec4 specularColour;
+	vec4 positionOffset;
+	vec4 positionScale;
+};
+layout (std430, binding = 3) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+// Per-frame camera data shared by all programs.
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
 mat4 modelViewProjection;
 
 
 void main(void) 
 {
+	mat4 modelMatrix = (instanced) ? instanceModel : model;
+#ifdef GL_ARB_shader_draw_parameters
+	drawIndex = (multiDraw) ? drawOffset + gl_DrawIDARB : -1;
+#else
+	drawIndex = -1;
+#endif
+	vec3 meshPosition = (drawIndex >= 0)
+		? draws[drawIndex].positionOffset.xyz + position * draws[drawIndex].positionScale.xyz
+		: positionOffset + position * positionScale;
+
 	texCoord = vertTexCoord;
 	// Ensure the normal is normalised.
 	normal = normalize(vertNormal);
 
 	//--- Tangent to world space matrix calculation.
 	// Normal in world space.
-	vec3 worldNormal = normalize(vec3(model * vec4(vertNormal, 0))); 
+	vec3 worldNormal = normalize(vec3(modelMatrix * vec4(vertNormal, 0))); 
 	// Tangent in world space.
-	vec3 tangent = normalize(vec3(model * vec4(vertTangent, 0)));
+	vec3 tangent = normalize(vec3(modelMatrix * vec4(vertTangent, 0)));
 	// Calculate bitangent as the cross of the normal and the tangent.
 	vec3 bitangent = cross(tangent, normal);
 	// Construct the tangent to world-space matrix for normal mapping.
@@ -42,8 +79,8 @@ void main(void)
 	//--- 
 
 	// Fragment position in world space.
-	fragPosition = vec3(model * vec4(position, 1.0f));
+	fragPosition = vec3(modelMatrix * vec4(meshPosition, 1.0f));
 
-	modelViewProjection = projection * view * model;
-	gl_Position = modelViewProjection * vec4(position, 1.0f);	
+	modelViewProjection = projection * view * modelMatrix;
+	gl_Position = modelViewProjection * vec4(meshPosition, 1.0f);	
 }
\ No newline at end of file
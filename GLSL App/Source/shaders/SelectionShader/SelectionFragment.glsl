@@ -1,14 +1,12 @@
 #version 400 core
 
-// Unique code to use as the colour component.
-// For more than 255 objects, this would be changed to use a vec4.
-uniform int colourCode;
+// ID of the entity being rendered. 0 is reserved for no entity.
+uniform uint entityId;
 
-out vec4 colour;
+out uint id;
 
 
 void main(void)
 {
-	//colour = vec4(colourCode/255.0, 0, 0, 0);
-	colour = vec4(colourCode/255.0, 0, 0, 1);
+	id = entityId;
 }
\ No newline at end of file
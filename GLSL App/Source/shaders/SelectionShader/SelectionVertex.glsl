@@ -3,13 +3,20 @@
 // Renders an object with a unique colour for selection.
 layout (location = 0) in vec3 position;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Compact vertex positions are stored within the mesh bounds. Identity for full vertices.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+// Per-frame camera data shared by all programs.
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
 mat4 modelViewProjection;
 
 
 void main(void) 
 {
 	modelViewProjection = projection * view * model;
-	gl_Position = modelViewProjection * vec4(position, 1.0f);	
+	gl_Position = modelViewProjection * vec4(positionOffset + position * positionScale, 1.0f);	
 }
\ No newline at end of file